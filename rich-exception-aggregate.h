@@ -0,0 +1,329 @@
+//----------------------------------------------------------------------------
+// Copyright (c) 2015, Codalogic Ltd (http://www.codalogic.com)
+// All rights reserved.
+//
+// The license for this file is based on the BSD-3-Clause license
+// (http://www.opensource.org/licenses/BSD-3-Clause).
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//
+// - Redistributions of source code must retain the above copyright notice,
+//   this list of conditions and the following disclaimer.
+// - Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+// - Neither the name Codalogic Ltd nor the names of its contributors may be
+//   used to endorse or promote products derived from this software without
+//   specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//----------------------------------------------------------------------------
+
+//----------------------------------------------------------------------------
+// Collecting many errors and reporting them together.
+//
+// RichExceptionAggregate collects the RichExceptions raised while, for
+// example, validating many records on many threads, so that all of the
+// failures can be reported rather than just the first.  Errors are grouped
+// by the error URI of their most recent node, and each group counts its
+// errors and keeps the first max_examples_per_group of them as examples,
+// held as RichExceptionHandles.
+//
+// Each worker adds errors to its own RichAggregateCollector, which needs
+// no locking, and merges them into the aggregate when it is destroyed (or
+// flushed).  throw_if_any() then throws a single RichAggregateException
+// describing all the errors.  For example:
+//
+//      RichExceptionAggregate failures;
+//
+//      // On each worker thread
+//      RichAggregateCollector collector( failures );
+//      for( size_t i = first; i < last; ++i )
+//      {
+//          try { validate( records[i] ); }
+//          catch( const RichException & e ) { collector.add( e ); }
+//      }
+//
+//      // Once the workers have finished
+//      failures.throw_if_any();
+//      ...
+//      catch( const RichAggregateException & e )
+//      {
+//          for( RichErrorGroups::const_iterator i( e.groups().begin() ), i_end( e.groups().end() );
+//                  i != i_end;
+//                  ++i )
+//              log << i->error_uri() << " x " << i->count() << ": " << i->front();
+//      }
+//
+// The aggregate's groups are spread over lock-striped shards, so errors can
+// also be added to it directly from several threads, e.g. by code that
+// only raises an occasional error.
+//
+// RichAggregateException's own node has the error URI
+// "com.codalogic.rich_excep.aggregate" and the parameters n_errors and
+// n_groups, and is chained to the first example of the largest group.
+// (Requires C++11.)
+//----------------------------------------------------------------------------
+
+#ifndef RICH_EXCEPTION_AGGREGATE
+#define RICH_EXCEPTION_AGGREGATE
+
+#include "rich-exception.h"
+
+#if defined( RICH_EXCEPTION_CXX11 )
+
+#include <algorithm>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace rich_excep {
+
+class RichErrorGroup
+{
+private:
+    const char * p_error_uri;
+    RichUriId uri_id;
+    unsigned long long n_errors;
+    std::vector< RichExceptionHandle > examples;
+
+public:
+    typedef const RichExceptionHandle & const_reference;
+    typedef std::vector< RichExceptionHandle >::const_iterator const_iterator;
+
+    RichErrorGroup() : p_error_uri( "" ), uri_id( 0 ), n_errors( 0 ) {}
+
+    const char * error_uri() const { return p_error_uri; }
+    RichUriId error_uri_id() const { return uri_id; }
+    unsigned long long count() const { return n_errors; }     // Including errors not kept as examples
+
+    // The examples
+    bool empty() const { return examples.empty(); }
+    size_t size() const { return examples.size(); }
+    const_reference front() const { return examples.front(); }
+    const_iterator begin() const { return examples.begin(); }
+    const_iterator end() const { return examples.end(); }
+
+private:
+    friend class RichExceptionAggregate;
+    friend class RichAggregateCollector;
+
+    void add( const RichException & r_exception, size_t max_examples )
+    {
+        if( n_errors++ == 0 )
+        {
+            p_error_uri = r_exception.main_error_uri();
+            uri_id = r_exception.main_error_uri_id();
+        }
+        if( examples.size() < max_examples )
+            examples.push_back( RichExceptionHandle( r_exception ) );
+    }
+    void merge( RichErrorGroup & r_other, size_t max_examples )   // Takes r_other's examples
+    {
+        if( n_errors == 0 )
+        {
+            p_error_uri = r_other.p_error_uri;
+            uri_id = r_other.uri_id;
+        }
+        n_errors += r_other.n_errors;
+        for( size_t i = 0; i < r_other.examples.size() && examples.size() < max_examples; ++i )
+            examples.push_back( std::move( r_other.examples[i] ) );
+    }
+};
+
+// An immutable snapshot of an aggregate's groups, largest group first.
+// Copies share the groups.
+class RichErrorGroups
+{
+private:
+    std::shared_ptr< const std::vector< RichErrorGroup > > p_groups;
+    unsigned long long n_errors;
+
+public:
+    typedef const RichErrorGroup & const_reference;
+    typedef std::vector< RichErrorGroup >::const_iterator const_iterator;
+
+    RichErrorGroups() : p_groups( std::make_shared< std::vector< RichErrorGroup > >() ), n_errors( 0 ) {}
+    explicit RichErrorGroups( std::vector< RichErrorGroup > && groups_in )
+        :
+        n_errors( 0 )
+    {
+        std::sort( groups_in.begin(), groups_in.end(), is_larger );
+        for( size_t i = 0; i < groups_in.size(); ++i )
+            n_errors += groups_in[i].count();
+        p_groups = std::make_shared< std::vector< RichErrorGroup > >( std::move( groups_in ) );
+    }
+
+    unsigned long long count() const { return n_errors; }     // Errors in all the groups
+
+    const_iterator find( RichUriId error_uri_id_in ) const     // Returns end() if there is no such group
+    {
+        for( const_iterator i( begin() ), i_end( end() ); i != i_end; ++i )
+            if( i->error_uri_id() == error_uri_id_in )
+                return i;
+        return end();
+    }
+    bool has( RichUriId error_uri_id_in ) const { return find( error_uri_id_in ) != end(); }
+
+    bool empty() const { return p_groups->empty(); }
+    size_t size() const { return p_groups->size(); }
+    const_reference front() const { return p_groups->front(); }
+    const_iterator begin() const { return p_groups->begin(); }
+    const_iterator end() const { return p_groups->end(); }
+
+private:
+    static bool is_larger( const RichErrorGroup & r_lhs, const RichErrorGroup & r_rhs )
+    {
+        if( r_lhs.count() != r_rhs.count() )
+            return r_lhs.count() > r_rhs.count();
+        return r_lhs.error_uri_id() < r_rhs.error_uri_id();
+    }
+};
+
+class RichAggregateException : public RichException
+{
+private:
+    RichErrorGroups error_groups;
+
+public:
+    explicit RichAggregateException( const RichErrorGroups & error_groups_in )
+        :
+        RichException( make( error_groups_in ) ),
+        error_groups( error_groups_in )
+    {}
+
+    const RichErrorGroups & groups() const { return error_groups; }
+
+private:
+    static RichException make( const RichErrorGroups & r_groups )
+    {
+        RichExceptionParams params;
+        params.add( "n_errors", r_groups.count() ).add( "n_groups", r_groups.size() );
+        if( ! r_groups.empty() && ! r_groups.front().empty() )
+            return RichException( "com.codalogic.rich_excep.aggregate", params, "Multiple errors", r_groups.front().front() );
+        return RichException( "com.codalogic.rich_excep.aggregate", params, "Multiple errors" );
+    }
+};
+
+class RichExceptionAggregate
+{
+private:
+    static const size_t n_shards = 16;
+
+    struct Shard
+    {
+        std::mutex mutex;
+        std::unordered_map< RichUriId, RichErrorGroup > groups;
+    };
+
+    const size_t max_examples;
+    Shard shards[n_shards];
+
+public:
+    explicit RichExceptionAggregate( size_t max_examples_per_group = 4 ) : max_examples( max_examples_per_group ) {}
+
+    size_t max_examples_per_group() const { return max_examples; }
+
+    void add( const RichException & r_exception )
+    {
+        Shard & r_shard( shard( r_exception.main_error_uri_id() ) );
+        std::lock_guard< std::mutex > lock( r_shard.mutex );
+        r_shard.groups[r_exception.main_error_uri_id()].add( r_exception, max_examples );
+    }
+    void add( const RichExceptionHandle & r_handle ) { add( r_handle.get() ); }
+
+    RichErrorGroups snapshot()
+    {
+        std::vector< RichErrorGroup > groups;
+        for( size_t i = 0; i < n_shards; ++i )
+        {
+            std::lock_guard< std::mutex > lock( shards[i].mutex );
+            for( std::unordered_map< RichUriId, RichErrorGroup >::const_iterator j( shards[i].groups.begin() ), j_end( shards[i].groups.end() );
+                    j != j_end;
+                    ++j )
+                groups.push_back( j->second );
+        }
+        return RichErrorGroups( std::move( groups ) );
+    }
+
+    void throw_if_any()     // Throws a RichAggregateException if any errors have been added
+    {
+        RichErrorGroups groups( snapshot() );
+        if( ! groups.empty() )
+            throw RichAggregateException( groups );
+    }
+
+    void clear()
+    {
+        for( size_t i = 0; i < n_shards; ++i )
+        {
+            std::lock_guard< std::mutex > lock( shards[i].mutex );
+            shards[i].groups.clear();
+        }
+    }
+
+private:
+    RichExceptionAggregate( const RichExceptionAggregate & );                 // Not implemented
+    RichExceptionAggregate & operator = ( const RichExceptionAggregate & );   // Not implemented
+
+    friend class RichAggregateCollector;
+
+    Shard & shard( RichUriId error_uri_id ) { return shards[(error_uri_id ^ (error_uri_id >> 32)) & (n_shards - 1)]; }
+
+    void merge( std::unordered_map< RichUriId, RichErrorGroup > & r_groups )
+    {
+        for( std::unordered_map< RichUriId, RichErrorGroup >::iterator i( r_groups.begin() ), i_end( r_groups.end() );
+                i != i_end;
+                ++i )
+        {
+            Shard & r_shard( shard( i->first ) );
+            std::lock_guard< std::mutex > lock( r_shard.mutex );
+            r_shard.groups[i->first].merge( i->second, max_examples );
+        }
+        r_groups.clear();
+    }
+};
+
+// Buffers one thread's errors for a RichExceptionAggregate.  A collector
+// must only be used by one thread at a time.
+class RichAggregateCollector
+{
+private:
+    RichExceptionAggregate & r_aggregate;
+    std::unordered_map< RichUriId, RichErrorGroup > groups;
+
+public:
+    explicit RichAggregateCollector( RichExceptionAggregate & r_aggregate_in ) : r_aggregate( r_aggregate_in ) {}
+    ~RichAggregateCollector() { flush(); }
+
+    void add( const RichException & r_exception )
+    {
+        groups[r_exception.main_error_uri_id()].add( r_exception, r_aggregate.max_examples_per_group() );
+    }
+    void add( const RichExceptionHandle & r_handle ) { add( r_handle.get() ); }
+
+    void flush() { r_aggregate.merge( groups ); }   // Moves the buffered errors to the aggregate
+
+private:
+    RichAggregateCollector( const RichAggregateCollector & );                 // Not implemented
+    RichAggregateCollector & operator = ( const RichAggregateCollector & );   // Not implemented
+};
+
+}   // Namespace namespace rich_excep
+
+#endif  // RICH_EXCEPTION_CXX11
+
+#endif  // RICH_EXCEPTION_AGGREGATE
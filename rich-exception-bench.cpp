@@ -0,0 +1,419 @@
+//----------------------------------------------------------------------------
+// Copyright (c) 2015, Codalogic Ltd (http://www.codalogic.com)
+// All rights reserved.
+//
+// The license for this file is based on the BSD-3-Clause license
+// (http://www.opensource.org/licenses/BSD-3-Clause).
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//
+// - Redistributions of source code must retain the above copyright notice,
+//   this list of conditions and the following disclaimer.
+// - Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+// - Neither the name Codalogic Ltd nor the names of its contributors may be
+//   used to endorse or promote products derived from this software without
+//   specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//----------------------------------------------------------------------------
+
+//----------------------------------------------------------------------------
+// Measures the cost of constructing, throwing, rendering, inspecting and
+// fingerprinting RichExceptions, alongside std::runtime_error and
+// std::nested_exception baselines.
+//
+// Build and run using "make bench".  The results are written to stdout as
+// CSV with the columns:
+//      benchmark,case,n,ns_per_op,allocs_per_op
+// where n is the number of parameters, chain depth or similar for the
+// benchmark, and allocs_per_op counts calls to the global operator new.
+// (Memory for the thrown exception objects themselves is obtained by the
+// C++ runtime and is not counted.)
+//----------------------------------------------------------------------------
+
+#include "rich-exception.h"
+#include "rich-exception-serialize.h"
+#include "rich-exception-json.h"
+#include "rich-exception-result.h"
+#include "rich-exception-suppress.h"
+#include "rich-exception-log-sink.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <exception>
+#include <new>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+using namespace rich_excep;
+
+namespace {
+
+long n_heap_allocations = 0;
+
+}   // namespace
+
+void * operator new( size_t size )
+{
+    ++n_heap_allocations;
+    void * p = malloc( size ? size : 1 );
+    if( ! p )
+        throw std::bad_alloc();
+    return p;
+}
+void operator delete( void * p ) noexcept
+{
+    free( p );
+}
+#if __cplusplus >= 201402L
+void operator delete( void * p, size_t ) noexcept
+{
+    free( p );
+}
+#endif
+
+namespace {
+
+volatile size_t sink;
+
+// Operations taking a few hundred nanoseconds or less use n_fast_iterations.
+// Those that throw use n_throw_iterations, divided by the number of throws
+// made per operation.
+const long n_fast_iterations = 2000000;
+const long n_throw_iterations = 200000;
+
+const char * const names[] = {
+        "request_id", "shard", "tenant", "user", "region", "zone", "host", "pid",
+        "thread", "attempt", "timeout", "deadline", "trace", "span", "route", "method",
+        "p16", "p17", "p18", "p19", "p20", "p21", "p22", "p23",
+        "p24", "p25", "p26", "p27", "p28", "p29", "p30", "p31" };
+
+template< typename Tfunction >
+void measure( const char * benchmark, const char * test_case, size_t n, long n_iterations, Tfunction function )
+{
+    function();     // Warm up
+    long n_allocations_at_start = n_heap_allocations;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for( long i = 0; i < n_iterations; ++i )
+        function();
+    std::chrono::steady_clock::duration elapsed = std::chrono::steady_clock::now() - start;
+    long n_allocations = n_heap_allocations - n_allocations_at_start;
+    printf( "%s,%s,%zu,%.1f,%.2f\n",
+            benchmark, test_case, n,
+            std::chrono::duration< double, std::nano >( elapsed ).count() / n_iterations,
+            static_cast< double >( n_allocations ) / n_iterations );
+}
+
+RichExceptionParams make_params( size_t n_params )
+{
+    RichExceptionParams params;
+    for( size_t i = 0; i < n_params; ++i )
+        params.add( names[i], i );
+    return params;
+}
+
+void bench_construction( size_t n_params )
+{
+    measure( "construct", "rich", n_params, n_fast_iterations, [=]() {
+                RichException e( "com.codalogic.bench.construct", make_params( n_params ), "Construction" );
+                sink = sink + e.size();
+            } );
+    // The nearest equivalent to recording parameters in a std::runtime_error
+    // is to format them into its message.
+    measure( "construct", "runtime_error", n_params, n_fast_iterations, [=]() {
+                std::string message( "Construction" );
+                for( size_t i = 0; i < n_params; ++i )
+                {
+                    message += ' ';
+                    message += names[i];
+                    message += '=';
+                    message += std::to_string( i );
+                }
+                std::runtime_error e( message );
+                sink = sink + *e.what();
+            } );
+}
+
+void throw_rich( size_t depth )
+{
+    if( depth == 1 )
+        throw RichException( "com.codalogic.bench.root", RichExceptionParams().add( "depth", depth ), "Root cause" );
+    try
+    {
+        throw_rich( depth - 1 );
+    }
+    catch( RichException & e )
+    {
+        throw RichException( "com.codalogic.bench.wrap", RichExceptionParams().add( "depth", depth ), "Wrapper", std::move( e ) );
+    }
+}
+
+void throw_runtime_error( size_t depth )
+{
+    if( depth == 1 )
+        throw std::runtime_error( "Root cause: depth=1" );
+    try
+    {
+        throw_runtime_error( depth - 1 );
+    }
+    catch( std::runtime_error & )
+    {
+        throw std::runtime_error( "Wrapper: depth=" + std::to_string( depth ) );
+    }
+}
+
+void throw_nested( size_t depth )
+{
+    if( depth == 1 )
+        throw std::runtime_error( "Root cause: depth=1" );
+    try
+    {
+        throw_nested( depth - 1 );
+    }
+    catch( std::exception & )
+    {
+        std::throw_with_nested( std::runtime_error( "Wrapper: depth=" + std::to_string( depth ) ) );
+    }
+}
+
+size_t nested_depth( const std::exception & r_e )
+{
+    try
+    {
+        std::rethrow_if_nested( r_e );
+    }
+    catch( std::exception & r_cause )
+    {
+        return 1 + nested_depth( r_cause );
+    }
+    return 1;
+}
+
+void bench_throw_chain( size_t depth )
+{
+    long n_iterations = n_throw_iterations / static_cast< long >( depth );
+    measure( "throw_chain", "rich", depth, n_iterations, [=]() {
+                try
+                {
+                    throw_rich( depth );
+                }
+                catch( const RichException & e )
+                {
+                    sink = sink + e.size();
+                }
+            } );
+    // A std::runtime_error chain can't report the earlier exceptions, and so
+    // is the lower bound of what chaining can cost
+    measure( "throw_chain", "runtime_error", depth, n_iterations, [=]() {
+                try
+                {
+                    throw_runtime_error( depth );
+                }
+                catch( const std::runtime_error & e )
+                {
+                    sink = sink + *e.what();
+                }
+            } );
+    // Inspecting a std::nested_exception chain requires rethrowing each level
+    measure( "throw_chain", "nested_exception", depth, n_iterations / 2, [=]() {
+                try
+                {
+                    throw_nested( depth );
+                }
+                catch( const std::exception & e )
+                {
+                    sink = sink + nested_depth( e );
+                }
+            } );
+}
+
+RichResult< size_t > fail_rich_result( size_t depth )
+{
+    if( depth == 1 )
+        return RichError( "com.codalogic.bench.root", RichExceptionParams().add( "depth", depth ), "Root cause" );
+    RichResult< size_t > inner( fail_rich_result( depth - 1 ) );
+    if( ! inner.ok() )
+        return RichError( "com.codalogic.bench.wrap", RichExceptionParams().add( "depth", depth ), "Wrapper", std::move( inner.error() ) );
+    return inner;
+}
+
+void bench_result_chain( size_t depth )
+{
+    // The same failures as bench_throw_chain(), returned instead of thrown
+    measure( "result_chain", "rich_result", depth, n_fast_iterations / static_cast< long >( depth ), [=]() {
+                RichResult< size_t > result( fail_rich_result( depth ) );
+                sink = sink + result.error().size();
+            } );
+}
+
+RichException make_chain( size_t depth )
+{
+    try
+    {
+        throw_rich( depth );
+    }
+    catch( RichException & e )
+    {
+        return std::move( e );
+    }
+    return RichException( "com.codalogic.bench.none", "Not reached" );
+}
+
+void bench_rendering( size_t depth )
+{
+    RichException e( make_chain( depth ) );
+    measure( "to_string", "rich", depth, n_fast_iterations / static_cast< long >( depth ), [&]() {
+                sink = sink + e.to_string().size();
+            } );
+    std::ostringstream os;
+    measure( "operator<<", "rich", depth, n_fast_iterations / static_cast< long >( depth ), [&]() {
+                os.str( std::string() );
+                os << e;
+                sink = sink + static_cast< size_t >( os.tellp() );
+            } );
+    char buffer[4096];
+    measure( "rich_serialize", "rich", depth, n_fast_iterations / static_cast< long >( depth ), [&]() {
+                sink = sink + rich_serialize( e, buffer, sizeof( buffer ) );
+            } );
+    RichJsonWriter json;
+    measure( "json", "rich", depth, n_fast_iterations / static_cast< long >( depth ), [&]() {
+                json.clear();
+                json.write_line( e );
+                sink = sink + json.size();
+            } );
+}
+
+// The way RichExceptionParams::add< T >() formatted values prior to the fast formatting path
+template< typename T >
+RichExceptionValue stream_formatted( const T & value )
+{
+    std::stringstream ss;
+    ss << value;
+    return RichExceptionValue( ss.str() );
+}
+
+void bench_suppression( size_t depth )
+{
+    RichException e( make_chain( depth ) );
+    measure( "fingerprint", "uris", depth, n_fast_iterations, [&]() {
+                sink = sink + static_cast< size_t >( rich_fingerprint( e ) );
+            } );
+    measure( "fingerprint", "uris_and_params", depth, n_fast_iterations, [&]() {
+                sink = sink + static_cast< size_t >( rich_fingerprint( e, fingerprint_uris_and_params ) );
+            } );
+    RichLogSuppressor suppressor;
+    measure( "suppress", "rich", depth, n_fast_iterations, [&]() {
+                sink = sink + suppressor.decide( rich_fingerprint( e ) ).action;
+            } );
+}
+
+void bench_log_sink( size_t depth )
+{
+    // The cost to the logging thread.  The queue is large enough to hold
+    // every exception logged, so that waiting for the background thread
+    // isn't measured.
+    RichException e( make_chain( depth ) );
+    RichLogSinkOptions options;
+    options.capacity = static_cast< size_t >( n_fast_iterations );
+    RichLogSink log_sink( []( const char *, size_t ) {}, options );
+    measure( "log_sink", "rich", depth, n_fast_iterations / static_cast< long >( depth ), [&]() {
+                sink = sink + log_sink.log( e );
+            } );
+}
+
+template< typename T >
+void bench_param_formatting( const char * type_name, const T & value )
+{
+    std::string stream_case( std::string( type_name ) + "_stream" );
+    measure( "param_format", stream_case.c_str(), 1, n_fast_iterations, [&]() {
+                RichExceptionParams params;
+                params.add( "p", stream_formatted( value ).str() );
+                sink = sink + params.size();
+            } );
+    std::string fast_case( std::string( type_name ) + "_fast" );
+    measure( "param_format", fast_case.c_str(), 1, n_fast_iterations, [&]() {
+                RichExceptionParams params;
+                params.add( "p", value );
+                sink = sink + params.size();
+            } );
+}
+
+void bench_param_lookup( size_t n_params )
+{
+    RichExceptionParams params( make_params( n_params ) );
+    std::vector< std::string > name_copies( names, names + n_params );
+    size_t i_name = 0;
+    measure( "get", "literal_name", n_params, n_fast_iterations, [&]() {
+                sink = sink + params.get_value( names[i_name] ).empty();
+                i_name = (i_name + 1) % n_params;
+            } );
+    measure( "get", "copied_name", n_params, n_fast_iterations, [&]() {
+                sink = sink + params.get_value( name_copies[i_name].c_str() ).empty();
+                i_name = (i_name + 1) % n_params;
+            } );
+    measure( "has", "literal_name", n_params, n_fast_iterations, [&]() {
+                sink = sink + params.has( names[i_name] );
+                i_name = (i_name + 1) % n_params;
+            } );
+    measure( "has", "missing_name", n_params, n_fast_iterations, [&]() {
+                sink = sink + params.has( "not_present" );
+            } );
+}
+
+}   // namespace
+
+int main()
+{
+    printf( "benchmark,case,n,ns_per_op,allocs_per_op\n" );
+
+    static const size_t n_params[] = { 0, 1, 4, 16 };
+    for( size_t i = 0; i < sizeof( n_params ) / sizeof( n_params[0] ); ++i )
+        bench_construction( n_params[i] );
+
+    static const size_t depths[] = { 1, 2, 4, 8, 16 };
+    for( size_t i = 0; i < sizeof( depths ) / sizeof( depths[0] ); ++i )
+    {
+        bench_throw_chain( depths[i] );
+        bench_result_chain( depths[i] );
+    }
+
+    static const size_t render_depths[] = { 1, 4, 16 };
+    for( size_t i = 0; i < sizeof( render_depths ) / sizeof( render_depths[0] ); ++i )
+    {
+        bench_rendering( render_depths[i] );
+        bench_suppression( render_depths[i] );
+        bench_log_sink( render_depths[i] );
+    }
+
+    bench_param_formatting( "int", 12345 );
+    bench_param_formatting( "long_long", -1234567890123LL );
+    bench_param_formatting( "unsigned", 42u );
+    bench_param_formatting( "double", 3.14159 );
+    bench_param_formatting( "bool", true );
+    bench_param_formatting( "char", 'x' );
+    bench_param_formatting( "pointer", static_cast< const void * >( names ) );
+
+    static const size_t lookup_sizes[] = { 4, 8, 16, 32 };
+    for( size_t i = 0; i < sizeof( lookup_sizes ) / sizeof( lookup_sizes[0] ); ++i )
+        bench_param_lookup( lookup_sizes[i] );
+
+    return 0;
+}
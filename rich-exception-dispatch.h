@@ -0,0 +1,293 @@
+//----------------------------------------------------------------------------
+// Copyright (c) 2015, Codalogic Ltd (http://www.codalogic.com)
+// All rights reserved.
+//
+// The license for this file is based on the BSD-3-Clause license
+// (http://www.opensource.org/licenses/BSD-3-Clause).
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//
+// - Redistributions of source code must retain the above copyright notice,
+//   this list of conditions and the following disclaimer.
+// - Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+// - Neither the name Codalogic Ltd nor the names of its contributors may be
+//   used to endorse or promote products derived from this software without
+//   specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//----------------------------------------------------------------------------
+
+//----------------------------------------------------------------------------
+// RichExceptionDispatcher maps families of error_uris to handlers.
+//
+// Handlers are registered against patterns made up of the dot-separated
+// segments of an error_uri.  A pattern ending in ".*" matches any error_uri
+// that starts with the segments before it (and the error_uri made of just
+// those segments); "*" on its own matches everything.  Any other pattern
+// only matches that exact error_uri.  For example:
+//
+//      RichExceptionDispatcher< Handler > dispatcher;
+//      dispatcher.add( "com.codalogic.file.*", file_handler );
+//      dispatcher.add( "com.codalogic.file.noopen", noopen_handler );
+//      dispatcher.add( ".mymodule.*", mymodule_handler );
+//
+//      RichExceptionDispatcher< Handler >::Match match = dispatcher.find( e );
+//      if( match.p_handler )
+//          ...
+//
+// find() makes a single pass over the nodes of a RichException and returns
+// the most specific match for any node in the chain.  An exact match is more
+// specific than any prefix matching the same number of segments, and longer
+// prefixes are more specific than shorter ones.  Where nodes have equally
+// specific matches, the most recent node wins.
+//
+// The patterns are held in a trie whose edges are stored in a single open
+// addressed hash table keyed on (parent, segment hash), so the cost of a
+// look-up depends on the number of segments in the error_uri, not the number
+// of registered patterns.
+//
+// THandler can be any copyable type, such as a function pointer, a
+// std::function or simply a value that classifies the error.  A dispatcher
+// can be read from multiple threads once all its patterns have been added.
+//----------------------------------------------------------------------------
+
+#ifndef RICH_EXCEPTION_DISPATCH
+#define RICH_EXCEPTION_DISPATCH
+
+#include "rich-exception.h"
+
+#include <vector>
+#include <cstring>
+
+namespace rich_excep {
+
+template< typename THandler >
+class RichExceptionDispatcher
+{
+public:
+    struct Match
+    {
+        const THandler * p_handler;         // 0 if nothing matched
+        const RichExceptionNode * p_node;   // The node that matched
+        size_t depth;                       // Of p_node in the chain, with 0 being the most recent
+        size_t specificity;                 // Higher is more specific
+
+        Match() : p_handler( 0 ), p_node( 0 ), depth( 0 ), specificity( 0 ) {}
+    };
+
+private:
+    static const size_t no_handler = ~static_cast< size_t >( 0 );
+    static const size_t no_node = ~static_cast< size_t >( 0 );
+
+    struct TrieNode
+    {
+        size_t exact_handler;
+        size_t prefix_handler;
+
+        TrieNode() : exact_handler( no_handler ), prefix_handler( no_handler ) {}
+    };
+    struct Edge
+    {
+        RichUriId segment_hash;
+        size_t parent;
+        size_t child;   // no_node if the slot is unused
+    };
+
+    std::vector< THandler > handlers;
+    std::vector< TrieNode > trie_nodes;
+    std::vector< Edge > edges;          // Open addressed hash table, size is a power of 2
+    size_t n_edges;
+
+    static RichUriId hash_segment( const char * p_begin, const char * p_end )
+    {
+        RichUriId hash = detail::fnv_offset_basis;
+        for( ; p_begin != p_end; ++p_begin )
+            hash = (hash ^ static_cast< unsigned char >( *p_begin )) * detail::fnv_prime;
+        return hash;
+    }
+    size_t slot_of( size_t parent, RichUriId segment_hash ) const
+    {
+        RichUriId mixed = segment_hash ^ (static_cast< RichUriId >( parent ) * 0x9e3779b97f4a7c15ULL);
+        return static_cast< size_t >( mixed ^ (mixed >> 29) ) & (edges.size() - 1);
+    }
+    size_t find_child( size_t parent, RichUriId segment_hash ) const
+    {
+        for( size_t slot = slot_of( parent, segment_hash ); ; slot = (slot + 1) & (edges.size() - 1) )
+        {
+            const Edge & r_edge = edges[slot];
+            if( r_edge.child == no_node )
+                return no_node;
+            if( r_edge.parent == parent && r_edge.segment_hash == segment_hash )
+                return r_edge.child;
+        }
+    }
+    void insert_edge( const Edge & r_edge )
+    {
+        size_t slot = slot_of( r_edge.parent, r_edge.segment_hash );
+        while( edges[slot].child != no_node )
+            slot = (slot + 1) & (edges.size() - 1);
+        edges[slot] = r_edge;
+    }
+    void grow_edges()
+    {
+        std::vector< Edge > old_edges( edges.size() * 2, empty_edge() );
+        old_edges.swap( edges );
+        for( size_t i = 0; i < old_edges.size(); ++i )
+            if( old_edges[i].child != no_node )
+                insert_edge( old_edges[i] );
+    }
+    size_t add_child( size_t parent, RichUriId segment_hash )
+    {
+        size_t child = find_child( parent, segment_hash );
+        if( child != no_node )
+            return child;
+        if( (n_edges + 1) * 2 > edges.size() )
+            grow_edges();
+        child = trie_nodes.size();
+        trie_nodes.push_back( TrieNode() );
+        Edge edge = { segment_hash, parent, child };
+        insert_edge( edge );
+        ++n_edges;
+        return child;
+    }
+    static Edge empty_edge()
+    {
+        Edge edge = { 0, 0, no_node };
+        return edge;
+    }
+
+    void consider( size_t handler, size_t specificity, const RichExceptionNode & r_node, size_t depth, Match * p_best ) const
+    {
+        if( handler != no_handler && (! p_best->p_handler || specificity > p_best->specificity) )
+        {
+            p_best->p_handler = &handlers[handler];
+            p_best->p_node = &r_node;
+            p_best->depth = depth;
+            p_best->specificity = specificity;
+        }
+    }
+    void match_node( const RichExceptionNode & r_node, size_t depth, Match * p_best ) const
+    {
+        size_t trie_node = 0;
+        size_t n_segments = 0;
+        const char * p_segment = r_node.error_uri;
+        for( ;; )
+        {
+            consider( trie_nodes[trie_node].prefix_handler, 2 * n_segments, r_node, depth, p_best );
+            const char * p_segment_end = p_segment;
+            while( *p_segment_end && *p_segment_end != '.' )
+                ++p_segment_end;
+            trie_node = find_child( trie_node, hash_segment( p_segment, p_segment_end ) );
+            if( trie_node == no_node )
+                return;
+            ++n_segments;
+            if( ! *p_segment_end )
+                break;
+            p_segment = p_segment_end + 1;
+        }
+        consider( trie_nodes[trie_node].prefix_handler, 2 * n_segments, r_node, depth, p_best );
+        consider( trie_nodes[trie_node].exact_handler, 2 * n_segments + 1, r_node, depth, p_best );
+    }
+
+public:
+    RichExceptionDispatcher()
+        :
+        trie_nodes( 1 ),
+        edges( 16, empty_edge() ),
+        n_edges( 0 )
+    {}
+
+    // Registers handler_in for pattern_in.  Registering the same pattern again
+    // replaces its handler.
+    RichExceptionDispatcher & add( const char * pattern_in, const THandler & handler_in )
+    {
+        size_t pattern_length = strlen( pattern_in );
+        bool is_prefix = false;
+        if( pattern_length == 1 && pattern_in[0] == '*' )
+        {
+            is_prefix = true;
+            pattern_length = 0;
+        }
+        else if( pattern_length >= 2 && pattern_in[pattern_length - 1] == '*' && pattern_in[pattern_length - 2] == '.' )
+        {
+            is_prefix = true;
+            pattern_length -= 2;
+        }
+
+        size_t trie_node = 0;
+        if( pattern_length > 0 || ! is_prefix )
+        {
+            const char * p_segment = pattern_in;
+            const char * p_pattern_end = pattern_in + pattern_length;
+            for( ;; )
+            {
+                const char * p_segment_end = p_segment;
+                while( p_segment_end != p_pattern_end && *p_segment_end != '.' )
+                    ++p_segment_end;
+                trie_node = add_child( trie_node, hash_segment( p_segment, p_segment_end ) );
+                if( p_segment_end == p_pattern_end )
+                    break;
+                p_segment = p_segment_end + 1;
+            }
+        }
+
+        size_t & r_handler = is_prefix ? trie_nodes[trie_node].prefix_handler : trie_nodes[trie_node].exact_handler;
+        if( r_handler == no_handler )
+        {
+            r_handler = handlers.size();
+            handlers.push_back( handler_in );
+        }
+        else
+            handlers[r_handler] = handler_in;
+        return *this;
+    }
+
+    bool empty() const { return handlers.empty(); }
+    size_t size() const { return handlers.size(); }
+
+    Match find( const RichExceptionNode & r_node ) const
+    {
+        Match best;
+        match_node( r_node, 0, &best );
+        return best;
+    }
+    Match find( const RichException & r_exception ) const
+    {
+        Match best;
+        size_t depth = 0;
+        for( RichException::const_iterator i( r_exception.begin() ), i_end( r_exception.end() );
+                i != i_end;
+                ++i, ++depth )
+            match_node( *i, depth, &best );
+        return best;
+    }
+
+    // Calls the best matching handler as handler( r_exception, matched_node ).
+    // Returns false if no handler matched.
+    bool dispatch( const RichException & r_exception ) const
+    {
+        Match match = find( r_exception );
+        if( ! match.p_handler )
+            return false;
+        (*match.p_handler)( r_exception, *match.p_node );
+        return true;
+    }
+};
+
+}   // Namespace namespace rich_excep
+
+#endif  // RICH_EXCEPTION_DISPATCH
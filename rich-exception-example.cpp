@@ -39,15 +39,78 @@
 #endif
 
 #include "rich-exception.h"
+#include "rich-exception-dispatch.h"
+#include "rich-exception-serialize.h"
+#include "rich-exception-wire.h"
+#include "rich-exception-json.h"
+#include "rich-exception-result.h"
+#include "rich-exception-static.h"
+#include "rich-exception-policy.h"
+#include "rich-exception-suppress.h"
+#include "rich-exception-journal.h"
+#include "rich-exception-log-sink.h"
+#include "rich-exception-aggregate.h"
 
 #include <string>
 #include <iostream>
 #include <cstring>
+#include <sstream>
+#include <limits>
+#include <vector>
+#include <algorithm>
+#include <new>
+#include <cstdlib>
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+#if defined( RICH_EXCEPTION_CXX11 )
+    #include <thread>
+    #include <future>
+    #include <atomic>
+#endif
 
 #include "annotate-lite.h"
 
 using namespace rich_excep;
 
+// Count the heap allocations made by the current thread, so that tests can
+// document how many allocations each operation makes.  Setting
+// is_allocation_failing makes the current thread's allocations throw
+// std::bad_alloc, as if memory were exhausted.
+#if defined( RICH_EXCEPTION_CXX11 )
+    static thread_local long n_heap_allocations = 0;
+    static thread_local bool is_allocation_failing = false;
+    #define NEW_THROWS
+    #define DELETE_THROWS noexcept
+#else
+    static long n_heap_allocations = 0;
+    static bool is_allocation_failing = false;
+    #define NEW_THROWS throw( std::bad_alloc )
+    #define DELETE_THROWS throw()
+#endif
+
+void * operator new( size_t size ) NEW_THROWS
+{
+    ++n_heap_allocations;
+    if( is_allocation_failing )
+        throw std::bad_alloc();
+    void * p = malloc( size ? size : 1 );
+    if( ! p )
+        throw std::bad_alloc();
+    return p;
+}
+void operator delete( void * p ) DELETE_THROWS
+{
+    free( p );
+}
+#if __cplusplus >= 201402L
+void operator delete( void * p, size_t ) noexcept
+{
+    free( p );
+}
+#endif
+
 void show_multiple_linkage_ok();
 
 void show_single_exception_class()
@@ -281,6 +344,1842 @@ void show_has_and_get_parameter_access()
     Verify( i_rich_exception->error_params.get( "Not there" ) == "", "Is DatabaseException exception unknown param safely returned?" );
 }
 
+void show_chain_iteration_and_copying()
+{
+    Suite( "show_chain_iteration_and_copying()" );
+
+    RichException rich_exception_1( "com.codalogic.nexp.chain.1", "Chain exception 1" );
+    RichException rich_exception_2( "com.codalogic.nexp.chain.2", "Chain exception 2", &rich_exception_1 );
+    RichException rich_exception_3( "com.codalogic.nexp.chain.3", "Chain exception 3", &rich_exception_2 );
+
+    VerifyCritical( rich_exception_3.size() == 3, "Is chained exception size correct?" );
+
+    RichException::const_reverse_iterator i_reverse = rich_exception_3.rbegin();
+
+    Verify( strcmp( i_reverse->error_uri, "com.codalogic.nexp.chain.1" ) == 0, "Is rbegin() the root cause?" );
+    ++i_reverse;
+    Verify( strcmp( i_reverse->error_uri, "com.codalogic.nexp.chain.2" ) == 0, "Is 2nd reverse node correct?" );
+    ++i_reverse;
+    Verify( strcmp( i_reverse->error_uri, "com.codalogic.nexp.chain.3" ) == 0, "Is 3rd reverse node the most recent?" );
+    ++i_reverse;
+    Verify( i_reverse == rich_exception_3.rend(), "Has reverse iterator reached rend()?" );
+    --i_reverse;
+    Verify( &*i_reverse == &rich_exception_3.front(), "Does stepping back from rend() reach the most recent node?" );
+    Verify( i_reverse.base() == ++rich_exception_3.begin(), "Is a reverse iterator's base() one past its node?" );
+    Verify( rich_exception_3.rend().base() == rich_exception_3.begin(), "Is rend().base() begin()?" );
+
+    RichException::const_iterator i_backward = rich_exception_3.end();
+    --i_backward;
+    Verify( strcmp( i_backward->error_uri, "com.codalogic.nexp.chain.1" ) == 0, "Does stepping back from end() reach the root cause?" );
+    i_backward--;
+    Verify( strcmp( i_backward->error_uri, "com.codalogic.nexp.chain.2" ) == 0, "Does stepping back again reach the 2nd node?" );
+    ++i_backward;
+    Verify( strcmp( i_backward->error_uri, "com.codalogic.nexp.chain.1" ) == 0, "Can a const_iterator step forward after stepping back?" );
+    Verify( --rich_exception_3.find( rich_uri_id( "com.codalogic.nexp.chain.2" ) ) == rich_exception_3.begin(),
+            "Can an iterator returned by find() step back?" );
+
+    std::vector< std::string > std_reversed;
+    for( std::reverse_iterator< RichException::const_iterator > i( rich_exception_3.end() ); i != std::reverse_iterator< RichException::const_iterator >( rich_exception_3.begin() ); ++i )
+        std_reversed.push_back( i->error_uri );
+    Verify( std_reversed.size() == 3 && std_reversed[0] == "com.codalogic.nexp.chain.1" && std_reversed[2] == "com.codalogic.nexp.chain.3",
+            "Can std::reverse_iterator be used with const_iterator?" );
+
+    RichExceptionNodeSnapshot root_cause( *rich_exception_3.rbegin() );
+    {
+        RichException temporary( "com.codalogic.nexp.chain.4", "Chain exception 4" );
+        temporary.add( "p1", std::string( "a value too long to be stored in a node" ) );
+        root_cause = *temporary.begin();
+    }
+    RichExceptionNodeSnapshot root_cause_copy( root_cause );
+    Verify( strcmp( root_cause_copy.error_uri, "com.codalogic.nexp.chain.4" ) == 0 &&
+            root_cause_copy.is( rich_uri_id( "com.codalogic.nexp.chain.4" ) ) &&
+            root_cause_copy.error_params.get( "p1" ) == "a value too long to be stored in a node",
+            "Does a node snapshot outlive its exception?" );
+    Verify( root_cause_copy.to_string() == "com.codalogic.nexp.chain.4 (p1: a value too long to be stored in a node): Chain exception 4",
+            "Is a node snapshot's to_string() the node's?" );
+
+    RichException long_chain( "com.codalogic.nexp.chain.0", "Chain exception 0" );
+    for( int i = 1; i < 200; ++i )
+        long_chain = RichException( "com.codalogic.nexp.chain.n", "Chain exception n", &long_chain );
+    std::vector< const RichExceptionNode * > forward_nodes;
+    for( RichException::const_iterator i = long_chain.begin(); i != long_chain.end(); ++i )
+        forward_nodes.push_back( &*i );
+    std::vector< const RichExceptionNode * > reverse_nodes;
+    for( RichException::const_reverse_iterator i = long_chain.rbegin(); i != long_chain.rend(); ++i )
+        reverse_nodes.push_back( &*i );
+    std::vector< const RichExceptionNode * > backward_nodes;
+    for( RichException::const_iterator i = long_chain.end(); i != long_chain.begin(); )
+        backward_nodes.push_back( &*--i );
+    std::reverse( forward_nodes.begin(), forward_nodes.end() );
+    Verify( forward_nodes.size() == long_chain.size() && reverse_nodes == forward_nodes && backward_nodes == forward_nodes,
+            "Do reverse and backward traversals of a long chain visit every node in order?" );
+
+    RichException copy( rich_exception_3 );
+    copy.add( "p1", 1 );
+
+    Verify( copy.size() == 3, "Is copied exception size correct?" );
+    Verify( copy.front().error_params.size() == 1, "Has param been added to copy?" );
+    Verify( rich_exception_3.front().error_params.empty(), "Is original unaffected by change to copy?" );
+    Verify( copy.to_string() == "com.codalogic.nexp.chain.3 (p1: 1): Chain exception 3\n"
+                                "  com.codalogic.nexp.chain.2: Chain exception 2\n"
+                                "    com.codalogic.nexp.chain.1: Chain exception 1\n",
+                                "Is copied exception to_string() correct?" );
+
+    RichException shared( rich_exception_3 );
+
+    Verify( &shared.front() == &rich_exception_3.front(), "Do copies share nodes?" );
+
+    shared.add( "p2", 2 );
+
+    Verify( &shared.front() != &rich_exception_3.front(), "Is shared head node copied before it is modified?" );
+    Verify( &*++shared.begin() == &*++rich_exception_3.begin(), "Are inner nodes still shared after modification?" );
+    Verify( rich_exception_3.front().error_params.empty(), "Is original unaffected by change to shared copy?" );
+
+    RichException assigned( "com.codalogic.nexp.chain.assigned", "Assigned" );
+    assigned = copy;
+
+    Verify( assigned.size() == 3, "Is assigned exception size correct?" );
+    Verify( assigned.to_string() == copy.to_string(), "Is assigned exception to_string() correct?" );
+}
+
+void show_params_beyond_inline_storage()
+{
+    Suite( "show_params_beyond_inline_storage()" );
+
+    const char * const long_value = "A value too long to be stored within the parameter itself";
+
+    RichExceptionParams params( "p1", 1 );
+    params.add( "p2", long_value ).add( "p3", 3 ).add( "p4", 4 ).add( "p5", 5 ).add( "p6", "six" );
+
+    RichException rich_exception( "com.codalogic.nexp.many_params", params, "Many params" );
+
+    VerifyCritical( rich_exception.front().error_params.size() == 6, "Are all params present?" );
+
+    const RichExceptionParams & r_params = rich_exception.front().error_params;
+
+    Verify( r_params[1].value == long_value, "Is long value correct?" );
+    Verify( r_params[1].value.size() == strlen( long_value ), "Is long value size correct?" );
+    Verify( r_params[5].value == "six", "Is param after spilling correct?" );
+    Verify( r_params.get( "p5" ) == "5", "Can spilled param be found?" );
+    Verify( r_params.get( "p5" ) != "6", "Does != operator work?" );
+
+    std::string as_string = r_params.get( "p2" );
+
+    Verify( as_string == long_value, "Does value convert to std::string?" );
+
+    RichException copy( rich_exception );
+    Verify( copy.to_string() == "com.codalogic.nexp.many_params (p1: 1, p2: " + std::string( long_value ) +
+                                ", p3: 3, p4: 4, p5: 5, p6: six): Many params\n",
+                                "Is to_string() of copy correct?" );
+}
+
+template< typename T >
+bool is_formatted_as_by_stream( const T & value )
+{
+    std::ostringstream ss;
+    ss << value;
+    return RichExceptionParams( "p", value )[0].value == ss.str();
+}
+
+struct StreamableOnly
+{
+    int n;
+    friend std::ostream & operator << ( std::ostream & os, const StreamableOnly & r_s ) { return os << "<" << r_s.n << ">"; }
+};
+
+void show_fast_parameter_formatting()
+{
+    Suite( "show_fast_parameter_formatting()" );
+
+    Verify( is_formatted_as_by_stream( 0 ), "Is 0 formatted correctly?" );
+    Verify( is_formatted_as_by_stream( -1 ), "Is -1 formatted correctly?" );
+    Verify( is_formatted_as_by_stream( 1234567 ), "Is int formatted correctly?" );
+    Verify( is_formatted_as_by_stream( std::numeric_limits< int >::min() ), "Is minimum int formatted correctly?" );
+    Verify( is_formatted_as_by_stream( std::numeric_limits< long long >::min() ), "Is minimum long long formatted correctly?" );
+    Verify( is_formatted_as_by_stream( std::numeric_limits< unsigned long long >::max() ), "Is maximum unsigned long long formatted correctly?" );
+    Verify( is_formatted_as_by_stream( static_cast< short >( -32 ) ), "Is short formatted correctly?" );
+    Verify( is_formatted_as_by_stream( 3.0 ), "Is 3.0 formatted correctly?" );
+    Verify( is_formatted_as_by_stream( -0.000123456789 ), "Is small double formatted correctly?" );
+    Verify( is_formatted_as_by_stream( 1.5e300 ), "Is large double formatted correctly?" );
+    Verify( is_formatted_as_by_stream( 2.5f ), "Is float formatted correctly?" );
+    Verify( is_formatted_as_by_stream( 1.0L / 3.0L ), "Is long double formatted correctly?" );
+    Verify( is_formatted_as_by_stream( true ), "Is true formatted correctly?" );
+    Verify( is_formatted_as_by_stream( false ), "Is false formatted correctly?" );
+    Verify( is_formatted_as_by_stream( 'x' ), "Is char formatted correctly?" );
+    int i = 0;
+    Verify( is_formatted_as_by_stream( &i ), "Is pointer formatted correctly?" );
+    Verify( is_formatted_as_by_stream( static_cast< void * >( 0 ) ), "Is null pointer formatted correctly?" );
+    StreamableOnly streamable = { 7 };
+    Verify( is_formatted_as_by_stream( streamable ), "Is type with only operator << formatted correctly?" );
+    Verify( RichExceptionParams( "p", "literal" )[0].value == "literal", "Is string literal stored as text?" );
+    char file_name[] = "abc.txt";
+    char * p_file_name = file_name;
+    Verify( is_formatted_as_by_stream( p_file_name ), "Is non-const char * formatted as text?" );
+    unsigned char * p_unsigned_name = reinterpret_cast< unsigned char * >( file_name );
+    Verify( is_formatted_as_by_stream( p_unsigned_name ), "Is unsigned char * formatted as text?" );
+    Verify( RichException( "com.codalogic.nexp.file", "File" ).add( "file", p_file_name ).to_string() ==
+            "com.codalogic.nexp.file (file: abc.txt): File\n", "Does add() record a char * as text?" );
+    Verify( StaticRichException<>( "com.codalogic.nexp.file", "File" ).add( "file", p_file_name ).to_string() ==
+            "com.codalogic.nexp.file (file: abc.txt): File\n", "Does StaticRichException::add() record a char * as text?" );
+}
+
+struct GridPoint
+{
+    int x, y;
+    friend std::ostream & operator << ( std::ostream & os, const GridPoint & r_p ) { return os << "(" << r_p.x << "," << r_p.y << ")"; }
+};
+
+namespace rich_excep {
+template<> struct RichLazyCapture< GridPoint > { enum { enabled = true }; };
+}
+
+void show_lazy_parameter_capture()
+{
+    Suite( "show_lazy_parameter_capture()" );
+
+    GridPoint point = { 3, 4 };
+
+    RichException rich_exception( "com.codalogic.nexp.lazy", "Lazy capture" );
+    rich_exception.add( "row", 12 ).add( "ratio", 0.5 ).add( "where", point ).add( "static", rich_literal( "not copied" ) );
+
+    const RichExceptionParams & r_params = rich_exception.front().error_params;
+
+#if ! defined( RICH_EXCEPTION_EAGER_FORMAT )
+    Verify( r_params[0].value.native_kind() == detail::value_signed, "Is int held natively?" );
+    Verify( r_params[1].value.native_kind() == detail::value_double, "Is double held natively?" );
+    Verify( r_params[2].value.native_kind() == detail::value_user, "Is opted-in user type held natively?" );
+#endif
+    Verify( r_params[3].value.native_kind() == detail::value_literal, "Is rich_literal() held by pointer?" );
+
+    Verify( r_params.get( "row" ) == "12", "Is lazily captured int text correct?" );
+    Verify( r_params.get( "row" ).size() == 2, "Is lazily captured int size correct?" );
+    const std::string & r_row_text = r_params.get( "row" );
+    Verify( r_row_text == "12" && strcmp( r_params.get( "row" ).c_str(), "12" ) == 0 && r_params.get( "row" ).substr( 1 ) == "2",
+            "Does get() return a std::string, as it always has?" );
+    Verify( r_params.get_value( "row" ).native_kind() == r_params[0].value.native_kind() && r_params.get_value( "row" ).length() == 2,
+            "Does get_value() return the value without formatting it?" );
+    Verify( r_params.get_value( "missing" ).empty(), "Does get_value() return an empty value for a missing parameter?" );
+    Verify( r_params.get( "ratio" ) == "0.5", "Is lazily captured double text correct?" );
+    Verify( r_params.get( "where" ) == "(3,4)", "Is lazily captured user type text correct?" );
+    Verify( r_params.get( "static" ) == "not copied", "Is rich_literal() text correct?" );
+    Verify( r_params.get( "row" ) == RichExceptionValue( std::string( "12" ) ), "Do native and text values compare equal?" );
+
+    Verify( rich_exception.to_string() == "com.codalogic.nexp.lazy (row: 12, ratio: 0.5, where: (3,4), static: not copied): Lazy capture\n",
+            "Is lazily captured to_string() correct?" );
+}
+
+void show_error_uri_ids()
+{
+    Suite( "show_error_uri_ids()" );
+
+    try
+    {
+        throw_2_second_with_derived_exceptions( 1, 2 );
+        Bad( "throw_2_second_with_derived_exceptions() did not throw" );
+    }
+    catch( RichException & e )
+    {
+        Verify( e.main_error_uri_id() == rich_uri_id( "com.codalogic.database.badcell" ), "Is main_error_uri_id() correct?" );
+        Verify( e.is( rich_uri_id( "com.codalogic.database.badcell" ) ), "Does is() match main error_uri?" );
+        Verify( ! e.is( rich_uri_id( "com.codalogic.file.noopen" ) ), "Does is() only match main error_uri?" );
+        Verify( e.has( rich_uri_id( "com.codalogic.file.noopen" ) ), "Does has() find cause's error_uri?" );
+        Verify( ! e.has( rich_uri_id( "com.codalogic.file.unknown" ) ), "Does has() reject unknown error_uri?" );
+
+        RichException::const_iterator i_cause = e.find( rich_uri_id( "com.codalogic.file.noopen" ) );
+
+        VerifyCritical( i_cause != e.end(), "Does find() locate cause?" );
+        Verify( i_cause->error_params.get( "name" ) == "abc.txt", "Is found cause correct?" );
+        Verify( i_cause->error_uri_id == detail::hash_uri( i_cause->error_uri ), "Does error_uri_id match error_uri?" );
+
+#if defined( RICH_EXCEPTION_CXX11 )
+        switch( e.main_error_uri_id() )
+        {
+        case rich_uri_id( "com.codalogic.database.badcell" ):
+            Good( "Can error_uri_id be used as a case label?" );
+            break;
+        default:
+            Bad( "Can error_uri_id be used as a case label?" );
+        }
+
+        std::string dynamic_uri = std::string( "com.codalogic." ) + "dynamic";
+        RichUriId dynamic_id = RichUriRegistry::instance().intern( dynamic_uri.c_str() );
+        dynamic_uri.clear();
+
+        Verify( dynamic_id == rich_uri_id( "com.codalogic.dynamic" ), "Is interned id the same as the compile-time id?" );
+        Verify( RichUriRegistry::instance().find( dynamic_id ) != 0 &&
+                strcmp( RichUriRegistry::instance().find( dynamic_id ), "com.codalogic.dynamic" ) == 0,
+                "Can interned URI be found from its id?" );
+        Verify( RichUriRegistry::instance().find( rich_uri_id( "com.codalogic.not_interned" ) ) == 0,
+                "Is URI that has not been interned absent?" );
+#endif
+    }
+}
+
+void show_uri_prefix_dispatch()
+{
+    Suite( "show_uri_prefix_dispatch()" );
+
+    RichExceptionDispatcher< std::string > dispatcher;
+    dispatcher.add( "*", "anything" )
+              .add( "com.codalogic.*", "codalogic" )
+              .add( "com.codalogic.file.*", "file" )
+              .add( "com.codalogic.database.badcell", "badcell" )
+              .add( ".mymodule.*", "mymodule" );
+
+    Verify( dispatcher.size() == 5, "Is dispatcher size correct?" );
+
+    FileException file_exception( "abc.txt" );
+    RichExceptionDispatcher< std::string >::Match match = dispatcher.find( file_exception );
+    Verify( match.p_handler && *match.p_handler == "file", "Does longest prefix match?" );
+
+    DatabaseException database_exception( 1, 2, &file_exception );
+    match = dispatcher.find( database_exception );
+    Verify( match.p_handler && *match.p_handler == "badcell", "Does exact match beat prefix at lower depth?" );
+    Verify( match.depth == 0 && match.p_node == &database_exception.front(), "Is matched node reported?" );
+
+    RichException wrapped( "com.codalogic.other.failed", "Other failure", &database_exception );
+    match = dispatcher.find( wrapped );
+    Verify( match.p_handler && *match.p_handler == "badcell", "Is most specific match found at any depth?" );
+    Verify( match.depth == 1, "Is depth of matched node correct?" );
+
+    match = dispatcher.find( RichException( ".mymodule.myerror", "Relative" ) );
+    Verify( match.p_handler && *match.p_handler == "mymodule", "Does relative URI prefix match?" );
+
+    match = dispatcher.find( RichException( "org.example.error", "Elsewhere" ) );
+    Verify( match.p_handler && *match.p_handler == "anything", "Does catch-all match?" );
+
+    match = dispatcher.find( RichException( "com.codalogic.filesystem.error", "Similar prefix" ) );
+    Verify( match.p_handler && *match.p_handler == "codalogic", "Is prefix matched on whole segments?" );
+
+    dispatcher.add( "com.codalogic.*", "replaced" );
+    match = dispatcher.find( RichException( "com.codalogic.x", "Replaced" ) );
+    Verify( dispatcher.size() == 5 && match.p_handler && *match.p_handler == "replaced", "Does re-registering replace handler?" );
+
+    RichExceptionDispatcher< size_t > large_dispatcher;
+    std::vector< std::string > patterns;
+    for( size_t i = 0; i < 5000; ++i )
+    {
+        std::ostringstream pattern;
+        pattern << "com.example.module" << i % 100 << ".error" << i << ".*";
+        patterns.push_back( pattern.str() );
+        large_dispatcher.add( patterns.back().c_str(), i );
+    }
+    RichExceptionDispatcher< size_t >::Match large_match =
+            large_dispatcher.find( RichException( "com.example.module42.error4242.detail", "Large" ) );
+    Verify( large_match.p_handler && *large_match.p_handler == 4242, "Does dispatch work with thousands of prefixes?" );
+    large_match = large_dispatcher.find( RichException( "com.example.module42.error4243", "Large" ) );
+    Verify( ! large_match.p_handler, "Does unregistered URI not match?" );
+}
+
+void show_indexed_parameter_lookup()
+{
+    Suite( "show_indexed_parameter_lookup()" );
+
+    static const char * const names[] = {
+            "request_id", "shard", "tenant", "user", "region", "zone", "host", "pid",
+            "thread", "attempt", "timeout", "deadline", "trace", "span", "route", "method" };
+    const size_t n_names = sizeof( names ) / sizeof( names[0] );
+
+    RichExceptionParams params;
+    for( size_t i = 0; i < n_names; ++i )
+        params.add( names[i], i );
+    params.add( "shard", "duplicate" );
+
+    VerifyCritical( params.size() == n_names + 1, "Are all params present?" );
+
+    bool is_all_found = true;
+    for( size_t i = 0; i < n_names; ++i )
+    {
+        std::string name_copy( names[i] );   // Not the same pointer as the literal
+        std::ostringstream expected;
+        expected << i;
+        if( ! params.has( name_copy.c_str() ) || params.get( name_copy.c_str() ) != expected.str() ||
+                params.get( names[i] ) != expected.str() )
+            is_all_found = false;
+    }
+    Verify( is_all_found, "Are all indexed params found by name?" );
+    Verify( params.get( "shard" ) == "1", "Is first of duplicate names found?" );
+    Verify( ! params.has( "missing" ), "Is absent param not found in index?" );
+
+    RichExceptionParams copy( params );
+    Verify( copy.get( "method" ) == "15", "Is index rebuilt in copy?" );
+
+    RichExceptionParams assigned( "user", "A value too long to be stored within the parameter itself" );
+    assigned = params;
+    Verify( assigned.size() == params.size() && assigned.get( "method" ) == "15" && assigned.get( "shard" ) == "1",
+            "Does assignment copy every param once?" );
+    RichExceptionParams inline_assigned;
+    inline_assigned = RichExceptionParams( "tenant", "acme" );
+    Verify( inline_assigned.size() == 1 && inline_assigned.get( "tenant" ) == "acme", "Does assignment copy inline params?" );
+
+#if ! defined( RICH_EXCEPTION_USE_ARENA )
+    bool is_bad_alloc_thrown = false;
+    is_allocation_failing = true;
+    try
+    {
+        inline_assigned = params;
+    }
+    catch( const std::bad_alloc & )
+    {
+        is_bad_alloc_thrown = true;
+    }
+    is_allocation_failing = false;
+    Verify( is_bad_alloc_thrown && inline_assigned.size() == 1 && inline_assigned.get( "tenant" ) == "acme",
+            "Does a failed assignment leave the params unchanged?" );
+#endif
+
+    const char * const wanted[] = { "tenant", "missing", "route" };
+    const RichExceptionValue * values[3];
+
+    Verify( params.get_many( wanted, 3, values ) == 2, "Does indexed get_many() find correct number?" );
+    Verify( values[0] && *values[0] == "2", "Is indexed get_many() first value correct?" );
+    Verify( values[1] == 0, "Is indexed get_many() missing value null?" );
+    Verify( values[2] && *values[2] == "14", "Is indexed get_many() last value correct?" );
+
+    RichExceptionParams few_params( "tenant", "acme" );
+    few_params.add( "route", "/a" );
+
+    Verify( few_params.get_many( wanted, 3, values ) == 2, "Does unindexed get_many() find correct number?" );
+    Verify( values[0] && *values[0] == "acme", "Is unindexed get_many() first value correct?" );
+    Verify( values[1] == 0, "Is unindexed get_many() missing value null?" );
+    Verify( values[2] && *values[2] == "/a", "Is unindexed get_many() last value correct?" );
+}
+
+void show_allocation_free_serialization()
+{
+    Suite( "show_allocation_free_serialization()" );
+
+    RichException cause( "com.codalogic.nexp.serialize.cause",
+                         RichExceptionParams( "attempt", 3 ).add( "ratio", 0.5 ).add( "path", "/tmp/abc.txt" ),
+                         "Cause" );
+    RichException exception( "com.codalogic.nexp.serialize.outer", "Outer", &cause );
+    exception.add( "ok", false );
+    std::string expected( exception.to_string() );
+
+    char buffer[512];
+    long n_at_start = n_heap_allocations;
+    size_t length = rich_serialize( exception, buffer, sizeof( buffer ) );
+    long n_for_serialize = n_heap_allocations - n_at_start;
+
+    Verify( length == expected.size(), "Does rich_serialize() return the text length?" );
+    Verify( buffer == expected, "Does rich_serialize() match to_string()?" );
+    Verify( n_for_serialize == 0, "Does rich_serialize() make no allocations?" );
+
+    length = rich_serialize( exception, buffer, 20 );
+    Verify( length == expected.size(), "Does truncated rich_serialize() return the full text length?" );
+    Verify( strlen( buffer ) == 19, "Is truncated text nul terminated within the buffer?" );
+    Verify( std::string( buffer ) == expected.substr( 0, 16 ) + "...", "Does truncated text end in '...'?" );
+
+    Verify( rich_serialize( exception, 0, 0 ) == expected.size(), "Can rich_serialize() be used to find the length needed?" );
+
+    rich_serialize( exception.front(), buffer, sizeof( buffer ) );
+    Verify( std::string( buffer ) == "com.codalogic.nexp.serialize.outer (ok: 0): Outer", "Can a node be serialized?" );
+    rich_serialize( exception.begin()->next()->error_params, buffer, sizeof( buffer ) );
+    Verify( std::string( buffer ) == "attempt: 3, ratio: 0.5, path: /tmp/abc.txt", "Can params be serialized?" );
+
+    FILE * p_file = tmpfile();
+    VerifyCritical( p_file != 0, "Can temporary file be opened?" );
+    n_at_start = n_heap_allocations;
+    bool is_written = rich_serialize_fd( exception, fileno( p_file ) );
+    long n_for_fd = n_heap_allocations - n_at_start;
+    Verify( is_written, "Does rich_serialize_fd() succeed?" );
+    Verify( n_for_fd == 0, "Does rich_serialize_fd() make no allocations?" );
+
+    rewind( p_file );
+    std::string written;
+    int c;
+    while( (c = fgetc( p_file )) != EOF )
+        written += static_cast< char >( c );
+    fclose( p_file );
+    Verify( written == expected, "Does rich_serialize_fd() write the same text as to_string()?" );
+}
+
+void show_wire_format_round_trip()
+{
+    Suite( "show_wire_format_round_trip()" );
+
+    GridPoint point = { 3, 4 };
+    RichException cause( "com.codalogic.nexp.wire.cause",
+                         RichExceptionParams( "attempt", 3 ).add( "ratio", 0.5 ).add( "where", point ),
+                         "Cause" );
+    RichException exception( "com.codalogic.nexp.wire.outer", "Outer", &cause );
+    exception.add( "path", "A value too long to be stored within the parameter itself" ).
+            add( "binary", std::string( "a\0b", 3 ) );
+
+    std::string encoded( rich_wire_encode( exception ) );
+
+    char small_buffer[8];
+    Verify( rich_wire_encode( exception, small_buffer, sizeof( small_buffer ) ) == encoded.size(), "Does encoding report the size needed?" );
+
+    long n_at_start = n_heap_allocations;
+    RichExceptionView view( encoded.data(), encoded.size() );
+    size_t n_nodes = 0;
+    for( RichExceptionView::const_iterator i( view.begin() ), i_end( view.end() ); i != i_end; ++i )
+        n_nodes += i->error_params.has( "attempt" ) ? 1 : 0;
+    long n_for_view = n_heap_allocations - n_at_start;
+
+    VerifyCritical( view.is_valid(), "Is encoded exception a valid view?" );
+    VerifyCritical( view.size() == 2, "Is view chain size correct?" );
+    Verify( view.encoded_size() == encoded.size(), "Is view encoded size correct?" );
+    Verify( n_nodes == 1, "Can view params be searched?" );
+    Verify( n_for_view == 0, "Does reading a view make no allocations?" );
+
+    Verify( strcmp( view.main_error_uri(), "com.codalogic.nexp.wire.outer" ) == 0, "Is view main_error_uri() correct?" );
+    Verify( strcmp( view.what(), "Outer" ) == 0, "Is view what() correct?" );
+    Verify( view.is( rich_uri_id( "com.codalogic.nexp.wire.outer" ) ), "Is view error_uri_id correct?" );
+    Verify( view.has( rich_uri_id( "com.codalogic.nexp.wire.cause" ) ), "Can view find a cause by id?" );
+
+    RichExceptionView::const_iterator i_cause( view.begin() );
+    ++i_cause;
+    const RichExceptionParamsView & r_params( i_cause->error_params );
+    VerifyCritical( r_params.size() == 3, "Is view params size correct?" );
+    Verify( strcmp( r_params[1].name, "ratio" ) == 0 && r_params[1].value == "0.5", "Is view param by index correct?" );
+    Verify( r_params.get( "attempt" ) == "3", "Is view param by name correct?" );
+    Verify( r_params.get( "where" ) == "(3,4)", "Is lazily captured user value encoded as text?" );
+    Verify( r_params.get( "missing" ).empty() && ! r_params.has( "missing" ), "Is missing view param empty?" );
+    Verify( view.front().error_params.get( "binary" ) == std::string( "a\0b", 3 ), "Are values with embedded nuls preserved?" );
+
+    Verify( view.to_string() == exception.to_string(), "Does view render the same as the exception?" );
+
+    std::string two_messages( encoded + encoded );
+    RichExceptionView first( two_messages.data(), two_messages.size() );
+    RichExceptionView second( two_messages.data() + first.encoded_size(), two_messages.size() - first.encoded_size() );
+    Verify( first.is_valid() && second.is_valid() && second.to_string() == exception.to_string(),
+            "Can consecutive encodings be split using encoded_size()?" );
+
+    bool is_any_truncation_accepted = false;
+    for( size_t length = 0; length < encoded.size(); ++length )
+        if( RichExceptionView( encoded.data(), length ).is_valid() )
+            is_any_truncation_accepted = true;
+    Verify( ! is_any_truncation_accepted, "Are all truncated encodings rejected?" );
+
+    RichException empty_exception( "com.codalogic.nexp.wire.moved", "Moved" );
+    RichException taker( "com.codalogic.nexp.wire.taker", "Taker", &empty_exception );
+    std::string empty_encoded( rich_wire_encode( empty_exception ) );
+    RichExceptionView empty_view( empty_encoded.data(), empty_encoded.size() );
+    Verify( empty_view.is_valid() && empty_view.empty(), "Can an empty exception be encoded?" );
+
+    const std::string long_uri( 2000000, 'u' );
+    RichException long_exception( long_uri.c_str(), "Long" );
+    std::string long_encoded( rich_wire_encode( long_exception ) );
+    RichExceptionView long_view( long_encoded.data(), long_encoded.size() );
+    Verify( long_view.is_valid() && long_view.main_error_uri_id() == long_exception.main_error_uri_id() &&
+            long_view.begin()->error_uri_id == long_exception.main_error_uri_id(),
+            "Can a view of an exception with a very long error URI be read?" );
+}
+
+void show_wire_format_fuzzing()
+{
+    Suite( "show_wire_format_fuzzing()" );
+
+    RichException cause( "com.codalogic.nexp.wire.cause", RichExceptionParams( "attempt", 3 ).add( "ratio", 0.5 ), "Cause" );
+    RichException exception( "com.codalogic.nexp.wire.outer", RichExceptionParams( "path", "/tmp/abc.txt" ), "Outer", &cause );
+    const std::string encoded( rich_wire_encode( exception ) );
+
+    // Corrupt the encoding in random ways and check that whatever is
+    // accepted can be read in full.  (Run under a sanitizer to check there
+    // are no out of bounds reads.)
+    unsigned long long lcg = 0x2545F4914F6CDD1DULL;
+    size_t n_valid = 0;
+    size_t n_chars_read = 0;
+    for( int i_case = 0; i_case < 20000; ++i_case )
+    {
+        std::string fuzzed( encoded );
+        int n_mutations = 1 + i_case % 4;
+        for( int i = 0; i < n_mutations; ++i )
+        {
+            lcg = lcg * 6364136223846793005ULL + 1442695040888963407ULL;
+            size_t position = static_cast< size_t >( (lcg >> 33) % fuzzed.size() );
+            unsigned char value = static_cast< unsigned char >( lcg >> 17 );
+            switch( (lcg >> 13) % 4 )
+            {
+            case 0: fuzzed[position] = static_cast< char >( value ); break;
+            case 1: fuzzed[position] = static_cast< char >( fuzzed[position] ^ (1 << (value % 8)) ); break;
+            case 2: fuzzed.erase( position, 1 + value % 8 ); break;
+            case 3: fuzzed.insert( position, 1 + value % 8, static_cast< char >( value ) ); break;
+            }
+            if( fuzzed.empty() )
+                fuzzed = "R";
+        }
+        // Copy to an exactly sized heap buffer so a sanitizer can see overruns
+        std::vector< char > bytes( fuzzed.begin(), fuzzed.end() );
+        RichExceptionView view( &bytes[0], bytes.size() );
+        if( ! view.is_valid() )
+            continue;
+        ++n_valid;
+        for( RichExceptionView::const_iterator i( view.begin() ), i_end( view.end() ); i != i_end; ++i )
+        {
+            n_chars_read += strlen( i->error_uri ) + strlen( i->description );
+            for( size_t i_param = 0; i_param < i->error_params.size(); ++i_param )
+                n_chars_read += i->error_params[i_param].value.size();
+            n_chars_read += i->error_params.has( "attempt" ) ? 1 : 0;
+        }
+        n_chars_read += view.to_string().size();
+    }
+
+    Verify( n_valid > 0, "Are some mutated encodings still valid?" );
+    Verify( n_chars_read > 0, "Can mutated encodings be read?" );
+
+    bool is_garbage_accepted = false;
+    for( int i_case = 0; i_case < 2000; ++i_case )
+    {
+        std::vector< char > garbage( 1 + i_case % 64 );
+        for( size_t i = 0; i < garbage.size(); ++i )
+        {
+            lcg = lcg * 6364136223846793005ULL + 1442695040888963407ULL;
+            garbage[i] = static_cast< char >( lcg >> 40 );
+        }
+        if( RichExceptionView( &garbage[0], garbage.size() ).is_valid() )
+            is_garbage_accepted = true;
+    }
+    Verify( ! is_garbage_accepted, "Is random data without the header rejected?" );
+}
+
+std::string reference_json_escape( const std::string & r_in )
+{
+    std::string escaped;
+    for( size_t i = 0; i < r_in.size(); ++i )
+    {
+        unsigned char c = static_cast< unsigned char >( r_in[i] );
+        if( c == '"' ) escaped += "\\\"";
+        else if( c == '\\' ) escaped += "\\\\";
+        else if( c == '\n' ) escaped += "\\n";
+        else if( c == '\r' ) escaped += "\\r";
+        else if( c == '\t' ) escaped += "\\t";
+        else if( c == '\b' ) escaped += "\\b";
+        else if( c == '\f' ) escaped += "\\f";
+        else if( c < 0x20 )
+        {
+            char hex[8];
+            sprintf( hex, "\\u%04x", c );
+            escaped += hex;
+        }
+        else
+            escaped += static_cast< char >( c );
+    }
+    return escaped;
+}
+
+void show_json_output()
+{
+    Suite( "show_json_output()" );
+
+    RichException cause( "com.codalogic.nexp.json.cause",
+                         RichExceptionParams( "attempt", -3 ).add( "size", 42u ).add( "ratio", 0.5 ).add( "ok", true ),
+                         "Unable to \"open\" file" );
+    RichException exception( "com.codalogic.nexp.json.outer", "Outer", &cause );
+    exception.add( "path", "C:\\tmp\\abc.txt\n" ).add( "ch", 'x' ).add( "big", std::numeric_limits< double >::infinity() );
+
+#if ! defined( RICH_EXCEPTION_EAGER_FORMAT )
+    Verify( rich_json( exception ) ==
+            "{\"error_uri\":\"com.codalogic.nexp.json.outer\",\"chain\":["
+            "{\"depth\":0,\"error_uri\":\"com.codalogic.nexp.json.outer\",\"description\":\"Outer\","
+                "\"params\":{\"path\":\"C:\\\\tmp\\\\abc.txt\\n\",\"ch\":\"x\",\"big\":\"inf\"}},"
+            "{\"depth\":1,\"error_uri\":\"com.codalogic.nexp.json.cause\",\"description\":\"Unable to \\\"open\\\" file\","
+                "\"params\":{\"attempt\":-3,\"size\":42,\"ratio\":0.5,\"ok\":true}}]}",
+            "Is JSON output correct?" );
+#endif
+
+    RichException no_params( "com.codalogic.nexp.json.plain", "Plain" );
+    Verify( rich_json( no_params ) ==
+            "{\"error_uri\":\"com.codalogic.nexp.json.plain\",\"chain\":["
+            "{\"depth\":0,\"error_uri\":\"com.codalogic.nexp.json.plain\",\"description\":\"Plain\",\"params\":{}}]}",
+            "Is JSON output without params correct?" );
+
+    std::string encoded( rich_wire_encode( exception ) );
+    RichExceptionView view( encoded.data(), encoded.size() );
+    Verify( rich_json( view ).find( "\"path\":\"C:\\\\tmp\\\\abc.txt\\n\"" ) != std::string::npos, "Can a RichExceptionView be written as JSON?" );
+
+    // Check the block-wise escaping against a simple reference, using
+    // strings of many lengths so that special characters fall at every
+    // position within a block
+    unsigned long long lcg = 0x9E3779B97F4A7C15ULL;
+    static const char alphabet[] = "abcXYZ019 \"\\\n\t\x01\x1f\x7f\x80\xff/";
+    bool is_escaping_ok = true;
+    for( int i_case = 0; i_case < 2000 && is_escaping_ok; ++i_case )
+    {
+        std::string text;
+        size_t length = i_case % 70;
+        for( size_t i = 0; i < length; ++i )
+        {
+            lcg = lcg * 6364136223846793005ULL + 1442695040888963407ULL;
+            size_t i_char = static_cast< size_t >( lcg >> 40 );
+            text += (i_case % 3 == 0) ? 'p' : alphabet[i_char % (sizeof( alphabet ) - 1)];
+        }
+        if( i_case % 3 == 0 && length > 0 )
+            text[i_case % length] = '"';
+        std::vector< char > output( text.size() * 6 + 16 );
+        char * p_end = detail::json_escape( &output[0], text.data(), text.size() );
+        if( std::string( &output[0], p_end ) != reference_json_escape( text ) )
+            is_escaping_ok = false;
+    }
+    Verify( is_escaping_ok, "Does escaping match the reference for all positions?" );
+
+    RichJsonWriter json;
+    std::vector< RichException > batch;
+    batch.push_back( no_params );
+    batch.push_back( exception );
+    batch.push_back( no_params );
+    json.write_lines( batch.begin(), batch.end() );
+    std::string ndjson( json.str() );
+    Verify( std::count( ndjson.begin(), ndjson.end(), '\n' ) == 3, "Does write_lines() write one line per exception?" );
+    Verify( ndjson.substr( 0, ndjson.find( '\n' ) ) == rich_json( no_params ), "Are NDJSON lines the JSON of each exception?" );
+
+    json.clear();
+    Verify( json.empty(), "Does clear() empty the writer?" );
+    long n_at_start = n_heap_allocations;
+    json.write_lines( batch.begin(), batch.end() );
+    long n_for_rewrite = n_heap_allocations - n_at_start;
+    Verify( json.str() == ndjson, "Is re-written output the same?" );
+    Verify( n_for_rewrite == 0, "Does re-using a writer avoid allocations?" );
+}
+
+RichResult< int > parse_digit( char c )
+{
+    if( c < '0' || c > '9' )
+        return RichError( "com.codalogic.nexp.result.digit", RichExceptionParams( "char", c ), "Not a digit" );
+    return c - '0';
+}
+
+RichResult< int > parse_number( const std::string & r_text )
+{
+    int number = 0;
+    for( size_t i = 0; i < r_text.size(); ++i )
+    {
+        RichResult< int > digit( parse_digit( r_text[i] ) );
+        if( ! digit.ok() )
+            return RichError( "com.codalogic.nexp.result.number",
+                              RichExceptionParams( "text", r_text ).add( "offset", i ),
+                              "Not a number",
+                              &digit.error() );
+        number = number * 10 + digit.value();
+    }
+    return number;
+}
+
+RichResult< void > check_positive( int n )
+{
+    if( n <= 0 )
+        return RichError( "com.codalogic.nexp.result.positive", "Not positive" ).add( "n", n );
+    return RichResult< void >();
+}
+
+struct ThrowingCopy
+{
+    static bool is_copy_failing;
+
+    int n;
+
+    ThrowingCopy( int n_in ) : n( n_in ) {}
+    ThrowingCopy( const ThrowingCopy & r_rhs ) : n( r_rhs.n )
+    {
+        if( is_copy_failing )
+            throw std::runtime_error( "copy failed" );
+    }
+    ThrowingCopy & operator = ( const ThrowingCopy & r_rhs )
+    {
+        if( is_copy_failing )
+            throw std::runtime_error( "copy failed" );
+        n = r_rhs.n;
+        return *this;
+    }
+};
+bool ThrowingCopy::is_copy_failing = false;
+
+void show_rich_result()
+{
+    Suite( "show_rich_result()" );
+
+    RichResult< int > good( parse_number( "123" ) );
+    Verify( good.ok() && ! good.has_error(), "Is successful result ok?" );
+    Verify( good.value() == 123, "Is successful result value correct?" );
+
+    RichResult< int > bad( parse_number( "12x4" ) );
+    VerifyCritical( bad.has_error(), "Is failed result an error?" );
+    Verify( bad.value_or( -1 ) == -1, "Does value_or() return default on error?" );
+    const RichError & r_error( bad.error() );
+    VerifyCritical( r_error.size() == 2, "Is error chain size correct?" );
+    Verify( strcmp( r_error.main_error_uri(), "com.codalogic.nexp.result.number" ) == 0, "Is error main_error_uri() correct?" );
+    Verify( r_error.front().error_params.get( "offset" ) == "2", "Is error param correct?" );
+    Verify( r_error.begin()->next()->error_params.get( "char" ) == "x", "Is cause param correct?" );
+    Verify( r_error.has( rich_uri_id( "com.codalogic.nexp.result.digit" ) ), "Can cause be found by id?" );
+
+    RichException thrown( "com.codalogic.nexp.result.none", "None" );
+    try
+    {
+        bad.value();
+    }
+    catch( RichException & e )
+    {
+        thrown = e;
+    }
+    Verify( thrown.to_string() == r_error.to_string(), "Does value() throw the equivalent RichException?" );
+    Verify( &thrown.front() == &r_error.front(), "Does the thrown RichException share the error's nodes?" );
+
+    RichError from_exception( thrown );
+    Verify( from_exception.to_string() == r_error.to_string(), "Is RichError from a RichException lossless?" );
+    RichError outer( "com.codalogic.nexp.result.outer", "Outer", &from_exception );
+    Verify( outer.size() == 3 && from_exception.empty(), "Does chaining take the inner error's nodes?" );
+    Verify( thrown.size() == 2, "Is chaining a shared error invisible to its other owners?" );
+    Verify( outer.to_exception().size() == 3, "Does to_exception() give the whole chain?" );
+
+    RichResult< std::string > text( std::string( "abc" ) );
+    RichResult< std::string > text_copy( text );
+    text_copy = RichResult< std::string >( RichError( "com.codalogic.nexp.result.text", "Text" ) );
+    Verify( text.value() == "abc" && text_copy.has_error(), "Can results be copied and assigned?" );
+
+    RichResult< ThrowingCopy > copied_to( RichError( "com.codalogic.nexp.result.copy", "Copy" ) );
+    RichResult< ThrowingCopy > copied_from( ThrowingCopy( 1 ) );
+    ThrowingCopy::is_copy_failing = true;
+    bool is_copy_thrown = false;
+    try
+    {
+        copied_to = copied_from;
+    }
+    catch( std::runtime_error & )
+    {
+        is_copy_thrown = true;
+    }
+    ThrowingCopy::is_copy_failing = false;
+    Verify( is_copy_thrown && copied_to.valueless_by_exception() && ! copied_to.ok() && ! copied_to.has_error(),
+            "Does a throwing assignment leave the result holding nothing, rather than destroying it twice?" );
+    copied_to = copied_from;
+    Verify( copied_to.ok() && copied_to.value().n == 1, "Can a valueless result be assigned to again?" );
+    RichResult< ThrowingCopy > other_value( ThrowingCopy( 2 ) );
+    ThrowingCopy::is_copy_failing = true;
+    try
+    {
+        copied_to = other_value;
+    }
+    catch( std::runtime_error & )
+    {
+    }
+    ThrowingCopy::is_copy_failing = false;
+    Verify( copied_to.ok() && copied_to.value().n == 1, "Does a value's throwing assignment leave the result holding its value?" );
+#if defined( RICH_EXCEPTION_CXX11 )
+    Verify( std::is_nothrow_move_constructible< RichResult< int > >::value &&
+            ! std::is_nothrow_move_constructible< RichResult< ThrowingCopy > >::value,
+            "Is moving a result noexcept when moving its value is?" );
+#endif
+
+    Verify( check_positive( 1 ).ok(), "Is successful void result ok?" );
+    RichResult< void > not_positive( check_positive( -1 ) );
+    Verify( not_positive.has_error() && not_positive.error().front().error_params.get( "n" ) == "-1", "Is void error correct?" );
+    bool is_thrown = false;
+    try
+    {
+        not_positive.value();
+    }
+    catch( RichException & )
+    {
+        is_thrown = true;
+    }
+    Verify( is_thrown, "Does value() on a void error throw?" );
+}
+
+void show_shared_chaining()
+{
+    Suite( "show_shared_chaining()" );
+
+    FileException cause( "abc.txt" );
+    RichException outer( "com.codalogic.nexp.shared.outer", "Outer", cause );
+
+    Verify( cause.size() == 1, "Does chaining via const reference leave the cause intact?" );
+    VerifyCritical( outer.size() == 2, "Is chain size correct after sharing?" );
+    Verify( outer.begin()->next() == &cause.front(), "Are the cause's nodes shared rather than copied?" );
+
+    RichException outer2( "com.codalogic.nexp.shared.outer2", RichExceptionParams( "attempt", 2 ), "Outer 2", cause );
+    Verify( outer2.size() == 2 && outer2.begin()->next() == &cause.front(), "Can the same cause be shared by several exceptions?" );
+
+    outer.add( "extra", 1 );
+    Verify( cause.front().error_params.size() == 1 && ! cause.front().error_params.has( "extra" ), "Does add() on the outer exception leave the cause unchanged?" );
+
+    RichExceptionHandle handle( outer );
+    RichException wrapped( "com.codalogic.nexp.shared.wrapped", "Wrapped", handle );
+    Verify( wrapped.size() == 3 && handle.size() == 2, "Can a handle be chained without changing it?" );
+    Verify( strcmp( handle.main_error_uri(), "com.codalogic.nexp.shared.outer" ) == 0, "Is handle main_error_uri() correct?" );
+
+    RichExceptionHandle empty;
+    Verify( empty.empty(), "Is a default handle empty?" );
+
+    bool is_rethrown = false;
+    try
+    {
+        handle.rethrow();
+    }
+    catch( const RichException & e )
+    {
+        is_rethrown = &e.front() == &handle.front();
+    }
+    Verify( is_rethrown, "Does rethrow() throw an exception sharing the handle's nodes?" );
+
+#if defined( RICH_EXCEPTION_CXX11 )
+    RichExceptionHandle from_ptr( RichExceptionHandle::from_exception_ptr( handle.to_exception_ptr() ) );
+    Verify( from_ptr.size() == 2 && &from_ptr.front() == &handle.front(), "Does a handle round trip via std::exception_ptr?" );
+    Verify( RichExceptionHandle::from_exception_ptr( std::make_exception_ptr( std::runtime_error( "x" ) ) ).empty(),
+            "Is a handle from a non-RichException empty?" );
+#endif
+}
+
+void show_cross_thread_handles()
+{
+#if defined( RICH_EXCEPTION_CXX11 )
+    Suite( "show_cross_thread_handles()" );
+
+    // Run with "make tsan" to check there are no data races.
+    RichExceptionHandle root_handle;
+    {
+        RichException root( "com.codalogic.nexp.threads.root",
+                            RichExceptionParams( "attempt", 1 ).add( "path", "A value too long to be stored within the parameter itself" ),
+                            "Root" );
+        root_handle = RichExceptionHandle( root );
+    }
+    const std::string root_text( root_handle.to_string() );
+
+    const int n_threads = 8;
+    const int n_iterations = 500;
+    std::atomic< int > n_ok( 0 );
+    std::vector< std::thread > threads;
+    std::vector< std::future< int > > futures;
+    for( int i_thread = 0; i_thread < n_threads; ++i_thread )
+    {
+        std::promise< int > promise;
+        futures.push_back( promise.get_future() );
+        threads.push_back( std::thread( [&root_handle, &root_text, &n_ok, n_iterations]( std::promise< int > result ) {
+                    RichExceptionHandle last;
+                    for( int i = 0; i < n_iterations; ++i )
+                    {
+                        RichExceptionHandle local( root_handle );
+                        RichException outer( "com.codalogic.nexp.threads.outer", "Outer", local );
+                        outer.add( "iteration", i );
+                        try
+                        {
+                            throw outer;
+                        }
+                        catch( const RichException & )
+                        {
+                            RichExceptionHandle caught( RichExceptionHandle::current() );
+                            if( caught.size() == 2 && caught.begin()->next() == &root_handle.front() &&
+                                    caught.front().error_params.get( "iteration" ) == RichExceptionValue( i ) )
+                                ++n_ok;
+                            last = caught;
+                        }
+                        if( i % 50 == 0 && local.to_string() == root_text )
+                            ++n_ok;
+                    }
+                    result.set_exception( last.to_exception_ptr() );
+                }, std::move( promise ) ) );
+    }
+
+    int n_futures_ok = 0;
+    for( size_t i = 0; i < futures.size(); ++i )
+    {
+        try
+        {
+            futures[i].get();
+        }
+        catch( const RichException & e )
+        {
+            RichException submitter( "com.codalogic.nexp.threads.submitter", "Task failed", e );
+            if( submitter.size() == 3 && e.size() == 2 )
+                ++n_futures_ok;
+        }
+    }
+    for( size_t i = 0; i < threads.size(); ++i )
+        threads[i].join();
+
+    Verify( n_ok == n_threads * (n_iterations + n_iterations / 50), "Are handles usable concurrently on many threads?" );
+    Verify( n_futures_ok == n_threads, "Can handles be passed back via futures and chained?" );
+    Verify( root_handle.to_string() == root_text, "Is the shared root unchanged?" );
+#endif
+}
+
+void show_capture_policies()
+{
+    Suite( "show_capture_policies()" );
+
+    typedef BasicRichException< RichCaptureUriOnly > UriOnlyException;
+    typedef BasicRichException< RichCaptureParams > ParamsException;
+
+    RichException rich( "com.codalogic.nexp.policy.all", "All" );
+    rich.add( "p1", 1 );
+    BasicRichException<> all( "com.codalogic.nexp.policy.all", "All" );
+    all.add( "p1", 1 );
+    Verify( all.to_string() == rich.to_string(), "Does the default policy record the same as RichException?" );
+
+    try
+    {
+        try
+        {
+            throw FileException( "abc.txt" );
+        }
+        catch( FileException & e )
+        {
+            throw UriOnlyException( "com.codalogic.nexp.policy.uri_only", "URI only", &e ).add( "p1", 1 ).add( "p2", "two" );
+        }
+    }
+    catch( RichException & e )
+    {
+        Verify( e.is( rich_uri_id( "com.codalogic.nexp.policy.uri_only" ) ), "Is a BasicRichException caught as a RichException?" );
+        Verify( e.front().error_params.empty(), "Does RichCaptureUriOnly discard parameters?" );
+        Verify( strcmp( e.what(), "" ) == 0, "Does RichCaptureUriOnly discard descriptions?" );
+        Verify( e.size() == 2 && e.has( rich_uri_id( "com.codalogic.file.noopen" ) ), "Is the cause of a BasicRichException kept?" );
+        Verify( strcmp( ( ++e.begin() )->description, "Unable to open file" ) == 0, "Are causes recorded with their own policy?" );
+    }
+
+    UriOnlyException uri_only( "com.codalogic.nexp.policy.uri_only", RichExceptionParams( "p1", 1 ), "URI only" );
+    Verify( uri_only.front().error_params.empty(), "Does RichCaptureUriOnly discard parameters passed to the constructor?" );
+
+    ParamsException params( "com.codalogic.nexp.policy.params", RichExceptionParams( "p1", 1 ), "Params" );
+    params.add( "p2", 2 );
+    Verify( params.to_string() == "com.codalogic.nexp.policy.params (p1: 1, p2: 2): \n", "Does RichCaptureParams keep parameters but not descriptions?" );
+
+    Verify( ! uri_only.front().has_params_storage() && params.front().has_params_storage(),
+            "Does the policy choose the layout of the nodes?" );
+    Verify( sizeof( RichCaptureUriOnly::node_type ) + sizeof( RichExceptionParams ) <= sizeof( RichCaptureAll::node_type ),
+            "Do RichCaptureUriOnly nodes have no parameter storage?" );
+
+    RichException widened( uri_only );
+    widened.add( "p1", 1 );
+    Verify( widened.front().has_params_storage() && widened.front().error_params.get( "p1" ) == "1" &&
+            uri_only.front().error_params.empty(),
+            "Does RichException::add() give a node without parameter storage some, leaving copies unchanged?" );
+}
+
+void show_static_rich_exception()
+{
+    Suite( "show_static_rich_exception()" );
+
+    const char * const long_value = "A value too long to be stored within the parameter itself";
+
+    long n_at_start = n_heap_allocations;
+    try
+    {
+        try
+        {
+            throw StaticRichException<>( "com.codalogic.nexp.static.inner", "Inner" ).add( "attempt", 2 ).add( "path", long_value );
+        }
+        catch( StaticRichException<> & e )
+        {
+            throw StaticRichException<>( "com.codalogic.nexp.static.outer", "Outer", e ).add( "flag", true );
+        }
+    }
+    catch( StaticRichException<> & e )
+    {
+        long n_for_static = n_heap_allocations - n_at_start;
+        Verify( n_for_static == 0, "Does StaticRichException not allocate memory?" );
+
+        RichException equivalent( "com.codalogic.nexp.static.outer", "Outer",
+                RichException( "com.codalogic.nexp.static.inner", "Inner" ).add( "attempt", 2 ).add( "path", long_value ) );
+        equivalent.add( "flag", true );
+
+        Verify( e.size() == 2, "Does StaticRichException record its cause?" );
+        Verify( ! e.is_truncated(), "Is a StaticRichException that fits not truncated?" );
+        Verify( e.to_string() == equivalent.to_string(), "Does StaticRichException render the same as RichException?" );
+        Verify( strcmp( e.what(), "Outer" ) == 0, "Does StaticRichException what() return its description?" );
+        Verify( e.has( rich_uri_id( "com.codalogic.nexp.static.inner" ) ), "Can a StaticRichException's chain be searched?" );
+
+        size_t n_nodes = 0;
+        for( RichException::const_iterator i( e.begin() ), i_end( e.end() ); i != i_end; ++i )
+            ++n_nodes;
+        Verify( n_nodes == 2, "Can a StaticRichException be iterated as a RichException?" );
+
+        char buffer[512];
+        rich_serialize( e, buffer, sizeof( buffer ) );
+        Verify( equivalent.to_string() == buffer, "Can a StaticRichException be serialized without allocating?" );
+    }
+
+    {
+        StaticRichException<> * p_original = new StaticRichException<>( "com.codalogic.nexp.static.copied", "Copied" );
+        p_original->add( "path", long_value );
+        StaticRichException<> copy( *p_original );
+        delete p_original;
+        Verify( copy.front().error_params.get( "path" ) == long_value, "Is a copy independent of the original's text?" );
+    }
+
+    {
+        StaticRichException< 2, 2, 32 > truncated( "com.codalogic.nexp.static.truncated", "Truncated" );
+        truncated.add( "p1", 1 ).add( "p2", 2 );
+        Verify( ! truncated.is_truncated(), "Is a StaticRichException not truncated when its parameters fit?" );
+        truncated.add( "p3", 3 );
+        Verify( truncated.is_truncated(), "Is a StaticRichException truncated when there are too many parameters?" );
+        Verify( truncated.front().error_params.size() == 2, "Are parameters beyond max_params left out?" );
+
+        StaticRichException< 2, 2, 32 > short_text( "com.codalogic.nexp.static.short_text", "Short text" );
+        short_text.add( "path", long_value );
+        Verify( short_text.is_truncated(), "Is a StaticRichException truncated when its text doesn't fit?" );
+        Verify( short_text.front().error_params.get( "path" ) == std::string( long_value, 32 ), "Is text beyond max_bytes left out?" );
+
+        RichException cause_1( "com.codalogic.nexp.static.cause_1", "Cause 1" );
+        RichException cause_2( "com.codalogic.nexp.static.cause_2", "Cause 2", &cause_1 );
+        StaticRichException< 2, 2, 32 > wrapper( "com.codalogic.nexp.static.wrapper", "Wrapper", cause_2 );
+        Verify( wrapper.size() == 2 && wrapper.is_truncated(), "Are nodes beyond max_nodes left out?" );
+        Verify( wrapper.has( rich_uri_id( "com.codalogic.nexp.static.cause_1" ) ) &&
+                ! wrapper.has( rich_uri_id( "com.codalogic.nexp.static.cause_2" ) ), "Is the root cause kept in place of the nodes above it?" );
+        Verify( wrapper.elided_count() == 1, "Does elided_count() say how many exceptions were left out?" );
+
+        RichException cause_3( "com.codalogic.nexp.static.cause_3", "Cause 3", &cause_2 );
+        StaticRichException< 3, 2, 32 > deep_wrapper( "com.codalogic.nexp.static.wrapper", "Wrapper", cause_3 );
+        RichException::const_iterator i_node( deep_wrapper.begin() );
+        Verify( deep_wrapper.size() == 3 && (++i_node)->is( rich_uri_id( "com.codalogic.nexp.static.cause_3" ) ) &&
+                (++i_node)->is( rich_uri_id( "com.codalogic.nexp.static.cause_1" ) ) && deep_wrapper.elided_count() == 1,
+                "Are the most recent nodes and the root cause kept?" );
+#if defined( RICH_EXCEPTION_COMPACT )
+        Verify( deep_wrapper.to_string().find( "... 1 more" ) != std::string::npos, "Are elided nodes shown when rendered?" );
+#endif
+    }
+
+    std::string caught_uri;
+    try
+    {
+        throw StaticRichException<>( "com.codalogic.nexp.static.base", "Base" ).add( "path", long_value );
+    }
+    catch( const RichException & e )
+    {
+        caught_uri = e.main_error_uri();
+        RichExceptionDispatcher< int > dispatcher;
+        dispatcher.add( "com.codalogic.nexp.static.*", 1 );
+        Verify( dispatcher.find( e ).p_handler != 0, "Can a StaticRichException be dispatched as a RichException?" );
+    }
+    Verify( caught_uri == "com.codalogic.nexp.static.base", "Can a StaticRichException be caught as a RichException?" );
+
+    {
+        StaticRichException<> * p_original = new StaticRichException<>( "com.codalogic.nexp.static.shared", "Shared" );
+        p_original->add( "path", long_value );
+        std::string original_text( p_original->to_string() );
+        RichExceptionHandle handle( *p_original );
+        RichException copy( *p_original );
+        RichException chained_shared( "com.codalogic.nexp.static.outer", "Outer", *p_original );
+        RichException chained_taken( "com.codalogic.nexp.static.outer", "Outer", p_original );
+        Verify( &handle.front() != &p_original->front() && p_original->size() == 1,
+                "Are a StaticRichException's nodes copied rather than shared or taken?" );
+        delete p_original;
+        Verify( handle.to_string() == original_text && copy.to_string() == original_text &&
+                chained_shared.size() == 2 && chained_taken.to_string() == chained_shared.to_string() &&
+                chained_shared.front().next()->error_params.get( "path" ) == long_value,
+                "Do copies of a StaticRichException's nodes outlive it?" );
+
+        StaticRichException<> assigned( "com.codalogic.nexp.static.assigned", "Assigned" );
+        static_cast< RichException & >( assigned ) = copy;
+        Verify( assigned.main_error_uri() == std::string( "com.codalogic.nexp.static.shared" ),
+                "Can a StaticRichException be assigned to as a RichException?" );
+
+#if defined( RICH_EXCEPTION_CXX11 ) && ! defined( RICH_EXCEPTION_USE_ARENA )
+        StaticRichException<> out_of_memory( "com.codalogic.nexp.static.memory", "Out of memory" );
+        bool is_bad_alloc_thrown = false;
+        is_allocation_failing = true;
+        try
+        {
+            RichException moved( std::move( out_of_memory ) );
+        }
+        catch( const std::bad_alloc & )
+        {
+            is_bad_alloc_thrown = true;
+        }
+        is_allocation_failing = false;
+        Verify( is_bad_alloc_thrown && out_of_memory.size() == 1,
+                "Does moving a StaticRichException when memory is exhausted throw std::bad_alloc, rather than terminate?" );
+#endif
+    }
+}
+
+#if defined( RICH_EXCEPTION_CXX11 )
+void decide_repeatedly( RichLogSuppressor & r_suppressor, RichFingerprint fingerprint, int n_occurrences,
+                        std::atomic< long > & r_n_full, std::atomic< long > & r_n_dropped )
+{
+    for( int i = 0; i < n_occurrences; ++i )
+    {
+        RichLogDecision decision( r_suppressor.decide( fingerprint ) );
+        if( decision.action == log_full )
+            ++r_n_full;
+        else if( decision.action == log_drop )
+            ++r_n_dropped;
+    }
+}
+#endif
+
+void show_log_suppression()
+{
+    Suite( "show_log_suppression()" );
+
+    RichException cause( "com.codalogic.nexp.suppress.cause", "Cause" );
+    RichException first( "com.codalogic.nexp.suppress.wrapper", RichExceptionParams( "row", 1 ), "Wrapper", cause );
+    RichException second( "com.codalogic.nexp.suppress.wrapper", RichExceptionParams( "row", 2 ), "Wrapper", cause );
+    RichException reversed( "com.codalogic.nexp.suppress.cause", "Cause",
+                            RichException( "com.codalogic.nexp.suppress.wrapper", "Wrapper" ) );
+
+    Verify( rich_fingerprint( first ) == rich_fingerprint( second ), "Do chains with the same URIs have the same fingerprint?" );
+    Verify( rich_fingerprint( first ) != rich_fingerprint( reversed ), "Does the order of URIs change the fingerprint?" );
+    Verify( rich_fingerprint( first ) != rich_fingerprint( cause ), "Does the length of the chain change the fingerprint?" );
+    Verify( rich_fingerprint( first, fingerprint_uris_and_params ) != rich_fingerprint( second, fingerprint_uris_and_params ),
+            "Can parameters be included in the fingerprint?" );
+    Verify( rich_fingerprint( first, fingerprint_uris_and_params ) ==
+            rich_fingerprint( RichException( first ), fingerprint_uris_and_params ), "Are fingerprints stable?" );
+
+    std::string encoded( rich_wire_encode( first ) );
+    Verify( rich_fingerprint( RichExceptionView( encoded.data(), encoded.size() ), fingerprint_uris_and_params ) ==
+            rich_fingerprint( first, fingerprint_uris_and_params ), "Does a decoded chain have the same fingerprint?" );
+
+#if defined( RICH_EXCEPTION_CXX11 )
+    RichLogSuppressor suppressor( std::chrono::seconds( 10 ), 2 );
+    RichLogSuppressor::clock::time_point start( RichLogSuppressor::clock::now() );
+    RichFingerprint fingerprint( rich_fingerprint( first ) );
+
+    Verify( suppressor.decide( fingerprint, start ).action == log_full, "Is the first occurrence logged in full?" );
+    Verify( suppressor.decide( fingerprint, start + std::chrono::seconds( 1 ) ).action == log_full,
+            "Are n_full_per_interval occurrences logged in full?" );
+    Verify( suppressor.decide( fingerprint, start + std::chrono::seconds( 2 ) ).action == log_drop,
+            "Are further occurrences dropped?" );
+    suppressor.decide( fingerprint, start + std::chrono::seconds( 3 ) );
+    Verify( suppressor.decide( rich_fingerprint( cause ), start + std::chrono::seconds( 3 ) ).action == log_full,
+            "Are errors suppressed independently?" );
+
+    RichLogDecision summary( suppressor.decide( fingerprint, start + std::chrono::seconds( 11 ) ) );
+    Verify( summary.action == log_summary, "Is the first occurrence after the interval logged as a summary?" );
+    Verify( summary.n_suppressed == 2, "Does a summary count the dropped occurrences?" );
+    Verify( summary.period == std::chrono::seconds( 11 ), "Does a summary give the period of the drops?" );
+    Verify( suppressor.decide( fingerprint, start + std::chrono::seconds( 12 ) ).action == log_drop,
+            "Does a summary stand for the full logs of its interval?" );
+    Verify( suppressor.decide( fingerprint, start + std::chrono::seconds( 30 ) ).action == log_summary,
+            "Is an error that recurs summarised once per interval?" );
+    Verify( suppressor.decide( fingerprint, start + std::chrono::seconds( 45 ) ).action == log_full,
+            "Is an error logged in full again after an interval with no drops?" );
+
+    RichLogSuppressor small( std::chrono::seconds( 10 ), 1, 1 );
+    Verify( small.capacity() == 64, "Is capacity rounded up to whole sets in each shard?" );
+    for( RichFingerprint i = 0; i < 1000; ++i )
+        small.decide( i, start );
+    size_t n_remembered = 0;
+    for( RichFingerprint i = 0; i < 1000; ++i )
+        if( small.decide( i, start ).action == log_drop )
+            ++n_remembered;
+    Verify( n_remembered <= small.capacity(), "Is the number of errors remembered bounded?" );
+
+    RichLogSuppressor shared;
+    std::atomic< long > n_full( 0 ), n_dropped( 0 );
+    std::vector< std::thread > threads;
+    for( int i = 0; i < 4; ++i )
+        threads.push_back( std::thread( decide_repeatedly, std::ref( shared ), fingerprint, 1000, std::ref( n_full ), std::ref( n_dropped ) ) );
+    for( size_t i = 0; i < threads.size(); ++i )
+        threads[i].join();
+    Verify( n_full == 1 && n_dropped == 3999, "Is suppression consistent across threads?" );
+#endif
+}
+
+#if defined( RICH_EXCEPTION_CXX11 )
+std::string read_file( const char * p_path )
+{
+    std::ifstream file( p_path, std::ios::binary );
+    return std::string( (std::istreambuf_iterator< char >( file )), std::istreambuf_iterator< char >() );
+}
+
+void append_to_journal( RichJournal & r_journal, int thread, int n_appends )
+{
+    for( int i = 0; i < n_appends; ++i )
+        r_journal.append( RichException( "com.codalogic.nexp.journal.threaded", "Threaded" ).add( "thread", thread ).add( "i", i ) );
+}
+#endif
+
+void show_exception_journal()
+{
+#if defined( RICH_EXCEPTION_CXX11 )
+    Suite( "show_exception_journal()" );
+
+    const char * const p_path = "rich-exception-example.journal";
+    std::remove( p_path );
+
+    {
+        RichJournal journal( p_path, 64 * 1024 );
+        VerifyCritical( journal.is_open(), "Can a journal be created?" );
+        try
+        {
+            throw FileException( "abc.txt" );
+        }
+        catch( FileException & e )
+        {
+            Verify( journal.append( e ), "Can a caught exception be appended to a journal?" );
+            Verify( journal.append( RichException( "com.codalogic.nexp.journal.wrapper", "Wrapper", e ).add( "row", 12 ) ),
+                    "Can a chain be appended to a journal?" );
+        }
+    }
+    {
+        RichJournal journal( p_path, 64 * 1024 );
+        journal.append( RichException( "com.codalogic.nexp.journal.reopened", "Reopened" ) );
+    }
+
+    std::string contents( read_file( p_path ) );
+    RichJournalReader reader( contents.data(), contents.size() );
+    VerifyCritical( reader.is_valid(), "Can a journal file be read?" );
+    RichJournalRecord record;
+    Verify( reader.next( record ) && record.exception.is( rich_uri_id( "com.codalogic.file.noopen" ) ) &&
+            record.exception.front().error_params.get( "name" ) == "abc.txt", "Are journal records read back oldest first?" );
+    Verify( record.time > 0, "Is the time of a journal record recorded?" );
+    Verify( reader.next( record ) && record.exception.size() == 2 &&
+            record.exception.to_string() == "com.codalogic.nexp.journal.wrapper (row: 12): Wrapper\n"
+                                            "  com.codalogic.file.noopen (name: abc.txt): Unable to open file\n",
+            "Is a chain read back from a journal?" );
+    Verify( reader.next( record ) && record.exception.is( rich_uri_id( "com.codalogic.nexp.journal.reopened" ) ),
+            "Is a reopened journal appended to?" );
+    Verify( ! reader.next( record ), "Does the reader stop after the last record?" );
+
+    std::string corrupted( contents );
+    corrupted[64 + 30] ^= 0x55;     // Within the first record's encoded exception
+    RichJournalReader corrupted_reader( corrupted.data(), corrupted.size() );
+    Verify( corrupted_reader.next( record ) && record.exception.size() == 2, "Are damaged journal records skipped?" );
+
+    std::remove( p_path );
+    {
+        RichJournal small( p_path, 1 );     // The capacity is increased to hold at least one record
+        for( int i = 0; i < 1000; ++i )
+            small.append( RichException( "com.codalogic.nexp.journal.wrapped", "Wrapped" ).add( "i", i ) );
+    }
+    contents = read_file( p_path );
+    RichJournalReader wrapped_reader( contents.data(), contents.size() );
+    int n_records = 0;
+    int last_i = -1;
+    bool is_ordered = true;
+    while( wrapped_reader.next( record ) )
+    {
+        int i = atoi( record.exception.front().error_params.get( "i" ).c_str() );
+        is_ordered = is_ordered && i > last_i;
+        last_i = i;
+        ++n_records;
+    }
+    Verify( n_records > 10 && n_records < 1000, "Are the oldest records overwritten when the journal is full?" );
+    Verify( is_ordered && last_i == 999, "Are the newest records kept in order when the journal is full?" );
+
+    std::remove( p_path );
+    {
+        RichJournal shared( p_path, 256 * 1024 );
+        std::vector< std::thread > threads;
+        for( int i = 0; i < 4; ++i )
+            threads.push_back( std::thread( append_to_journal, std::ref( shared ), i, 250 ) );
+        for( size_t i = 0; i < threads.size(); ++i )
+            threads[i].join();
+    }
+    contents = read_file( p_path );
+    RichJournalReader threaded_reader( contents.data(), contents.size() );
+    n_records = 0;
+    while( threaded_reader.next( record ) )
+        ++n_records;
+    Verify( n_records == 1000, "Can many threads append to a journal at once?" );
+
+    std::remove( p_path );
+#endif
+}
+
+#if defined( RICH_EXCEPTION_CXX11 )
+void log_repeatedly( RichLogSink & r_sink, int n_logs )
+{
+    for( int i = 0; i < n_logs; ++i )
+        r_sink.log( RichException( "com.codalogic.nexp.sink.threaded", "Threaded" ).add( "i", i ) );
+}
+#endif
+
+void show_async_log_sink()
+{
+#if defined( RICH_EXCEPTION_CXX11 )
+    Suite( "show_async_log_sink()" );
+
+    std::string output;
+    std::atomic< bool > is_writer_released( true );
+    RichLogSink::Writer writer = [&]( const char * p_data, size_t length ) {
+            while( ! is_writer_released )
+                std::this_thread::yield();
+            output.append( p_data, length );
+        };
+
+    RichException cause( "com.codalogic.nexp.sink.cause", "Cause" );
+    RichException wrapper( "com.codalogic.nexp.sink.wrapper", RichExceptionParams( "row", 12 ), "Wrapper", cause );
+    {
+        RichLogSink sink( writer );
+        Verify( sink.log( cause ) && sink.log( wrapper ), "Can exceptions be logged asynchronously?" );
+        sink.flush();
+        Verify( output == cause.to_string() + wrapper.to_string(), "Does flush() write what has been logged as text?" );
+    }
+
+    output.clear();
+    {
+        RichLogSinkOptions options;
+        options.format = log_format_json;
+        RichLogSink sink( writer, options );
+        sink.log( wrapper );
+        sink.flush();
+        Verify( output == rich_json( wrapper ) + "\n", "Can exceptions be logged asynchronously as NDJSON?" );
+    }
+
+    output.clear();
+    {
+        RichLogSink sink( writer );
+        for( int i = 0; i < 100; ++i )
+            sink.log( cause );
+    }
+    Verify( output.size() == 100 * cause.to_string().size(), "Does destroying a sink write everything that was logged?" );
+
+    output.clear();
+    {
+        RichLogSinkOptions options;
+        options.capacity = 8;
+        RichLogSink sink( writer, options );
+        is_writer_released = false;
+        int n_logged = 0;
+        for( int i = 0; i < 100; ++i )
+            if( sink.log( cause ) )
+                ++n_logged;
+        Verify( sink.n_dropped() > 0 && sink.n_dropped() == static_cast< unsigned long long >( 100 - n_logged ),
+                "Does backpressure_drop drop exceptions when the queue is full?" );
+        is_writer_released = true;
+    }
+
+    output.clear();
+    {
+        RichLogSinkOptions options;
+        options.capacity = 64;
+        options.backpressure = backpressure_sample;
+        options.sample_rate = 4;
+        options.max_batch = 1;     // So that the background thread holds at most 1 exception while the writer is blocked
+        RichLogSink sink( writer, options );
+        is_writer_released = false;
+        for( int i = 0; i < 40; ++i )
+            sink.log( cause );
+        unsigned long long n_dropped = sink.n_dropped();
+        Verify( n_dropped > 0 && n_dropped < 40 - 32 / 4, "Does backpressure_sample keep some exceptions once the queue is half full?" );
+        is_writer_released = true;
+    }
+
+    output.clear();
+    {
+        RichLogSinkOptions options;
+        options.capacity = 64;
+        options.backpressure = backpressure_sample;
+        options.sample_rate = 0;
+        options.max_batch = 1;
+        RichLogSink sink( writer, options );
+        is_writer_released = false;
+        for( int i = 0; i < 40; ++i )
+            sink.log( cause );
+        is_writer_released = true;
+        sink.flush();
+        Verify( sink.n_dropped() == 0 && output.size() == 40 * cause.to_string().size(),
+                "Does a sample_rate of 0 keep every exception that fits in the queue?" );
+    }
+
+    output.clear();
+    {
+        RichLogSink sink( writer );
+        StaticRichException<> out_of_memory( "com.codalogic.nexp.sink.memory", "Out of memory" );
+        out_of_memory.add( "path", "A value too long to be stored within the parameter itself" );
+        is_allocation_failing = true;
+        bool is_logged = sink.log( out_of_memory );
+        is_allocation_failing = false;
+        sink.log( cause );
+        sink.flush();
+        Verify( is_logged ? output == out_of_memory.to_string() + cause.to_string() :
+                            output == cause.to_string() && sink.n_dropped() == 1,
+                "Is a StaticRichException that can't be copied when memory is exhausted dropped, without stalling the sink?" );
+    }
+
+    output.clear();
+    {
+        RichLogSinkOptions options;
+        options.capacity = 2;
+        options.backpressure = backpressure_block;
+        RichLogSink sink( writer, options );
+        std::vector< std::thread > threads;
+        for( int i = 0; i < 4; ++i )
+            threads.push_back( std::thread( log_repeatedly, std::ref( sink ), 250 ) );
+        for( size_t i = 0; i < threads.size(); ++i )
+            threads[i].join();
+        sink.flush();
+        Verify( sink.n_dropped() == 0, "Does backpressure_block not drop exceptions?" );
+        Verify( std::count( output.begin(), output.end(), '\n' ) == 1000, "Are exceptions from many threads all written?" );
+    }
+#endif
+}
+
+#if defined( RICH_EXCEPTION_CXX11 )
+void validate_records( RichExceptionAggregate & r_aggregate, int first, int last )
+{
+    RichAggregateCollector collector( r_aggregate );
+    for( int i = first; i < last; ++i )
+    {
+        try
+        {
+            if( i % 10 == 0 )
+                throw RichException( "com.codalogic.nexp.record.empty", "Empty record" ).add( "i", i );
+            if( i % 3 == 0 )
+                throw RichException( "com.codalogic.nexp.record.bad", "Bad record" ).add( "i", i );
+        }
+        catch( const RichException & e )
+        {
+            collector.add( e );
+        }
+    }
+}
+#endif
+
+void show_exception_aggregate()
+{
+#if defined( RICH_EXCEPTION_CXX11 )
+    Suite( "show_exception_aggregate()" );
+
+    RichExceptionAggregate aggregate( 2 );
+    Verify( aggregate.snapshot().empty(), "Is a new aggregate empty?" );
+    aggregate.throw_if_any();   // Should not throw
+
+    {
+        RichAggregateCollector collector( aggregate );
+        for( int i = 0; i < 5; ++i )
+            collector.add( RichException( "com.codalogic.nexp.aggr.first", "First" ).add( "i", i ) );
+        collector.add( RichException( "com.codalogic.nexp.aggr.second", "Second" ) );
+        Verify( aggregate.snapshot().empty(), "Does a collector buffer errors until it is flushed?" );
+    }
+    aggregate.add( RichException( "com.codalogic.nexp.aggr.second", "Second" ) );
+
+    RichErrorGroups groups( aggregate.snapshot() );
+    Verify( groups.size() == 2 && groups.count() == 7, "Are errors grouped by error URI?" );
+    Verify( groups.front().error_uri_id() == rich_uri_id( "com.codalogic.nexp.aggr.first" ) &&
+            groups.front().count() == 5, "Is the largest group first?" );
+    Verify( groups.front().size() == 2, "Are the examples kept in a group bounded?" );
+    Verify( groups.front().front().front().error_params[0].value == "0", "Are the first errors kept as examples?" );
+    RichErrorGroups::const_iterator second( groups.find( rich_uri_id( "com.codalogic.nexp.aggr.second" ) ) );
+    Verify( second != groups.end() && second->count() == 2 &&
+            std::string( second->error_uri() ) == "com.codalogic.nexp.aggr.second",
+            "Can a group be found by error URI?" );
+    size_t n_examples = 0;
+    std::ostringstream log;
+    for( RichErrorGroups::const_iterator i( groups.begin() ), i_end( groups.end() ); i != i_end; ++i )
+    {
+        log << i->error_uri() << " x " << i->count() << ": " << i->front();
+        for( RichErrorGroup::const_iterator j( i->begin() ), j_end( i->end() ); j != j_end; ++j )
+        {
+            RichErrorGroup::const_reference r_example( *j );
+            if( r_example.get().is( i->error_uri_id() ) )
+                ++n_examples;
+        }
+    }
+    Verify( n_examples == 4, "Can the groups and their examples be iterated?" );
+    Verify( log.str().find( "com.codalogic.nexp.aggr.first x 5: com.codalogic.nexp.aggr.first (i: 0): First" ) == 0,
+            "Can groups be logged as shown in rich-exception-aggregate.h?" );
+
+    bool is_thrown = false;
+    try
+    {
+        aggregate.throw_if_any();
+    }
+    catch( const RichAggregateException & e )
+    {
+        is_thrown = true;
+        Verify( e.is( rich_uri_id( "com.codalogic.rich_excep.aggregate" ) ) && e.groups().count() == 7,
+                "Does throw_if_any() throw the aggregated errors?" );
+        Verify( e.size() == 2 && std::string( e.begin()->next()->error_uri ) == "com.codalogic.nexp.aggr.first",
+                "Is the thrown exception chained to an example of the largest group?" );
+    }
+    Verify( is_thrown, "Does throw_if_any() throw when there are errors?" );
+
+    aggregate.clear();
+    Verify( aggregate.snapshot().empty(), "Can an aggregate be cleared?" );
+
+    std::vector< std::thread > threads;
+    for( int i = 0; i < 4; ++i )
+        threads.push_back( std::thread( validate_records, std::ref( aggregate ), i * 1000, (i + 1) * 1000 ) );
+    for( size_t i = 0; i < threads.size(); ++i )
+        threads[i].join();
+    groups = aggregate.snapshot();
+    Verify( groups.size() == 2 && groups.count() == 400 + 1200 &&
+            groups.find( rich_uri_id( "com.codalogic.nexp.record.empty" ) )->count() == 400,
+            "Are errors from many threads all counted?" );
+#endif
+}
+
+void show_allocations_per_rethrow()
+{
+    Suite( "show_allocations_per_rethrow()" );
+
+    // The heap allocations documented here are those made via operator new,
+    // excluding the memory the C++ runtime allocates for thrown objects.
+    // (Instrumentation makes allocations of its own, so the counts are not
+    // checked when it is enabled.)
+
+    const char * const long_value = "A value too long to be stored within the parameter itself";
+
+    long n_at_start = n_heap_allocations;
+    FileException file_exception( "abc.txt" );
+#if ! defined( RICH_EXCEPTION_USE_ARENA ) && ! defined( RICH_EXCEPTION_INSTRUMENT )
+    long n_for_file_exception = n_heap_allocations - n_at_start;
+    Verify( n_for_file_exception == 1, "Does an exception with short params make 1 allocation (its node)?" );
+#endif
+
+    n_at_start = n_heap_allocations;
+    RichException wrapper( "com.codalogic.nexp.rethrow.wrapper",
+                           RichExceptionParams( "attempt", 1 ).add( "path", long_value ),
+                           "Wrapper", &file_exception );
+#if ! defined( RICH_EXCEPTION_USE_ARENA ) && ! defined( RICH_EXCEPTION_INSTRUMENT )
+    long n_for_wrapper = n_heap_allocations - n_at_start;
+#if defined( RICH_EXCEPTION_CXX11 )
+    Verify( n_for_wrapper == 2, "Does chaining a node with a long value make 2 allocations (node and moved value)?" );
+#else
+    Verify( n_for_wrapper == 4, "Does chaining a node with a long value make 4 allocations (node, value and 2 copies of value)?" );
+#endif
+#endif
+
+    n_at_start = n_heap_allocations;
+    RichException copy( wrapper );
+#if ! defined( RICH_EXCEPTION_USE_ARENA ) && ! defined( RICH_EXCEPTION_INSTRUMENT )
+    long n_for_copy = n_heap_allocations - n_at_start;
+    Verify( n_for_copy == 0, "Does copying a chain make no allocations?" );
+#endif
+
+#if defined( RICH_EXCEPTION_CXX11 )
+    try
+    {
+        try
+        {
+            throw FileException( "abc.txt" );
+        }
+        catch( FileException & e )
+        {
+            n_at_start = n_heap_allocations;
+            throw RichException( "com.codalogic.nexp.rethrow.moved",
+                                 RichExceptionParams( "attempt", 2 ).add( "path", long_value ),
+                                 "Moved",
+                                 std::move( e ) );
+        }
+    }
+    catch( RichException & e )
+    {
+#if ! defined( RICH_EXCEPTION_USE_ARENA ) && ! defined( RICH_EXCEPTION_INSTRUMENT )
+        long n_for_rethrow = n_heap_allocations - n_at_start;
+        Verify( n_for_rethrow == 2, "Does a move rethrow with a long value make 2 allocations (node and value)?" );
+#endif
+
+        VerifyCritical( e.size() == 2, "Is moved chain size correct?" );
+        Verify( e.front().error_params.get( "path" ) == long_value, "Is moved param value correct?" );
+        Verify( e.begin()->next()->error_params.get( "name" ) == "abc.txt", "Is moved cause correct?" );
+    }
+
+    RichException moved_from( "com.codalogic.nexp.rethrow.moved_from", "Moved from" );
+    n_at_start = n_heap_allocations;
+    RichException moved_to( std::move( moved_from ) );
+    long n_for_move = n_heap_allocations - n_at_start;
+
+    Verify( n_for_move == 0, "Does moving an exception make no allocations?" );
+    Verify( moved_from.empty() && moved_to.size() == 1, "Has moving an exception transferred its nodes?" );
+
+    n_at_start = n_heap_allocations;
+    RichException added = RichException( "com.codalogic.nexp.rethrow.added", "Added" ).add( "p1", 1 );
+#if ! defined( RICH_EXCEPTION_USE_ARENA ) && ! defined( RICH_EXCEPTION_INSTRUMENT )
+    long n_for_add = n_heap_allocations - n_at_start;
+    Verify( n_for_add == 1, "Does add() on a temporary move rather than copy?" );
+#endif
+#endif
+}
+
+void show_instrumentation()
+{
+#if defined( RICH_EXCEPTION_INSTRUMENT )
+    Suite( "show_instrumentation()" );
+
+    RichInstrumentation::instance().reset();
+
+    try
+    {
+        try
+        {
+            throw RichException( "com.codalogic.nexp.instrument.inner",
+                                 "Inner" ).add( "path", "A value too long to be stored within the parameter itself" );
+        }
+        catch( RichException & e )
+        {
+            throw RichException( "com.codalogic.nexp.instrument.outer", "Outer", std::move( e ) );
+        }
+    }
+    catch( RichException & e )
+    {
+        std::string text( e.to_string() );
+        std::ostringstream os;
+        os << e;
+    }
+
+    std::vector< RichInstrumentRecord > records( RichInstrumentation::instance().snapshot() );
+
+    VerifyCritical( records.size() == 2, "Is instrumentation recorded for each error URI?" );
+    Verify( records[0].error_uri == "com.codalogic.nexp.instrument.inner", "Are instrumentation records ordered by URI?" );
+
+    const RichInstrumentRecord & r_inner( records[0] );
+    Verify( r_inner[instrument_construct].n_operations == 1, "Is construction recorded?" );
+    Verify( r_inner[instrument_construct].n_allocations == 1, "Is construction allocation count correct?" );
+    Verify( r_inner[instrument_construct].n_bytes >= sizeof( RichExceptionNode ), "Are construction bytes recorded?" );
+    Verify( r_inner[instrument_add].n_operations == 1, "Is add() recorded?" );
+    Verify( r_inner[instrument_add].n_allocations == 1, "Is add() allocation of long value recorded?" );
+    Verify( r_inner[instrument_chain].n_operations == 0, "Is inner exception not recorded as chained?" );
+
+    const RichInstrumentRecord & r_outer( records[1] );
+    Verify( r_outer[instrument_chain].n_operations == 1, "Is chaining recorded?" );
+    Verify( r_outer[instrument_construct].n_operations == 0, "Is chaining not recorded as construction?" );
+    Verify( r_outer[instrument_render].n_operations == 2, "Are to_string() and operator << recorded?" );
+
+    std::ostringstream dump;
+    RichInstrumentation::instance().dump( dump );
+    Verify( dump.str().find( "com.codalogic.nexp.instrument.outer render n=2 allocations=0 bytes=0 cycles=" ) != std::string::npos,
+            "Is instrumentation dump correct?" );
+
+    RichInstrumentation::instance().reset();
+    Verify( RichInstrumentation::instance().snapshot().empty(), "Does reset() clear instrumentation?" );
+
+    const std::string long_uri( 2000000, 'u' );
+    RichException long_exception( long_uri.c_str(), "Long" );
+    Verify( RichInstrumentation::instance().snapshot().size() == 1, "Can exceptions with very long error URIs be instrumented?" );
+    RichInstrumentation::instance().reset();
+#endif
+}
+
+#if defined( RICH_EXCEPTION_STATS )
+void count_stats_exceptions( int n_exceptions )
+{
+    for( int i = 0; i < n_exceptions; ++i )
+    {
+        RichException cause( "com.codalogic.nexp.stats.threaded_cause", "Threaded cause" );
+        RichException wrapper( "com.codalogic.nexp.stats.threaded", "Threaded", std::move( cause ) );
+    }
+}
+#endif
+
+void show_exception_stats()
+{
+#if defined( RICH_EXCEPTION_STATS )
+    Suite( "show_exception_stats()" );
+
+    RichExceptionStats before( RichExceptionStats::snapshot() );
+
+    for( int i = 0; i < 3; ++i )
+    {
+        try
+        {
+            try
+            {
+                throw FileException( "abc.txt" );
+            }
+            catch( FileException & e )
+            {
+                throw RichException( "com.codalogic.nexp.stats.wrapper", "Wrapper", &e );
+            }
+        }
+        catch( RichException & )
+        {
+        }
+    }
+    RichException other( "com.codalogic.nexp.stats.other", "Other" );
+
+    RichExceptionStats delta( RichExceptionStats::snapshot().since( before ) );
+
+    Verify( delta.counts().size() == 3, "Are stats counted for each error URI?" );
+    Verify( delta.raised( rich_uri_id( "com.codalogic.file.noopen" ) ) == 3, "Are raised causes counted?" );
+    Verify( delta.wrapped( rich_uri_id( "com.codalogic.file.noopen" ) ) == 3, "Are wrapped causes counted?" );
+    Verify( delta.raised( rich_uri_id( "com.codalogic.nexp.stats.wrapper" ) ) == 3, "Are raised wrappers counted?" );
+    Verify( delta.wrapped( rich_uri_id( "com.codalogic.nexp.stats.wrapper" ) ) == 0, "Are unwrapped exceptions not counted as wrapped?" );
+    Verify( delta.raised( rich_uri_id( "com.codalogic.nexp.stats.unused" ) ) == 0, "Are unraised URIs not counted?" );
+
+    std::vector< RichUriCount > top( delta.top( 2 ) );
+    VerifyCritical( top.size() == 2, "Is top-N size correct?" );
+    Verify( top[0].n_raised == 3 && top[1].n_raised == 3, "Are the most raised URIs first?" );
+    Verify( delta.top( 10 ).size() == 3, "Is top-N limited to the URIs counted?" );
+    Verify( strcmp( delta.find( rich_uri_id( "com.codalogic.nexp.stats.other" ) )->error_uri, "com.codalogic.nexp.stats.other" ) == 0,
+            "Is counted URI text available?" );
+
+    RichExceptionStats merged( delta );
+    merged.merge( delta );
+    Verify( merged.raised( rich_uri_id( "com.codalogic.file.noopen" ) ) == 6, "Does merging snapshots sum counts?" );
+
+    before = RichExceptionStats::snapshot();
+    std::vector< std::thread > threads;
+    for( int i = 0; i < 8; ++i )
+        threads.push_back( std::thread( count_stats_exceptions, 1000 ) );
+    for( size_t i = 0; i < threads.size(); ++i )
+        threads[i].join();
+    delta = RichExceptionStats::snapshot().since( before );
+    Verify( delta.raised( rich_uri_id( "com.codalogic.nexp.stats.threaded" ) ) == 8000, "Are raised counts from exited threads retained?" );
+    Verify( delta.wrapped( rich_uri_id( "com.codalogic.nexp.stats.threaded_cause" ) ) == 8000, "Are wrapped counts from exited threads retained?" );
+#endif
+}
+
+void show_chain_compaction()
+{
+#if defined( RICH_EXCEPTION_COMPACT )
+    Suite( "show_chain_compaction()" );
+
+    RichException retried( "com.codalogic.nexp.retry.root", "Connection refused" );
+    for( int i = 0; i < 100; ++i )
+        retried = RichException( "com.codalogic.nexp.retry", RichExceptionParams( "attempt", i ), "Retry failed", &retried );
+    Verify( retried.size() == 2 && retried.front().repeat_count() == 100,
+            "Are identical consecutive exceptions merged into one node?" );
+    Verify( retried.front().error_params[0].value == "99", "Does a merged node keep the most recent parameters?" );
+    Verify( retried.to_string().find( "Retry failed (x100)" ) != std::string::npos, "Are repeat counts rendered?" );
+
+    RichException recursed( "com.codalogic.nexp.recurse.root", "Stack overflow" );
+    for( int i = 0; i < 100; ++i )
+        recursed = RichException( i % 2 ? "com.codalogic.nexp.recurse.odd" : "com.codalogic.nexp.recurse.even", "Recursed", &recursed );
+    Verify( recursed.size() == RICH_EXCEPTION_MAX_CHAIN_DEPTH, "Is the depth of a chain capped?" );
+    Verify( strcmp( recursed.rbegin()->error_uri, "com.codalogic.nexp.recurse.root" ) == 0 &&
+            strcmp( recursed.front().error_uri, "com.codalogic.nexp.recurse.odd" ) == 0,
+            "Are the root cause and the outermost exception kept?" );
+    size_t n_layers = 0;
+    for( RichException::const_iterator i( recursed.begin() ), i_end( recursed.end() ); i != i_end; ++i )
+        n_layers += i->repeat_count() + i->omitted_count();
+    Verify( n_layers == 101, "Do the repeat and omitted counts account for every exception?" );
+    std::ostringstream expected_omitted;
+    expected_omitted << "... " << 101 - RICH_EXCEPTION_MAX_CHAIN_DEPTH << " more\n";
+    Verify( recursed.to_string().find( expected_omitted.str() ) != std::string::npos, "Are omitted exceptions rendered?" );
+
+    std::string shared_before( recursed.to_string() );
+    RichException wrapper( "com.codalogic.nexp.recurse.wrapper", "Wrapper", recursed );
+    Verify( wrapper.size() == RICH_EXCEPTION_MAX_CHAIN_DEPTH && recursed.to_string() == shared_before,
+            "Does capping a chain leave exceptions sharing its nodes unchanged?" );
+
+    char buffer[8192];
+    size_t length = rich_serialize( wrapper, buffer, sizeof( buffer ) );
+    Verify( std::string( buffer, length ) == wrapper.to_string(), "Does rich_serialize() render compacted chains as to_string() does?" );
+#endif
+}
+
+void show_stack_capture()
+{
+#if defined( RICH_EXCEPTION_STACK )
+    Suite( "show_stack_capture()" );
+
+    RichStackTrace::enable_capture( true );
+
+    RichException cause( "com.codalogic.nexp.stack.cause", "Cause" );
+    RichException wrapper( "com.codalogic.nexp.stack.wrapper", "Wrapper", cause );
+
+    const RichStackTrace & r_stack_trace( cause.front().stack_trace );
+    VerifyCritical( ! r_stack_trace.empty(), "Is a stack trace captured when a node is constructed?" );
+    Verify( r_stack_trace.size() <= RICH_EXCEPTION_STACK_DEPTH, "Is the stack trace limited to RICH_EXCEPTION_STACK_DEPTH frames?" );
+    Verify( ! r_stack_trace.symbol( 0 ).empty(), "Can a frame be symbolized?" );
+    Verify( r_stack_trace.symbol( 0 ) == r_stack_trace.symbol( 0 ), "Are symbols consistently looked up?" );
+
+    RichException copy( cause );
+    copy.add( "extra", 1 );   // Forces the shared node to be copied
+    Verify( copy.front().stack_trace.size() == r_stack_trace.size() &&
+            copy.front().stack_trace[0] == r_stack_trace[0], "Is the stack trace kept when a node is copied?" );
+
+    std::string text( wrapper.to_string() );
+    Verify( text.find( "com.codalogic.nexp.stack.wrapper: Wrapper\n    at " ) == 0, "Does to_string() render the stack trace?" );
+    Verify( text.find( "\n  com.codalogic.nexp.stack.cause: Cause\n      at " ) != std::string::npos,
+            "Is each node's stack trace indented below it?" );
+
+    char buffer[4096];
+    rich_serialize( wrapper, buffer, sizeof( buffer ) );
+    Verify( std::string( buffer ).find( "com.codalogic.nexp.stack.wrapper: Wrapper\n    at 0x" ) == 0,
+            "Does rich_serialize() write the raw addresses?" );
+
+    RichStackTrace::enable_capture( false );
+    RichException untraced( "com.codalogic.nexp.stack.untraced", "Untraced" );
+    Verify( untraced.front().stack_trace.empty(), "Can stack capture be disabled?" );
+    Verify( untraced.to_string() == "com.codalogic.nexp.stack.untraced: Untraced\n", "Is an untraced node rendered without a trace?" );
+#endif
+}
+
 // Reworked from https://github.com/codalogic/safe-divide
 
 template< typename Texception >
@@ -401,6 +2300,10 @@ void show_rework_of_safe_divide_project()
 
 int main( int argc, char * argv[] )
 {
+#if defined( RICH_EXCEPTION_STACK )
+    RichStackTrace::enable_capture( false );    // Keeps the rendered text predictable.  See show_stack_capture()
+#endif
+
     show_single_exception_class();
 
     show_throw_2();
@@ -413,6 +2316,56 @@ int main( int argc, char * argv[] )
 
     show_has_and_get_parameter_access();
 
+    show_indexed_parameter_lookup();
+
+    show_allocations_per_rethrow();
+
+    show_allocation_free_serialization();
+
+    show_wire_format_round_trip();
+
+    show_wire_format_fuzzing();
+
+    show_json_output();
+
+    show_rich_result();
+
+    show_shared_chaining();
+
+    show_cross_thread_handles();
+
+    show_static_rich_exception();
+
+    show_capture_policies();
+
+    show_log_suppression();
+
+    show_exception_journal();
+
+    show_async_log_sink();
+
+    show_exception_aggregate();
+
+    show_instrumentation();
+
+    show_exception_stats();
+
+    show_stack_capture();
+
+    show_chain_compaction();
+
+    show_error_uri_ids();
+
+    show_uri_prefix_dispatch();
+
+    show_chain_iteration_and_copying();
+
+    show_params_beyond_inline_storage();
+
+    show_fast_parameter_formatting();
+
+    show_lazy_parameter_capture();
+
     show_rework_of_safe_divide_project();
 
     report();
@@ -0,0 +1,128 @@
+//----------------------------------------------------------------------------
+// Copyright (c) 2015, Codalogic Ltd (http://www.codalogic.com)
+// All rights reserved.
+//
+// The license for this file is based on the BSD-3-Clause license
+// (http://www.opensource.org/licenses/BSD-3-Clause).
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//
+// - Redistributions of source code must retain the above copyright notice,
+//   this list of conditions and the following disclaimer.
+// - Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+// - Neither the name Codalogic Ltd nor the names of its contributors may be
+//   used to endorse or promote products derived from this software without
+//   specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//----------------------------------------------------------------------------
+
+//----------------------------------------------------------------------------
+// Prints the RichExceptions recorded in a RichJournal file, oldest first.
+//
+// Usage:
+//      rich-exception-journal-reader [--json] journal-file
+//
+// By default each record is printed as its time (UTC) followed by the
+// exception as rendered by operator <<.  With --json, each record is
+// printed as a line of NDJSON (see rich-exception-json.h).
+//----------------------------------------------------------------------------
+
+#include "rich-exception-journal.h"
+#include "rich-exception-json.h"
+
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <string>
+
+using namespace rich_excep;
+
+namespace {
+
+std::string format_time( uint64_t nanoseconds )
+{
+    time_t seconds = static_cast< time_t >( nanoseconds / 1000000000ULL );
+    struct tm utc;
+#if defined( _WIN32 )
+    gmtime_s( &utc, &seconds );
+#else
+    gmtime_r( &seconds, &utc );
+#endif
+    char buffer[64];
+    size_t length = strftime( buffer, sizeof( buffer ), "%Y-%m-%dT%H:%M:%S", &utc );
+    snprintf( buffer + length, sizeof( buffer ) - length, ".%09uZ", static_cast< unsigned int >( nanoseconds % 1000000000ULL ) );
+    return buffer;
+}
+
+int usage()
+{
+    std::cerr << "Usage: rich-exception-journal-reader [--json] journal-file\n";
+    return 2;
+}
+
+}   // namespace
+
+int main( int argc, char * argv[] )
+{
+    bool is_json = false;
+    const char * p_path = 0;
+    for( int i = 1; i < argc; ++i )
+    {
+        if( strcmp( argv[i], "--json" ) == 0 )
+            is_json = true;
+        else if( ! p_path )
+            p_path = argv[i];
+        else
+            return usage();
+    }
+    if( ! p_path )
+        return usage();
+
+    std::ifstream file( p_path, std::ios::binary );
+    if( ! file )
+    {
+        std::cerr << "Unable to open " << p_path << "\n";
+        return 1;
+    }
+    std::string contents( (std::istreambuf_iterator< char >( file )), std::istreambuf_iterator< char >() );
+
+    RichJournalReader reader( contents.data(), contents.size() );
+    if( ! reader.is_valid() )
+    {
+        std::cerr << p_path << " is not a RichJournal file\n";
+        return 1;
+    }
+
+    RichJournalRecord record;
+    RichJsonWriter json;
+    while( reader.next( record ) )
+    {
+        if( is_json )
+        {
+            json.clear();
+            json.write_line( record.exception );
+            std::cout.write( json.data(), json.size() );
+        }
+        else
+            std::cout << format_time( record.time ) << "\n" << record.exception << "\n";
+    }
+    return 0;
+}
@@ -0,0 +1,479 @@
+//----------------------------------------------------------------------------
+// Copyright (c) 2015, Codalogic Ltd (http://www.codalogic.com)
+// All rights reserved.
+//
+// The license for this file is based on the BSD-3-Clause license
+// (http://www.opensource.org/licenses/BSD-3-Clause).
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//
+// - Redistributions of source code must retain the above copyright notice,
+//   this list of conditions and the following disclaimer.
+// - Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+// - Neither the name Codalogic Ltd nor the names of its contributors may be
+//   used to endorse or promote products derived from this software without
+//   specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//----------------------------------------------------------------------------
+
+//----------------------------------------------------------------------------
+// A journal of RichExceptions that survives the process crashing.
+//
+// RichJournal keeps a fixed size ring buffer in a memory mapped file.
+// append() writes a RichException into it in the binary wire format (see
+// rich-exception-wire.h), along with the time it was appended.  Because the
+// file is memory mapped, what has been appended is in the operating system's
+// page cache as soon as append() returns, and so is kept if the process
+// crashes (though not if the machine does, unless flush() is called).
+// For example:
+//
+//      RichJournal journal( "/var/tmp/myservice.journal", 1024 * 1024 );
+//      journal.install_terminate_handler();
+//      ...
+//      catch( const RichException & e )
+//      {
+//          journal.append( e );
+//          ...
+//      }
+//
+// install_terminate_handler() appends any RichException that is in flight
+// when std::terminate() is called, before calling the previous handler.
+//
+// append() can be called from many threads at once.  Each append reserves
+// its space with a single atomic add and then writes its record without
+// locks or allocations.  Once the ring is full the oldest records are
+// overwritten.  Records larger than max_record_size bytes are not written.
+//
+// RichJournalReader reads the records in a journal file, oldest first, e.g.
+// after a crash.  Records that were incomplete when the process died, or
+// were partly overwritten, are skipped.  rich-exception-journal-reader.cpp
+// is a command line tool that prints them.
+//
+// Each record is:
+//      8 bytes     Offset of the record in the stream of all records
+//                  appended, written last so that it marks the record as
+//                  complete
+//      4 bytes     Length of the encoded exception
+//      4 bytes     Checksum of the encoded exception
+//      8 bytes     Time appended, in nanoseconds since the Unix epoch
+//      ...         The encoded exception, padded to a multiple of 8 bytes
+// and records are preceded in the file by a 64 byte header.  Integers are
+// in the writing machine's byte order.  (Requires C++11.)
+//----------------------------------------------------------------------------
+
+#ifndef RICH_EXCEPTION_JOURNAL
+#define RICH_EXCEPTION_JOURNAL
+
+#include "rich-exception.h"
+#include "rich-exception-wire.h"
+
+#if defined( RICH_EXCEPTION_CXX11 )
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <exception>
+#include <vector>
+
+#if defined( _WIN32 )
+    #ifndef WIN32_LEAN_AND_MEAN
+        #define WIN32_LEAN_AND_MEAN
+    #endif
+    #include <windows.h>
+#else
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+#endif
+
+namespace rich_excep {
+
+namespace detail {
+
+static const char journal_magic[8] = { 'R', 'X', 'J', 'O', 'U', 'R', 'N', 'L' };
+static const uint32_t journal_version = 1;
+static const size_t journal_header_size = 64;
+static const size_t journal_record_header_size = 24;
+
+struct RichJournalHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t header_size;
+    uint64_t capacity;                  // Bytes in the ring.  A multiple of 8
+    std::atomic< uint64_t > n_written;  // Bytes reserved since the journal was created
+};
+
+struct RichJournalRecordHeader
+{
+    uint64_t offset;
+    uint32_t length;
+    uint32_t checksum;
+    uint64_t time;
+};
+
+inline size_t journal_padded( size_t length ) { return (length + 7) & ~size_t( 7 ); }
+
+inline uint32_t journal_checksum( const char * p_data, size_t length )
+{
+    // Quicker than a byte-wise hash, as appending is on the error path of
+    // production code.  Only needs to detect records that were partly
+    // overwritten.
+    uint64_t hash = 0x9e3779b97f4a7c15ULL ^ length;
+    size_t i = 0;
+    for( ; i + 8 <= length; i += 8 )
+    {
+        uint64_t word;
+        memcpy( &word, p_data + i, 8 );
+        hash = (hash ^ word) * 0xff51afd7ed558ccdULL;
+        hash ^= hash >> 32;
+    }
+    for( ; i < length; ++i )
+        hash = (hash ^ static_cast< unsigned char >( p_data[i] )) * 0xc4ceb9fe1a85ec53ULL;
+    return static_cast< uint32_t >( hash ^ (hash >> 32) );
+}
+
+// Copies between a ring buffer, indexed by offsets into the stream of all
+// bytes written to it, and linear memory
+inline void journal_write( char * p_ring, uint64_t capacity, uint64_t offset, const void * p_data, size_t length )
+{
+    size_t start = static_cast< size_t >( offset % capacity );
+    size_t n_first = static_cast< size_t >( (std::min)( uint64_t( length ), capacity - start ) );
+    memcpy( p_ring + start, p_data, n_first );
+    memcpy( p_ring, static_cast< const char * >( p_data ) + n_first, length - n_first );
+}
+
+inline void journal_read( const char * p_ring, uint64_t capacity, uint64_t offset, void * p_data, size_t length )
+{
+    size_t start = static_cast< size_t >( offset % capacity );
+    size_t n_first = static_cast< size_t >( (std::min)( uint64_t( length ), capacity - start ) );
+    memcpy( p_data, p_ring + start, n_first );
+    memcpy( static_cast< char * >( p_data ) + n_first, p_ring, length - n_first );
+}
+
+inline std::atomic< uint64_t > & journal_commit_word( char * p_ring, uint64_t capacity, uint64_t offset )
+{
+    // Records start on 8 byte boundaries and the capacity is a multiple of 8,
+    // so the word is never split by the end of the ring
+    return *reinterpret_cast< std::atomic< uint64_t > * >( p_ring + offset % capacity );
+}
+
+}   // namespace detail
+
+class RichJournal
+{
+public:
+#ifdef RICH_EXCEPTION_JOURNAL_MAX_RECORD_SIZE
+    static const size_t max_record_size = RICH_EXCEPTION_JOURNAL_MAX_RECORD_SIZE;
+#else
+    static const size_t max_record_size = 4096;
+#endif
+
+private:
+    char * p_mapping;
+    size_t mapping_size;
+    detail::RichJournalHeader * p_header;
+    char * p_ring;
+    uint64_t capacity;
+#if defined( _WIN32 )
+    HANDLE file;
+    HANDLE file_mapping;
+#else
+    int fd;
+#endif
+    std::terminate_handler previous_terminate_handler;
+
+    static RichJournal * & terminate_journal() { static RichJournal * p_journal = 0; return p_journal; }
+
+public:
+    // Opens the journal file at p_path, creating it if needed.  An existing
+    // journal with the same capacity is appended to, otherwise the file is
+    // (re)initialised.  capacity_in is rounded up to a multiple of 8.
+    RichJournal( const char * p_path, size_t capacity_in )
+        :
+        p_mapping( 0 ),
+        mapping_size( 0 ),
+        p_header( 0 ),
+        p_ring( 0 ),
+        capacity( detail::journal_padded( (std::max)( capacity_in, max_record_size + detail::journal_record_header_size ) ) ),
+#if defined( _WIN32 )
+        file( INVALID_HANDLE_VALUE ),
+        file_mapping( 0 ),
+#else
+        fd( -1 ),
+#endif
+        previous_terminate_handler( 0 )
+    {
+        static_assert( sizeof( detail::RichJournalHeader ) <= detail::journal_header_size, "RichJournalHeader is too large" );
+        static_assert( sizeof( detail::RichJournalRecordHeader ) == detail::journal_record_header_size, "RichJournalRecordHeader is not packed" );
+        mapping_size = static_cast< size_t >( detail::journal_header_size + capacity );
+        if( ! map( p_path ) )
+        {
+            unmap();
+            return;
+        }
+        p_header = reinterpret_cast< detail::RichJournalHeader * >( p_mapping );
+        p_ring = p_mapping + detail::journal_header_size;
+        if( memcmp( p_header->magic, detail::journal_magic, sizeof( detail::journal_magic ) ) != 0 ||
+                p_header->version != detail::journal_version ||
+                p_header->header_size != detail::journal_header_size ||
+                p_header->capacity != capacity )
+        {
+            memset( p_mapping, 0, mapping_size );
+            p_header->version = detail::journal_version;
+            p_header->header_size = detail::journal_header_size;
+            p_header->capacity = capacity;
+            p_header->n_written.store( 0 );
+            memcpy( p_header->magic, detail::journal_magic, sizeof( detail::journal_magic ) );
+        }
+    }
+    ~RichJournal()
+    {
+        if( terminate_journal() == this )
+        {
+            std::set_terminate( previous_terminate_handler );
+            terminate_journal() = 0;
+        }
+        unmap();
+    }
+
+    bool is_open() const { return p_mapping != 0; }
+
+    // Returns false if the journal isn't open or the encoded exception is
+    // larger than max_record_size
+    bool append( const RichException & r_exception )
+    {
+        if( ! is_open() )
+            return false;
+        char encoded[max_record_size];
+        size_t length = rich_wire_encode( r_exception, encoded, sizeof( encoded ) );
+        if( length > sizeof( encoded ) )
+            return false;
+        uint64_t record_size = detail::journal_record_header_size + detail::journal_padded( length );
+        uint64_t offset = p_header->n_written.fetch_add( record_size, std::memory_order_relaxed );
+
+        // Invalidate whatever record was at this offset before writing the
+        // new one, so that a reader can't see a mixture of the two
+        std::atomic< uint64_t > & r_commit( detail::journal_commit_word( p_ring, capacity, offset ) );
+        r_commit.store( ~uint64_t( 0 ), std::memory_order_relaxed );
+        std::atomic_thread_fence( std::memory_order_release );
+
+        detail::RichJournalRecordHeader record_header;
+        record_header.offset = ~uint64_t( 0 );
+        record_header.length = static_cast< uint32_t >( length );
+        record_header.checksum = detail::journal_checksum( encoded, length );
+        record_header.time = static_cast< uint64_t >( std::chrono::duration_cast< std::chrono::nanoseconds >(
+                std::chrono::system_clock::now().time_since_epoch() ).count() );
+        detail::journal_write( p_ring, capacity, offset + sizeof( uint64_t ),
+                               reinterpret_cast< const char * >( &record_header ) + sizeof( uint64_t ),
+                               detail::journal_record_header_size - sizeof( uint64_t ) );
+        detail::journal_write( p_ring, capacity, offset + detail::journal_record_header_size, encoded, length );
+        r_commit.store( offset, std::memory_order_release );
+        return true;
+    }
+
+    // Appends the RichException, if any, that is in flight when
+    // std::terminate() is called.  Only one journal at a time can be
+    // installed.
+    void install_terminate_handler()
+    {
+        terminate_journal() = this;
+        previous_terminate_handler = std::set_terminate( &on_terminate );
+    }
+
+    // Writes the journal to disk, so that it survives the machine crashing
+    bool flush()
+    {
+        if( ! is_open() )
+            return false;
+#if defined( _WIN32 )
+        return FlushViewOfFile( p_mapping, mapping_size ) != FALSE && FlushFileBuffers( file ) != FALSE;
+#else
+        return msync( p_mapping, mapping_size, MS_SYNC ) == 0;
+#endif
+    }
+
+private:
+    RichJournal( const RichJournal & );                 // Not implemented
+    RichJournal & operator = ( const RichJournal & );   // Not implemented
+
+    static void on_terminate()
+    {
+        RichJournal * p_journal = terminate_journal();
+        if( p_journal )
+        {
+            if( std::exception_ptr p_current = std::current_exception() )
+            {
+                try
+                {
+                    std::rethrow_exception( p_current );
+                }
+                catch( const RichException & e )
+                {
+                    p_journal->append( e );
+                }
+                catch( ... )
+                {
+                }
+            }
+            if( p_journal->previous_terminate_handler )
+                p_journal->previous_terminate_handler();
+        }
+        std::abort();
+    }
+
+    bool map( const char * p_path )
+    {
+#if defined( _WIN32 )
+        file = CreateFileA( p_path, GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE, 0, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, 0 );
+        if( file == INVALID_HANDLE_VALUE )
+            return false;
+        unsigned long long size = mapping_size;
+        file_mapping = CreateFileMappingA( file, 0, PAGE_READWRITE, static_cast< DWORD >( size >> 32 ), static_cast< DWORD >( size ), 0 );
+        if( ! file_mapping )
+            return false;
+        p_mapping = static_cast< char * >( MapViewOfFile( file_mapping, FILE_MAP_ALL_ACCESS, 0, 0, mapping_size ) );
+        return p_mapping != 0;
+#else
+        fd = open( p_path, O_RDWR | O_CREAT, 0644 );
+        if( fd < 0 )
+            return false;
+        struct stat status;
+        if( fstat( fd, &status ) != 0 )
+            return false;
+        if( static_cast< size_t >( status.st_size ) != mapping_size && ftruncate( fd, static_cast< off_t >( mapping_size ) ) != 0 )
+            return false;
+        void * p_mapped = mmap( 0, mapping_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0 );
+        if( p_mapped == MAP_FAILED )
+            return false;
+        p_mapping = static_cast< char * >( p_mapped );
+        return true;
+#endif
+    }
+
+    void unmap()
+    {
+#if defined( _WIN32 )
+        if( p_mapping )
+            UnmapViewOfFile( p_mapping );
+        if( file_mapping )
+            CloseHandle( file_mapping );
+        if( file != INVALID_HANDLE_VALUE )
+            CloseHandle( file );
+        file_mapping = 0;
+        file = INVALID_HANDLE_VALUE;
+#else
+        if( p_mapping )
+            munmap( p_mapping, mapping_size );
+        if( fd >= 0 )
+            close( fd );
+        fd = -1;
+#endif
+        p_mapping = 0;
+        p_header = 0;
+        p_ring = 0;
+    }
+};
+
+struct RichJournalRecord
+{
+    uint64_t offset;            // In the stream of all records appended to the journal
+    uint64_t time;              // Nanoseconds since the Unix epoch
+    RichExceptionView exception;
+
+    RichJournalRecord() : offset( 0 ), time( 0 ), exception( 0, 0 ) {}
+};
+
+class RichJournalReader
+{
+private:
+    const char * p_ring;
+    uint64_t capacity;
+    uint64_t next_offset;
+    uint64_t end_offset;
+    std::vector< char > encoded;    // The current record's exception, which may be split by the end of the ring
+
+public:
+    // p_data must be the whole contents of a journal file, and must outlive
+    // the reader.  is_valid() is false if it isn't a journal.
+    RichJournalReader( const void * p_data, size_t size )
+        :
+        p_ring( 0 ),
+        capacity( 0 ),
+        next_offset( 0 ),
+        end_offset( 0 )
+    {
+        const char * p_file = static_cast< const char * >( p_data );
+        if( size < detail::journal_header_size )
+            return;
+        const detail::RichJournalHeader * p_header = reinterpret_cast< const detail::RichJournalHeader * >( p_file );
+        if( memcmp( p_header->magic, detail::journal_magic, sizeof( detail::journal_magic ) ) != 0 ||
+                p_header->version != detail::journal_version ||
+                p_header->header_size != detail::journal_header_size ||
+                p_header->capacity == 0 || p_header->capacity % 8 != 0 ||
+                p_header->capacity > size - detail::journal_header_size )
+            return;
+        p_ring = p_file + detail::journal_header_size;
+        capacity = p_header->capacity;
+        end_offset = p_header->n_written.load();
+        next_offset = end_offset > capacity ? end_offset - capacity : 0;
+    }
+
+    bool is_valid() const { return p_ring != 0; }
+
+    // Reads the next complete record, oldest first.  The record's exception
+    // refers to memory owned by the reader, and is only valid until next()
+    // is called again.  Returns false when there are no more records.
+    bool next( RichJournalRecord & r_record )
+    {
+        while( is_valid() && next_offset + detail::journal_record_header_size <= end_offset )
+        {
+            detail::RichJournalRecordHeader record_header;
+            detail::journal_read( p_ring, capacity, next_offset, &record_header, sizeof( record_header ) );
+            uint64_t record_size = detail::journal_record_header_size + detail::journal_padded( record_header.length );
+            if( record_header.offset == next_offset &&
+                    record_header.length <= RichJournal::max_record_size &&
+                    next_offset + record_size <= end_offset )
+            {
+                encoded.resize( record_header.length );
+                if( record_header.length > 0 )
+                    detail::journal_read( p_ring, capacity, next_offset + detail::journal_record_header_size, &encoded[0], encoded.size() );
+                RichExceptionView view( encoded.empty() ? 0 : &encoded[0], encoded.size() );
+                if( detail::journal_checksum( encoded.empty() ? 0 : &encoded[0], encoded.size() ) == record_header.checksum &&
+                        view.is_valid() )
+                {
+                    r_record.offset = next_offset;
+                    r_record.time = record_header.time;
+                    r_record.exception = view;
+                    next_offset += record_size;
+                    return true;
+                }
+            }
+            next_offset += 8;   // Not a complete record, so look for the next one
+        }
+        return false;
+    }
+};
+
+}   // Namespace namespace rich_excep
+
+#endif  // RICH_EXCEPTION_CXX11
+
+#endif  // RICH_EXCEPTION_JOURNAL
@@ -0,0 +1,354 @@
+//----------------------------------------------------------------------------
+// Copyright (c) 2015, Codalogic Ltd (http://www.codalogic.com)
+// All rights reserved.
+//
+// The license for this file is based on the BSD-3-Clause license
+// (http://www.opensource.org/licenses/BSD-3-Clause).
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//
+// - Redistributions of source code must retain the above copyright notice,
+//   this list of conditions and the following disclaimer.
+// - Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+// - Neither the name Codalogic Ltd nor the names of its contributors may be
+//   used to endorse or promote products derived from this software without
+//   specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//----------------------------------------------------------------------------
+
+//----------------------------------------------------------------------------
+// Structured JSON output of RichException chains.
+//
+// RichJsonWriter appends each exception written to it to a reusable buffer
+// as a JSON object of the form:
+//
+//      {"error_uri":"com.codalogic.nexp.db","chain":[
+//          {"depth":0,"error_uri":"com.codalogic.nexp.db","description":"Unable to update","params":{"row":12}},
+//          {"depth":1,"error_uri":"com.codalogic.file.noopen","description":"Unable to open file","params":{"name":"abc.txt"}}]}
+//
+// (without the line breaks), where depth 0 is the most recent exception.
+// Signed, unsigned and finite double parameter values are written as JSON
+// numbers, bools as true or false and everything else as strings.
+//
+// write_line() adds a newline after each object to produce NDJSON, and
+// write_lines() writes a batch of exceptions so that they can be output with
+// a single write(), e.g.:
+//
+//      RichJsonWriter json;
+//      ...
+//      json.clear();
+//      json.write_lines( pending.begin(), pending.end() );
+//      write( fd, json.data(), json.size() );
+//
+// clear() keeps the buffer's memory, so a writer that is re-used does not
+// allocate once its buffer is large enough.  RichExceptionViews can be
+// written as well as RichExceptions.
+//
+// Strings are escaped 16 bytes at a time using SSE2 where available, and 8
+// bytes at a time otherwise.  Bytes of 0x80 and above are copied unchanged,
+// so UTF-8 text is preserved.
+//----------------------------------------------------------------------------
+
+#ifndef RICH_EXCEPTION_JSON
+#define RICH_EXCEPTION_JSON
+
+#include "rich-exception.h"
+
+#include <string>
+#include <cstring>
+
+#if defined( __SSE2__ ) || defined( _M_X64 ) || ( defined( _M_IX86_FP ) && _M_IX86_FP >= 2 )
+    #include <emmintrin.h>
+    #define RICH_EXCEPTION_JSON_SSE2 1
+#endif
+
+namespace rich_excep {
+
+namespace detail {
+
+// The most characters escaping one input character can produce, i.e. \u00XX
+static const size_t max_json_escape_size = 6;
+
+inline char * json_escape_char( char * p_out, unsigned char c )
+{
+    static const char hex_digits[] = "0123456789abcdef";
+    *p_out++ = '\\';
+    switch( c )
+    {
+    case '"': *p_out++ = '"'; break;
+    case '\\': *p_out++ = '\\'; break;
+    case '\b': *p_out++ = 'b'; break;
+    case '\f': *p_out++ = 'f'; break;
+    case '\n': *p_out++ = 'n'; break;
+    case '\r': *p_out++ = 'r'; break;
+    case '\t': *p_out++ = 't'; break;
+    default:
+        *p_out++ = 'u';
+        *p_out++ = '0';
+        *p_out++ = '0';
+        *p_out++ = hex_digits[c >> 4];
+        *p_out++ = hex_digits[c & 0xf];
+    }
+    return p_out;
+}
+
+inline bool json_needs_escape( unsigned char c )
+{
+    return c < 0x20 || c == '"' || c == '\\';
+}
+
+// Writes the escaped form of the length characters at p_in to p_out, which
+// must have room for max_json_escape_size * length characters.  Returns the
+// end of the output.
+inline char * json_escape( char * p_out, const char * p_in, size_t length )
+{
+    const char * p_end = p_in + length;
+#if defined( RICH_EXCEPTION_JSON_SSE2 )
+    const __m128i control_limit = _mm_set1_epi8( 0x1f );
+    const __m128i quote = _mm_set1_epi8( '"' );
+    const __m128i backslash = _mm_set1_epi8( '\\' );
+    while( p_end - p_in >= 16 )
+    {
+        __m128i chars = _mm_loadu_si128( reinterpret_cast< const __m128i * >( p_in ) );
+        __m128i is_control = _mm_cmpeq_epi8( _mm_min_epu8( chars, control_limit ), chars );     // chars <= 0x1f
+        __m128i is_special = _mm_or_si128( is_control,
+                                _mm_or_si128( _mm_cmpeq_epi8( chars, quote ), _mm_cmpeq_epi8( chars, backslash ) ) );
+        int mask = _mm_movemask_epi8( is_special );
+        _mm_storeu_si128( reinterpret_cast< __m128i * >( p_out ), chars );
+        if( mask == 0 )
+        {
+            p_in += 16;
+            p_out += 16;
+            continue;
+        }
+        // Keep the characters before the first one needing escaping
+        int n_plain = 0;
+        while( (mask & (1 << n_plain)) == 0 )
+            ++n_plain;
+        p_out = json_escape_char( p_out + n_plain, static_cast< unsigned char >( p_in[n_plain] ) );
+        p_in += n_plain + 1;
+    }
+#else
+    typedef unsigned long long word;
+    const word ones = ~static_cast< word >( 0 ) / 255;
+    const word high_bits = ones * 0x80;
+    while( p_end - p_in >= 8 )
+    {
+        word chars;
+        memcpy( &chars, p_in, sizeof( chars ) );
+        word quotes = chars ^ (ones * '"');
+        word backslashes = chars ^ (ones * '\\');
+        word is_special = ((chars - ones * 0x20) & ~chars) |     // Bytes < 0x20
+                          ((quotes - ones) & ~quotes) |
+                          ((backslashes - ones) & ~backslashes);
+        if( (is_special & high_bits) == 0 )
+        {
+            memcpy( p_out, p_in, 8 );
+            p_in += 8;
+            p_out += 8;
+            continue;
+        }
+        for( const char * p_block_end = p_in + 8; p_in != p_block_end; ++p_in )
+        {
+            if( json_needs_escape( static_cast< unsigned char >( *p_in ) ) )
+                p_out = json_escape_char( p_out, static_cast< unsigned char >( *p_in ) );
+            else
+                *p_out++ = *p_in;
+        }
+    }
+#endif
+    for( ; p_in != p_end; ++p_in )
+    {
+        if( json_needs_escape( static_cast< unsigned char >( *p_in ) ) )
+            p_out = json_escape_char( p_out, static_cast< unsigned char >( *p_in ) );
+        else
+            *p_out++ = *p_in;
+    }
+    return p_out;
+}
+
+inline bool is_json_number( const char * p_text, size_t length )   // Rejects "inf", "-nan" etc.
+{
+    size_t i_digit = (length > 0 && p_text[0] == '-') ? 1 : 0;
+    return i_digit < length && p_text[i_digit] >= '0' && p_text[i_digit] <= '9';
+}
+
+}   // namespace detail
+
+class RichJsonWriter
+{
+private:
+    char * p_data;
+    size_t n_used;
+    size_t capacity;
+
+    RichJsonWriter( const RichJsonWriter & );               // Not implemented
+    RichJsonWriter & operator = ( const RichJsonWriter & ); // Not implemented
+
+public:
+    explicit RichJsonWriter( size_t initial_capacity = 4096 )
+        : p_data( new char[initial_capacity ? initial_capacity : 1] ), n_used( 0 ), capacity( initial_capacity ? initial_capacity : 1 )
+    {}
+    ~RichJsonWriter()
+    {
+        delete [] p_data;
+    }
+
+    void clear() { n_used = 0; }     // Keeps the buffer's memory for re-use
+
+    bool empty() const { return n_used == 0; }
+    size_t size() const { return n_used; }
+    const char * data() const { return p_data; }
+    std::string str() const { return std::string( p_data, n_used ); }
+
+    // Texception is RichException or RichExceptionView
+    template< typename Texception >
+    RichJsonWriter & write( const Texception & r_exception )
+    {
+        raw( "{\"error_uri\":" );
+        string( r_exception.main_error_uri() );
+        raw( ",\"chain\":[" );
+        size_t depth = 0;
+        for( typename Texception::const_iterator i( r_exception.begin() ), i_end( r_exception.end() );
+                i != i_end;
+                ++i, ++depth )
+        {
+            raw( depth == 0 ? "{\"depth\":" : ",{\"depth\":" );
+            number( depth );
+            raw( ",\"error_uri\":" );
+            string( i->error_uri );
+            raw( ",\"description\":" );
+            string( i->description );
+            raw( ",\"params\":{" );
+            for( size_t i_param = 0; i_param < i->error_params.size(); ++i_param )
+            {
+                const RichExceptionParameter & r_param( i->error_params[i_param] );
+                if( i_param != 0 )
+                    raw( "," );
+                string( r_param.name );
+                raw( ":" );
+                value( r_param.value );
+            }
+            raw( "}}" );
+        }
+        raw( "]}" );
+        return *this;
+    }
+
+    template< typename Texception >
+    RichJsonWriter & write_line( const Texception & r_exception )   // Writes a line of NDJSON
+    {
+        write( r_exception );
+        raw( "\n" );
+        return *this;
+    }
+
+    template< typename Titerator >
+    RichJsonWriter & write_lines( Titerator first, Titerator last )
+    {
+        for( ; first != last; ++first )
+            write_line( *first );
+        return *this;
+    }
+
+private:
+    char * reserve( size_t n_more )     // Returns where to write the next n_more characters
+    {
+        if( capacity - n_used < n_more )
+        {
+            size_t new_capacity = (std::max)( capacity * 2, n_used + n_more );
+            char * p_new_data = new char[new_capacity];
+            memcpy( p_new_data, p_data, n_used );
+            delete [] p_data;
+            p_data = p_new_data;
+            capacity = new_capacity;
+        }
+        return p_data + n_used;
+    }
+
+    void raw( const char * p_text, size_t length )
+    {
+        memcpy( reserve( length ), p_text, length );
+        n_used += length;
+    }
+    void raw( const char * p_text ) { raw( p_text, strlen( p_text ) ); }
+
+    void string( const char * p_text, size_t length )
+    {
+        char * p_out = reserve( length * detail::max_json_escape_size + 2 );
+        char * p_start = p_out;
+        *p_out++ = '"';
+        p_out = detail::json_escape( p_out, p_text, length );
+        *p_out++ = '"';
+        n_used += p_out - p_start;
+    }
+    void string( const char * p_text )
+    {
+        if( ! p_text )
+            p_text = "";
+        string( p_text, strlen( p_text ) );
+    }
+
+    void number( size_t value )
+    {
+        char * p_out = reserve( detail::max_fast_format_size );
+        n_used += detail::format_unsigned( p_out, value );
+    }
+
+    void value( const RichExceptionValue & r_value )
+    {
+        if( ! r_value.has_text() )
+        {
+            const std::string & r_text( r_value.str() );
+            string( r_text.data(), r_text.size() );
+            return;
+        }
+        char scratch[RichExceptionValue::inline_capacity];
+        size_t length;
+        const char * p_text = r_value.text( scratch, length );
+        switch( r_value.native_kind() )
+        {
+        case detail::value_bool:
+            raw( length == 1 && *p_text == '1' ? "true" : "false" );
+            break;
+        case detail::value_signed:
+        case detail::value_unsigned:
+        case detail::value_double:
+            if( detail::is_json_number( p_text, length ) )
+            {
+                raw( p_text, length );
+                break;
+            }
+            // Fall through
+        default:
+            string( p_text, length );
+        }
+    }
+};
+
+template< typename Texception >
+std::string rich_json( const Texception & r_exception )
+{
+    RichJsonWriter writer( 256 );
+    writer.write( r_exception );
+    return writer.str();
+}
+
+}   // Namespace namespace rich_excep
+
+#endif  // RICH_EXCEPTION_JSON
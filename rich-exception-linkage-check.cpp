@@ -2,6 +2,17 @@
 // Just check whether including header in multiple files doesn't cause linkage problems.
 
 #include "rich-exception.h"
+#include "rich-exception-dispatch.h"
+#include "rich-exception-serialize.h"
+#include "rich-exception-wire.h"
+#include "rich-exception-json.h"
+#include "rich-exception-result.h"
+#include "rich-exception-static.h"
+#include "rich-exception-policy.h"
+#include "rich-exception-suppress.h"
+#include "rich-exception-journal.h"
+#include "rich-exception-log-sink.h"
+#include "rich-exception-aggregate.h"
 
 #define ANNOTATE_LITE_PROTOTYPES_ONLY
 #include "annotate-lite.h"
@@ -0,0 +1,422 @@
+//----------------------------------------------------------------------------
+// Copyright (c) 2015, Codalogic Ltd (http://www.codalogic.com)
+// All rights reserved.
+//
+// The license for this file is based on the BSD-3-Clause license
+// (http://www.opensource.org/licenses/BSD-3-Clause).
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//
+// - Redistributions of source code must retain the above copyright notice,
+//   this list of conditions and the following disclaimer.
+// - Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+// - Neither the name Codalogic Ltd nor the names of its contributors may be
+//   used to endorse or promote products derived from this software without
+//   specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//----------------------------------------------------------------------------
+
+//----------------------------------------------------------------------------
+// Asynchronous logging of RichExceptions.
+//
+// RichLogSink moves the cost of rendering and writing exceptions off the
+// threads that throw and catch them.  log() only adds a reference to the
+// exception's chain of nodes (see RichExceptionHandle) to a lock-free
+// queue.  A background thread takes batches of exceptions from the queue,
+// renders them as text (as to_string()) or as NDJSON (see
+// rich-exception-json.h), and writes each batch with a single write.
+// For example:
+//
+//      RichLogSink sink( STDERR_FILENO );
+//      ...
+//      catch( const RichException & e )
+//      {
+//          sink.log( e );
+//          ...
+//      }
+//
+// The queue holds options.capacity exceptions.  What log() does when it is
+// full is chosen by options.backpressure:
+//      backpressure_drop       The exception is dropped
+//      backpressure_block      log() waits until there is space
+//      backpressure_sample     Once the queue is half full, only one in
+//                              options.sample_rate exceptions is queued,
+//                              and the rest are dropped.  A sample_rate
+//                              of 0 or 1 queues every exception.
+// n_dropped() counts the exceptions that have been dropped.
+//
+// flush() waits until everything logged before it was called has been
+// written.  The destructor writes everything that has been logged before
+// stopping the background thread.  (Requires C++11.)
+//----------------------------------------------------------------------------
+
+#ifndef RICH_EXCEPTION_LOG_SINK
+#define RICH_EXCEPTION_LOG_SINK
+
+#include "rich-exception.h"
+#include "rich-exception-json.h"
+
+#if defined( RICH_EXCEPTION_CXX11 )
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <cerrno>
+
+#if defined( _WIN32 )
+    #include <io.h>
+#else
+    #include <unistd.h>
+#endif
+
+namespace rich_excep {
+
+enum RichLogFormat { log_format_text, log_format_json };
+
+enum RichBackpressure { backpressure_drop, backpressure_block, backpressure_sample };
+
+struct RichLogSinkOptions
+{
+    RichLogFormat format;
+    RichBackpressure backpressure;
+    size_t capacity;        // Rounded up to a power of 2
+    size_t sample_rate;     // For backpressure_sample.  0 and 1 keep everything
+    size_t max_batch;       // Most exceptions rendered and written at once
+
+    RichLogSinkOptions()
+        :
+        format( log_format_text ),
+        backpressure( backpressure_drop ),
+        capacity( 4096 ),
+        sample_rate( 10 ),
+        max_batch( 256 )
+    {}
+};
+
+namespace detail {
+
+// A bounded queue of RichExceptionHandles that many threads can push to and
+// one thread pops from, without locks.  Each slot's sequence number says
+// whether it is ready to be pushed to or popped from for a given position.
+class RichHandleQueue
+{
+private:
+    struct Slot
+    {
+        std::atomic< size_t > sequence;
+        RichExceptionHandle handle;
+    };
+
+    std::vector< Slot > slots;
+    const size_t mask;
+    char padding_1[64];
+    std::atomic< size_t > push_position;
+    char padding_2[64];
+    std::atomic< size_t > pop_position;
+
+    static size_t power_of_2( size_t n ) { size_t p = 2; while( p < n ) p *= 2; return p; }
+
+public:
+    explicit RichHandleQueue( size_t capacity_in )
+        :
+        slots( power_of_2( capacity_in ) ),
+        mask( slots.size() - 1 ),
+        push_position( 0 ),
+        pop_position( 0 )
+    {
+        for( size_t i = 0; i < slots.size(); ++i )
+            slots[i].sequence.store( i, std::memory_order_relaxed );
+    }
+
+    size_t capacity() const { return slots.size(); }
+    size_t size() const     // Approximate while being pushed to
+    {
+        size_t n_pushed = push_position.load( std::memory_order_relaxed );
+        size_t n_popped = pop_position.load( std::memory_order_relaxed );
+        return n_pushed > n_popped ? n_pushed - n_popped : 0;
+    }
+    size_t n_pushed() const { return push_position.load( std::memory_order_acquire ); }
+
+    bool try_push( RichExceptionHandle & r_handle )    // Moves r_handle into the queue if there is space
+    {
+        size_t position = push_position.load( std::memory_order_relaxed );
+        for( ;; )
+        {
+            Slot & r_slot( slots[position & mask] );
+            ptrdiff_t difference = static_cast< ptrdiff_t >( r_slot.sequence.load( std::memory_order_acquire ) - position );
+            if( difference == 0 )
+            {
+                if( push_position.compare_exchange_weak( position, position + 1, std::memory_order_relaxed ) )
+                {
+                    r_slot.handle = std::move( r_handle );     // Doesn't throw, so the slot is always released
+                    r_slot.sequence.store( position + 1, std::memory_order_release );
+                    return true;
+                }
+            }
+            else if( difference < 0 )
+                return false;   // Full, as the slot hasn't been popped since the previous lap
+            else
+                position = push_position.load( std::memory_order_relaxed );
+        }
+    }
+
+    bool can_pop() const
+    {
+        size_t position = pop_position.load( std::memory_order_relaxed );
+        return slots[position & mask].sequence.load( std::memory_order_acquire ) == position + 1;
+    }
+
+    bool try_pop( RichExceptionHandle & r_handle )  // Only to be called by one thread
+    {
+        size_t position = pop_position.load( std::memory_order_relaxed );
+        Slot & r_slot( slots[position & mask] );
+        if( r_slot.sequence.load( std::memory_order_acquire ) != position + 1 )
+            return false;
+        r_handle = std::move( r_slot.handle );
+        r_slot.sequence.store( position + slots.size(), std::memory_order_release );
+        pop_position.store( position + 1, std::memory_order_release );
+        return true;
+    }
+    size_t n_popped() const { return pop_position.load( std::memory_order_acquire ); }
+};
+
+}   // namespace detail
+
+class RichLogSink
+{
+public:
+    typedef std::function< void( const char * p_data, size_t length ) > Writer;
+
+private:
+    const RichLogSinkOptions options;
+    Writer writer;
+    detail::RichHandleQueue queue;
+    std::atomic< unsigned long long > n_dropped_count;
+    std::atomic< size_t > n_sample_count;
+    std::atomic< bool > is_consumer_waiting;
+
+    std::mutex mutex;
+    std::condition_variable consumer_wakeup;
+    std::condition_variable written;
+    size_t n_written;       // Positions in the queue that have been written.  Protected by mutex
+    bool is_stopping;       // Protected by mutex
+
+    std::thread consumer;
+
+public:
+    // Writes to the file descriptor fd, which is not closed
+    explicit RichLogSink( int fd, const RichLogSinkOptions & options_in = RichLogSinkOptions() )
+        :
+        options( options_in ),
+        writer( [fd]( const char * p_data, size_t length ) { write_fd( fd, p_data, length ); } ),
+        queue( options_in.capacity )
+    {
+        start();
+    }
+    explicit RichLogSink( const Writer & writer_in, const RichLogSinkOptions & options_in = RichLogSinkOptions() )
+        :
+        options( options_in ),
+        writer( writer_in ),
+        queue( options_in.capacity )
+    {
+        start();
+    }
+    ~RichLogSink()
+    {
+        {
+            std::lock_guard< std::mutex > lock( mutex );
+            is_stopping = true;
+        }
+        consumer_wakeup.notify_one();
+        consumer.join();
+    }
+
+    // Returns false if the exception was dropped.  Logging a
+    // StaticRichException copies its nodes (see RichExceptionHandle), and if
+    // that can't be done because memory is exhausted, it is dropped.
+    bool log( const RichException & r_exception )
+    {
+        if( is_sampled_out() )
+            return dropped();
+        RichExceptionHandle handle;
+        try
+        {
+            handle = RichExceptionHandle( r_exception );
+        }
+        catch( const std::bad_alloc & )
+        {
+            return dropped();
+        }
+        return push( handle );
+    }
+    bool log( const RichExceptionHandle & r_handle )
+    {
+        if( is_sampled_out() )
+            return dropped();
+        RichExceptionHandle handle( r_handle );
+        return push( handle );
+    }
+
+    // Waits until everything logged before flush() was called has been written
+    void flush()
+    {
+        size_t n_to_write = queue.n_pushed();
+        std::unique_lock< std::mutex > lock( mutex );
+        written.wait( lock, [&]() { return n_written >= n_to_write; } );
+    }
+
+    unsigned long long n_dropped() const { return n_dropped_count.load( std::memory_order_relaxed ); }
+
+private:
+    RichLogSink( const RichLogSink & );                 // Not implemented
+    RichLogSink & operator = ( const RichLogSink & );   // Not implemented
+
+    void start()
+    {
+        n_dropped_count.store( 0 );
+        n_sample_count.store( 0 );
+        is_consumer_waiting.store( false );
+        n_written = 0;
+        is_stopping = false;
+        consumer = std::thread( &RichLogSink::consume, this );
+    }
+
+    bool is_sampled_out()
+    {
+        return options.backpressure == backpressure_sample && options.sample_rate > 1 &&
+                queue.size() >= queue.capacity() / 2 &&
+                n_sample_count.fetch_add( 1, std::memory_order_relaxed ) % options.sample_rate != 0;
+    }
+
+    bool push( RichExceptionHandle & r_handle )
+    {
+        while( ! queue.try_push( r_handle ) )
+        {
+            if( options.backpressure != backpressure_block )
+                return dropped();
+            wait_for_space();
+        }
+        wake_consumer();
+        return true;
+    }
+
+    bool dropped()
+    {
+        n_dropped_count.fetch_add( 1, std::memory_order_relaxed );
+        return false;
+    }
+
+    void wake_consumer()
+    {
+        // Pairs with the fence in consume(), so that either the consumer
+        // sees what was pushed before waiting, or this sees that it waits
+        std::atomic_thread_fence( std::memory_order_seq_cst );
+        if( is_consumer_waiting.load( std::memory_order_relaxed ) )
+        {
+            std::lock_guard< std::mutex > lock( mutex );
+            consumer_wakeup.notify_one();
+        }
+    }
+
+    void wait_for_space()
+    {
+        // The consumer notifies written, with mutex locked, after popping
+        // each batch, so a pop can't be missed between the check and the wait
+        wake_consumer();
+        std::unique_lock< std::mutex > lock( mutex );
+        written.wait( lock, [&]() { return queue.size() < queue.capacity(); } );
+    }
+
+    void consume()
+    {
+        RichJsonWriter json;
+        std::string text;
+        std::ostringstream os;
+        RichExceptionHandle handle;
+        for( ;; )
+        {
+            json.clear();
+            text.clear();
+            size_t n_batched = 0;
+            while( n_batched < options.max_batch && queue.try_pop( handle ) )
+            {
+                if( options.format == log_format_json )
+                    json.write_line( handle.get() );
+                else
+                {
+                    os.str( std::string() );
+                    os << handle.get();
+                    text += os.str();
+                }
+                handle = RichExceptionHandle();     // Releases the nodes
+                ++n_batched;
+            }
+            if( n_batched > 0 )
+            {
+                if( options.format == log_format_json )
+                    writer( json.data(), json.size() );
+                else
+                    writer( text.data(), text.size() );
+                std::lock_guard< std::mutex > lock( mutex );
+                n_written = queue.n_popped();
+                written.notify_all();
+                continue;
+            }
+
+            std::unique_lock< std::mutex > lock( mutex );
+            if( is_stopping && ! queue.can_pop() )
+                break;
+            is_consumer_waiting.store( true, std::memory_order_relaxed );
+            std::atomic_thread_fence( std::memory_order_seq_cst );
+            consumer_wakeup.wait_for( lock, std::chrono::milliseconds( 100 ),
+                    [&]() { return is_stopping || queue.can_pop(); } );
+            is_consumer_waiting.store( false, std::memory_order_relaxed );
+        }
+    }
+
+    static void write_fd( int fd, const char * p_data, size_t length )
+    {
+        while( length > 0 )
+        {
+#if defined( _WIN32 )
+            int n_written = _write( fd, p_data, static_cast< unsigned int >( length ) );
+#else
+            ssize_t n_written = ::write( fd, p_data, length );
+#endif
+            if( n_written > 0 )
+            {
+                p_data += n_written;
+                length -= n_written;
+            }
+            else if( ! ( n_written < 0 && errno == EINTR ) )
+                return;
+        }
+    }
+};
+
+}   // Namespace namespace rich_excep
+
+#endif  // RICH_EXCEPTION_CXX11
+
+#endif  // RICH_EXCEPTION_LOG_SINK
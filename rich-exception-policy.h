@@ -0,0 +1,236 @@
+//----------------------------------------------------------------------------
+// Copyright (c) 2015, Codalogic Ltd (http://www.codalogic.com)
+// All rights reserved.
+//
+// The license for this file is based on the BSD-3-Clause license
+// (http://www.opensource.org/licenses/BSD-3-Clause).
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//
+// - Redistributions of source code must retain the above copyright notice,
+//   this list of conditions and the following disclaimer.
+// - Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+// - Neither the name Codalogic Ltd nor the names of its contributors may be
+//   used to endorse or promote products derived from this software without
+//   specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//----------------------------------------------------------------------------
+
+//----------------------------------------------------------------------------
+// BasicRichException< Tpolicy > chooses at compile time how much of each
+// exception is recorded, and how its nodes are stored, so that latency
+// critical code can record only error URIs, while other code records
+// everything.  For example:
+//
+//      typedef BasicRichException< RichCaptureUriOnly > FastException;
+//
+//      throw FastException( "com.codalogic.feed.stale", "Feed is stale" ).add( "age", age );
+//
+// records the error URI but not the description or the "age" parameter.
+//
+// The policy's capture_descriptions and capture_params members say what is
+// recorded, and its node_type is the layout of the nodes it makes.
+// RichCaptureUriOnly's nodes are detail::RichUriNodes, which have no
+// parameter storage, so they are about a quarter of the size of the
+// detail::RichParamsNodes of the other policies.  Descriptions and
+// parameters that aren't captured are discarded at compile time, so
+// neither formatting code nor the description text need be in the binary.
+// The arguments of add() are still evaluated.
+//
+// BasicRichException< RichCaptureAll > behaves exactly like RichException.
+//
+// A BasicRichException is a RichException, so it is caught by
+// "catch( RichException & )", can be chained to and from any other
+// RichException, and works with everything else that works with
+// RichExceptions.  Nodes without parameter storage have empty error_params.
+// Should parameters be added to one via RichException::add(), it is
+// replaced by a copy with parameter storage.
+//----------------------------------------------------------------------------
+
+#ifndef RICH_EXCEPTION_POLICY
+#define RICH_EXCEPTION_POLICY
+
+#include "rich-exception.h"
+
+namespace rich_excep {
+
+struct RichCaptureAll
+{
+    enum { capture_descriptions = true, capture_params = true };
+    typedef detail::RichParamsNode node_type;
+};
+
+struct RichCaptureParams     // Error URIs and parameters, but not descriptions
+{
+    enum { capture_descriptions = false, capture_params = true };
+    typedef detail::RichParamsNode node_type;
+};
+
+struct RichCaptureUriOnly
+{
+    enum { capture_descriptions = false, capture_params = false };
+    typedef detail::RichUriNode node_type;
+};
+
+template< typename Tpolicy = RichCaptureAll >
+class BasicRichException : public RichException
+{
+public:
+    typedef Tpolicy policy_type;
+
+private:
+    typedef typename Tpolicy::node_type node_type;
+    typedef detail::RichBoolType< Tpolicy::capture_params != 0 > params_tag;
+
+    class NodeFactory : public detail::RichNodeFactory
+    {
+    private:
+        const char * const error_uri;
+        const char * const description;
+        const RichExceptionParams * const p_error_params;   // 0 if there are none
+        RichExceptionParams * const p_movable_params;       // 0 unless the parameters can be moved from
+
+    public:
+        NodeFactory(
+                const char * const error_uri_in,
+                const char * const description_in,
+                const RichExceptionParams * p_error_params_in = 0,
+                RichExceptionParams * p_movable_params_in = 0 )
+            :
+            error_uri( error_uri_in ),
+            description( Tpolicy::capture_descriptions ? description_in : "" ),
+            p_error_params( p_error_params_in ),
+            p_movable_params( p_movable_params_in )
+        {}
+
+        virtual RichExceptionNode * make() const { return make( params_tag() ); }
+
+    private:
+        RichExceptionNode * make( detail::RichBoolType< false > ) const
+        {
+            return new( detail::rich_allocation ) node_type( error_uri, description );
+        }
+        RichExceptionNode * make( detail::RichBoolType< true > ) const
+        {
+#if defined( RICH_EXCEPTION_CXX11 )
+            if( p_movable_params )
+                return new( detail::rich_allocation ) node_type( error_uri, std::move( *p_movable_params ), description );
+#endif
+            if( p_error_params )
+                return new( detail::rich_allocation ) node_type( error_uri, *p_error_params, description );
+            return new( detail::rich_allocation ) node_type( error_uri, description );
+        }
+    };
+
+public:
+    BasicRichException(
+            const char * const error_uri_in,
+            const char * const description_in,
+            RichException * p_prev_rich_exception = 0 )
+        :
+        RichException( NodeFactory( error_uri_in, description_in ), p_prev_rich_exception )
+    {}
+    BasicRichException(
+            const char * const error_uri_in,
+            const RichExceptionParams & error_params_in,
+            const char * const description_in,
+            RichException * p_prev_rich_exception = 0 )
+        :
+        RichException( NodeFactory( error_uri_in, description_in, &error_params_in ), p_prev_rich_exception )
+    {}
+    BasicRichException(
+            const char * const error_uri_in,
+            const char * const description_in,
+            const RichException & r_prev_rich_exception )
+        :
+        RichException( NodeFactory( error_uri_in, description_in ), r_prev_rich_exception )
+    {}
+    BasicRichException(
+            const char * const error_uri_in,
+            const RichExceptionParams & error_params_in,
+            const char * const description_in,
+            const RichException & r_prev_rich_exception )
+        :
+        RichException( NodeFactory( error_uri_in, description_in, &error_params_in ), r_prev_rich_exception )
+    {}
+#if defined( RICH_EXCEPTION_CXX11 )
+    BasicRichException(
+            const char * const error_uri_in,
+            RichExceptionParams && error_params_in,
+            const char * const description_in,
+            const RichException & r_prev_rich_exception )
+        :
+        RichException( NodeFactory( error_uri_in, description_in, 0, &error_params_in ), r_prev_rich_exception )
+    {}
+    BasicRichException(
+            const char * const error_uri_in,
+            const char * const description_in,
+            RichException && r_prev_rich_exception )
+        :
+        RichException( NodeFactory( error_uri_in, description_in ), std::move( r_prev_rich_exception ) )
+    {}
+    BasicRichException(
+            const char * const error_uri_in,
+            RichExceptionParams && error_params_in,
+            const char * const description_in,
+            RichException * p_prev_rich_exception = 0 )
+        :
+        RichException( NodeFactory( error_uri_in, description_in, 0, &error_params_in ), p_prev_rich_exception )
+    {}
+    BasicRichException(
+            const char * const error_uri_in,
+            RichExceptionParams && error_params_in,
+            const char * const description_in,
+            RichException && r_prev_rich_exception )
+        :
+        RichException( NodeFactory( error_uri_in, description_in, 0, &error_params_in ), std::move( r_prev_rich_exception ) )
+    {}
+#endif
+
+    // Hides RichException::add() so that parameters can be discarded
+    template< typename T >
+    BasicRichException & add(
+            const char * const name_in,
+            const T & value_in ) RICH_EXCEPTION_LVALUE_QUALIFIER
+    {
+        add( name_in, value_in, params_tag() );
+        return *this;
+    }
+#if defined( RICH_EXCEPTION_CXX11 )
+    template< typename T >
+    BasicRichException && add(
+            const char * const name_in,
+            const T & value_in ) &&
+    {
+        return std::move( add( name_in, value_in ) );
+    }
+#endif
+
+private:
+    template< typename T >
+    void add( const char * const name_in, const T & value_in, detail::RichBoolType< true > )
+    {
+        RichException::add( name_in, value_in );
+    }
+    template< typename T >
+    void add( const char * const, const T &, detail::RichBoolType< false > ) {}
+};
+
+}   // Namespace namespace rich_excep
+
+#endif  // RICH_EXCEPTION_POLICY
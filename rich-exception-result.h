@@ -0,0 +1,414 @@
+//----------------------------------------------------------------------------
+// Copyright (c) 2015, Codalogic Ltd (http://www.codalogic.com)
+// All rights reserved.
+//
+// The license for this file is based on the BSD-3-Clause license
+// (http://www.opensource.org/licenses/BSD-3-Clause).
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//
+// - Redistributions of source code must retain the above copyright notice,
+//   this list of conditions and the following disclaimer.
+// - Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+// - Neither the name Codalogic Ltd nor the names of its contributors may be
+//   used to endorse or promote products derived from this software without
+//   specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//----------------------------------------------------------------------------
+
+//----------------------------------------------------------------------------
+// Non-throwing error reporting with the same diagnostics as RichException.
+//
+// A RichError holds a chain of RichExceptionNodes, exactly as RichException
+// does, but is returned rather than thrown.  A RichResult< T > holds either
+// a T or a RichError.  For example:
+//
+//      RichResult< int > parse_field( const char * p_text )
+//      {
+//          if( ! isdigit( *p_text ) )
+//              return RichError( "com.codalogic.ingest.field.bad", "Field is not a number" ).add( "text", p_text );
+//          return atoi( p_text );
+//      }
+//
+//      RichResult< Record > parse_record( const char * p_line )
+//      {
+//          RichResult< int > id( parse_field( p_line ) );
+//          if( ! id.ok() )
+//              return RichError( "com.codalogic.ingest.record.bad", "Bad record", &id.error() );
+//          ...
+//      }
+//
+// As with RichException, chaining takes the nodes of the inner error without
+// copying them, and copying a RichError only increments a reference count.
+//
+// At API boundaries a RichError converts to a RichException (and back) by
+// sharing its nodes, so nothing is lost.  throw_exception() throws the
+// equivalent RichException, as does RichResult< T >::value() if there is no
+// value.  If assigning to a RichResult< T > throws because T's constructor
+// threw, the result holds neither a T nor a RichError until it is next
+// assigned to; valueless_by_exception() then returns true.
+//----------------------------------------------------------------------------
+
+#ifndef RICH_EXCEPTION_RESULT
+#define RICH_EXCEPTION_RESULT
+
+#include "rich-exception.h"
+
+#include <new>
+#include <cassert>
+
+namespace rich_excep {
+
+class RichError
+{
+private:
+    RichException exception;    // Never thrown itself; shares its nodes with exceptions made from it
+
+public:
+    typedef RichException::const_iterator const_iterator;
+    typedef RichException::const_reverse_iterator const_reverse_iterator;
+    typedef RichException::const_reference const_reference;
+
+    RichError(
+            const char * const error_uri_in,
+            const char * const description_in,
+            RichError * p_cause = 0 )
+        :
+        exception( error_uri_in, description_in, p_cause ? &p_cause->exception : 0 )
+    {}
+    RichError(
+            const char * const error_uri_in,
+            const RichExceptionParams & error_params_in,
+            const char * const description_in,
+            RichError * p_cause = 0 )
+        :
+        exception( error_uri_in, error_params_in, description_in, p_cause ? &p_cause->exception : 0 )
+    {}
+    explicit RichError( const RichException & r_exception ) : exception( r_exception ) {}
+#if defined( RICH_EXCEPTION_CXX11 )
+    RichError(
+            const char * const error_uri_in,
+            const char * const description_in,
+            RichError && r_cause )
+        :
+        exception( error_uri_in, description_in, std::move( r_cause.exception ) )
+    {}
+    RichError(
+            const char * const error_uri_in,
+            RichExceptionParams && error_params_in,
+            const char * const description_in,
+            RichError * p_cause = 0 )
+        :
+        exception( error_uri_in, std::move( error_params_in ), description_in, p_cause ? &p_cause->exception : 0 )
+    {}
+    RichError(
+            const char * const error_uri_in,
+            RichExceptionParams && error_params_in,
+            const char * const description_in,
+            RichError && r_cause )
+        :
+        exception( error_uri_in, std::move( error_params_in ), description_in, std::move( r_cause.exception ) )
+    {}
+    explicit RichError( RichException && r_exception ) : exception( std::move( r_exception ) ) {}
+#endif
+
+    template< typename T >
+    RichError & add(
+            const char * const name_in,
+            const T & value_in ) RICH_EXCEPTION_LVALUE_QUALIFIER
+    {
+        exception.add( name_in, value_in );
+        return *this;
+    }
+#if defined( RICH_EXCEPTION_CXX11 )
+    template< typename T >
+    RichError && add(
+            const char * const name_in,
+            const T & value_in ) &&
+    {
+        return std::move( add( name_in, value_in ) );
+    }
+#endif
+
+    const RichException & to_exception() const { return exception; }
+    void throw_exception() const { throw exception; }
+
+    const char * what() const { return exception.what(); }
+    const char * main_error_uri() const { return exception.main_error_uri(); }
+    RichUriId main_error_uri_id() const { return exception.main_error_uri_id(); }
+    bool is( RichUriId error_uri_id_in ) const { return exception.is( error_uri_id_in ); }
+    const_iterator find( RichUriId error_uri_id_in ) const { return exception.find( error_uri_id_in ); }
+    bool has( RichUriId error_uri_id_in ) const { return exception.has( error_uri_id_in ); }
+
+    bool empty() const { return exception.empty(); }
+    size_t size() const { return exception.size(); }
+
+    const_reference front() const { return exception.front(); }
+    const_iterator begin() const { return exception.begin(); }
+    const_iterator end() const { return exception.end(); }
+    const_reverse_iterator rbegin() const { return exception.rbegin(); }
+    const_reverse_iterator rend() const { return exception.rend(); }
+
+    std::string to_string() const { return exception.to_string(); }
+
+    friend std::ostream & operator << ( std::ostream & os, const RichError & r_error )
+    {
+        return os << r_error.exception;
+    }
+};
+
+namespace detail {
+
+template< size_t size, size_t alignment >
+struct RichResultStorage
+{
+#if defined( RICH_EXCEPTION_CXX11 )
+    alignas( alignment ) unsigned char bytes[size];
+#else
+    union
+    {
+        unsigned char bytes[size];
+        long double long_double_alignment;
+        long long long_long_alignment;
+        void * pointer_alignment;
+    };
+#endif
+    void * address() { return bytes; }
+    const void * address() const { return bytes; }
+};
+
+#if defined( RICH_EXCEPTION_CXX11 )
+    #define RICH_EXCEPTION_ALIGNOF( T ) alignof( T )
+#elif defined( _MSC_VER )
+    #define RICH_EXCEPTION_ALIGNOF( T ) __alignof( T )
+#else
+    #define RICH_EXCEPTION_ALIGNOF( T ) __alignof__( T )
+#endif
+
+}   // namespace detail
+
+template< typename T >
+class RichResult
+{
+    // Holds either a T or a RichError, constructed in place.  If assigning a
+    // value throws part way through, the result holds neither (see
+    // valueless_by_exception()), so it is never destroyed twice.
+private:
+    enum
+    {
+        storage_size = sizeof( T ) > sizeof( RichError ) ? sizeof( T ) : sizeof( RichError ),
+        storage_alignment = RICH_EXCEPTION_ALIGNOF( T ) > RICH_EXCEPTION_ALIGNOF( RichError ) ?
+                                RICH_EXCEPTION_ALIGNOF( T ) : RICH_EXCEPTION_ALIGNOF( RichError )
+    };
+    enum Holding { holds_nothing, holds_value, holds_error };
+
+    detail::RichResultStorage< storage_size, storage_alignment > storage;
+    Holding holding;
+
+    T * p_value() { return static_cast< T * >( storage.address() ); }
+    const T * p_value() const { return static_cast< const T * >( storage.address() ); }
+    RichError * p_error() { return static_cast< RichError * >( storage.address() ); }
+    const RichError * p_error() const { return static_cast< const RichError * >( storage.address() ); }
+
+public:
+    typedef T value_type;
+
+    RichResult( const T & value_in ) : holding( holds_nothing )
+    {
+        new( storage.address() ) T( value_in );
+        holding = holds_value;
+    }
+    RichResult( const RichError & r_error_in ) : holding( holds_error ) { new( storage.address() ) RichError( r_error_in ); }
+    RichResult( const RichResult & r_rhs ) : holding( holds_nothing )
+    {
+        construct_from( r_rhs );
+    }
+#if defined( RICH_EXCEPTION_CXX11 )
+    RichResult( T && value_in ) : holding( holds_nothing )
+    {
+        new( storage.address() ) T( std::move( value_in ) );
+        holding = holds_value;
+    }
+    RichResult( RichError && r_error_in ) : holding( holds_error ) { new( storage.address() ) RichError( std::move( r_error_in ) ); }
+    RichResult( RichResult && r_rhs ) noexcept( std::is_nothrow_move_constructible< T >::value )
+        :
+        holding( holds_nothing )
+    {
+        construct_from( std::move( r_rhs ) );
+    }
+#endif
+    RichResult & operator = ( const RichResult & r_rhs )
+    {
+        if( this != &r_rhs )
+        {
+            if( holding == holds_value && r_rhs.holding == holds_value )
+                *p_value() = *r_rhs.p_value();  // T's own assignment decides what happens if this throws
+            else
+            {
+                destroy();
+                construct_from( r_rhs );
+            }
+        }
+        return *this;
+    }
+#if defined( RICH_EXCEPTION_CXX11 )
+    RichResult & operator = ( RichResult && r_rhs )
+            noexcept( std::is_nothrow_move_constructible< T >::value && std::is_nothrow_move_assignable< T >::value )
+    {
+        if( this != &r_rhs )
+        {
+            if( holding == holds_value && r_rhs.holding == holds_value )
+                *p_value() = std::move( *r_rhs.p_value() );
+            else
+            {
+                destroy();
+                construct_from( std::move( r_rhs ) );
+            }
+        }
+        return *this;
+    }
+#endif
+    ~RichResult()
+    {
+        destroy();
+    }
+
+    bool ok() const { return holding == holds_value; }
+    bool has_error() const { return holding == holds_error; }
+    bool valueless_by_exception() const { return holding == holds_nothing; }
+
+    // Throws the equivalent RichException if there is no value
+    T & value()
+    {
+        if( holding != holds_value )
+            throw_no_value();
+        return *p_value();
+    }
+    const T & value() const
+    {
+        if( holding != holds_value )
+            throw_no_value();
+        return *p_value();
+    }
+    T value_or( const T & default_in ) const { return holding == holds_value ? *p_value() : default_in; }
+
+    RichError & error() { assert( holding == holds_error ); return *p_error(); }
+    const RichError & error() const { assert( holding == holds_error ); return *p_error(); }
+
+private:
+    void destroy()
+    {
+        if( holding == holds_value )
+            p_value()->~T();
+        else if( holding == holds_error )
+            p_error()->~RichError();
+        holding = holds_nothing;
+    }
+    // These require this to hold nothing, and only record what is held once
+    // its constructor has succeeded
+    void construct_from( const RichResult & r_rhs )
+    {
+        if( r_rhs.holding == holds_value )
+            new( storage.address() ) T( *r_rhs.p_value() );
+        else if( r_rhs.holding == holds_error )
+            new( storage.address() ) RichError( *r_rhs.p_error() );     // Copying a RichError does not throw
+        holding = r_rhs.holding;
+    }
+#if defined( RICH_EXCEPTION_CXX11 )
+    void construct_from( RichResult && r_rhs )
+    {
+        if( r_rhs.holding == holds_value )
+            new( storage.address() ) T( std::move( *r_rhs.p_value() ) );
+        else if( r_rhs.holding == holds_error )
+            new( storage.address() ) RichError( std::move( *r_rhs.p_error() ) );
+        holding = r_rhs.holding;
+    }
+#endif
+    void throw_no_value() const
+    {
+        if( holding == holds_error )
+            p_error()->throw_exception();
+        throw RichException( "com.codalogic.rich_excep.result.valueless",
+                "The result lost its value when an assignment threw" );
+    }
+};
+
+template<>
+class RichResult< void >
+{
+    // Success, or a RichError.  Default constructed results are successful.
+private:
+    detail::RichResultStorage< sizeof( RichError ), RICH_EXCEPTION_ALIGNOF( RichError ) > storage;
+    bool is_ok;
+
+    RichError * p_error() { return static_cast< RichError * >( storage.address() ); }
+    const RichError * p_error() const { return static_cast< const RichError * >( storage.address() ); }
+
+public:
+    typedef void value_type;
+
+    RichResult() : is_ok( true ) {}
+    RichResult( const RichError & r_error_in ) : is_ok( false ) { new( storage.address() ) RichError( r_error_in ); }
+    RichResult( const RichResult & r_rhs ) : is_ok( r_rhs.is_ok )
+    {
+        if( ! is_ok )
+            new( storage.address() ) RichError( *r_rhs.p_error() );
+    }
+#if defined( RICH_EXCEPTION_CXX11 )
+    RichResult( RichError && r_error_in ) : is_ok( false ) { new( storage.address() ) RichError( std::move( r_error_in ) ); }
+#endif
+    RichResult & operator = ( const RichResult & r_rhs )
+    {
+        if( this != &r_rhs )
+        {
+            destroy();
+            is_ok = r_rhs.is_ok;
+            if( ! is_ok )
+                new( storage.address() ) RichError( *r_rhs.p_error() );    // Copying a RichError does not throw
+        }
+        return *this;
+    }
+    ~RichResult()
+    {
+        destroy();
+    }
+
+    bool ok() const { return is_ok; }
+    bool has_error() const { return ! is_ok; }
+
+    void value() const     // Throws the equivalent RichException if there is an error
+    {
+        if( ! is_ok )
+            p_error()->throw_exception();
+    }
+
+    RichError & error() { assert( ! is_ok ); return *p_error(); }
+    const RichError & error() const { assert( ! is_ok ); return *p_error(); }
+
+private:
+    void destroy()
+    {
+        if( ! is_ok )
+            p_error()->~RichError();
+        is_ok = true;
+    }
+};
+
+}   // Namespace namespace rich_excep
+
+#endif  // RICH_EXCEPTION_RESULT
@@ -0,0 +1,327 @@
+//----------------------------------------------------------------------------
+// Copyright (c) 2015, Codalogic Ltd (http://www.codalogic.com)
+// All rights reserved.
+//
+// The license for this file is based on the BSD-3-Clause license
+// (http://www.opensource.org/licenses/BSD-3-Clause).
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//
+// - Redistributions of source code must retain the above copyright notice,
+//   this list of conditions and the following disclaimer.
+// - Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+// - Neither the name Codalogic Ltd nor the names of its contributors may be
+//   used to endorse or promote products derived from this software without
+//   specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//----------------------------------------------------------------------------
+
+//----------------------------------------------------------------------------
+// Allocation free rendering of RichExceptions.
+//
+// rich_serialize() renders a RichException or StaticRichException (or one
+// of its parts) into a caller supplied buffer, producing the same text as
+// to_string().  Like snprintf(), it always nul terminates the buffer (if
+// buffer_size is not 0) and returns the length the full text would have
+// had, so the text has been truncated if the returned value is >=
+// buffer_size.  Truncated text ends in "...".  For example:
+//
+//      char buffer[1024];
+//      rich_serialize( e, buffer, sizeof( buffer ) );
+//
+// rich_serialize_fd() writes the text of a RichException straight to a file
+// descriptor, such as STDERR_FILENO, via a small stack buffer.  It returns
+// false if a write fails.
+//
+// Neither allocates memory, takes locks or uses streams, so they can be used
+// from std::terminate handlers, signal handlers and hot logging paths.
+// Values of user types captured via RichLazyCapture need operator << to be
+// formatted, so they are rendered as "<?>".  (Before C++17, double values
+// are formatted using snprintf(), which most, but not all, C libraries
+// implement in an async-signal-safe way.)
+//----------------------------------------------------------------------------
+
+#ifndef RICH_EXCEPTION_SERIALIZE
+#define RICH_EXCEPTION_SERIALIZE
+
+#include "rich-exception.h"
+
+#include <cstring>
+#include <cerrno>
+
+#if defined( _WIN32 )
+    #include <io.h>
+#else
+    #include <unistd.h>
+#endif
+
+namespace rich_excep {
+
+namespace detail {
+
+class RichBufferSink
+{
+private:
+    char * p_buffer;
+    size_t buffer_size;
+    size_t n_stored;
+    size_t n_total;
+
+public:
+    RichBufferSink( char * p_buffer_in, size_t buffer_size_in )
+        : p_buffer( p_buffer_in ), buffer_size( buffer_size_in ), n_stored( 0 ), n_total( 0 )
+    {}
+
+    void write( const char * p_text, size_t length )
+    {
+        n_total += length;
+        if( buffer_size == 0 )
+            return;
+        size_t n_to_store = (std::min)( length, buffer_size - 1 - n_stored );
+        memcpy( p_buffer + n_stored, p_text, n_to_store );
+        n_stored += n_to_store;
+    }
+
+    size_t finish()
+    {
+        if( buffer_size == 0 )
+            return n_total;
+        p_buffer[n_stored] = '\0';
+        if( n_total > n_stored && n_stored >= 3 )
+            memcpy( p_buffer + n_stored - 3, "...", 3 );
+        return n_total;
+    }
+};
+
+class RichFdSink
+{
+private:
+    int fd;
+    bool is_ok;
+    size_t n_buffered;
+    char buffer[256];
+
+public:
+    explicit RichFdSink( int fd_in ) : fd( fd_in ), is_ok( true ), n_buffered( 0 ) {}
+
+    void write( const char * p_text, size_t length )
+    {
+        while( length > 0 )
+        {
+            if( n_buffered == sizeof( buffer ) )
+                flush();
+            size_t n_to_buffer = (std::min)( length, sizeof( buffer ) - n_buffered );
+            memcpy( buffer + n_buffered, p_text, n_to_buffer );
+            n_buffered += n_to_buffer;
+            p_text += n_to_buffer;
+            length -= n_to_buffer;
+        }
+    }
+
+    bool finish()
+    {
+        flush();
+        return is_ok;
+    }
+
+private:
+    void flush()
+    {
+        const char * p_next = buffer;
+        while( is_ok && p_next < buffer + n_buffered )
+        {
+#if defined( _WIN32 )
+            int n_written = _write( fd, p_next, static_cast< unsigned int >( buffer + n_buffered - p_next ) );
+#else
+            ssize_t n_written = ::write( fd, p_next, buffer + n_buffered - p_next );
+#endif
+            if( n_written > 0 )
+                p_next += n_written;
+            else if( n_written < 0 && errno == EINTR )
+                continue;
+            else
+                is_ok = false;
+        }
+        n_buffered = 0;
+    }
+};
+
+template< typename Tsink >
+class RichSerializer
+{
+private:
+    Tsink & r_sink;
+
+public:
+    explicit RichSerializer( Tsink & r_sink_in ) : r_sink( r_sink_in ) {}
+
+    void write( const RichException & r_exception )
+    {
+        write_chain( r_exception.begin(), r_exception.end() );
+    }
+    void write_chain( RichException::const_iterator i, RichException::const_iterator i_end )
+    {
+        for( size_t indent = 0; i != i_end; ++i, indent += 2 )
+        {
+            write_indent( indent );
+            write( *i );
+            r_sink.write( "\n", 1 );
+#if defined( RICH_EXCEPTION_STACK )
+            write( i->stack_trace, indent + 4 );
+#endif
+            if( i->omitted_count() > 0 )
+            {
+                indent += 2;
+                write_indent( indent );
+                r_sink.write( "... ", 4 );
+                write( i->omitted_count() );
+                r_sink.write( " more\n", 6 );
+            }
+        }
+    }
+    void write( const RichExceptionNode & r_node )
+    {
+        write( r_node.error_uri );
+        if( ! r_node.error_params.empty() )
+        {
+            r_sink.write( " (", 2 );
+            write( r_node.error_params );
+            r_sink.write( ")", 1 );
+        }
+        r_sink.write( ": ", 2 );
+        write( r_node.description );
+        if( r_node.repeat_count() > 1 )
+        {
+            r_sink.write( " (x", 3 );
+            write( r_node.repeat_count() );
+            r_sink.write( ")", 1 );
+        }
+    }
+    void write( size_t count )
+    {
+        char digits[20];
+        r_sink.write( digits, detail::format_unsigned( digits, count ) );
+    }
+    void write( const RichExceptionParams & r_params )
+    {
+        for( size_t i = 0; i < r_params.size(); ++i )
+        {
+            if( i != 0 )
+                r_sink.write( ", ", 2 );
+            write( r_params[i] );
+        }
+    }
+    void write( const RichExceptionParameter & r_param )
+    {
+        write( r_param.name );
+        r_sink.write( ": ", 2 );
+        write( r_param.value );
+    }
+    void write( const RichExceptionValue & r_value )
+    {
+        if( ! r_value.has_text() )
+        {
+            r_sink.write( "<?>", 3 );
+            return;
+        }
+        char scratch[RichExceptionValue::inline_capacity];
+        size_t length;
+        const char * p_text = r_value.text( scratch, length );
+        r_sink.write( p_text, length );
+    }
+    void write( const char * p_text )
+    {
+        if( p_text )
+            r_sink.write( p_text, strlen( p_text ) );
+    }
+    void write_indent( size_t indent )
+    {
+        detail::write_indent( r_sink, indent );
+    }
+#if defined( RICH_EXCEPTION_STACK )
+    // Looking up symbols isn't async-signal-safe, so only the raw addresses
+    // are written
+    void write( const RichStackTrace & r_stack_trace, size_t indent )
+    {
+        static const char hex_digits[] = "0123456789abcdef";
+        for( size_t i_frame = 0; i_frame < r_stack_trace.size(); ++i_frame )
+        {
+            write_indent( indent );
+            char address[2 * sizeof( void * ) + 1];
+            char * p_digit = address + sizeof( address ) - 1;
+            *p_digit = '\n';
+            uintptr_t value = reinterpret_cast< uintptr_t >( r_stack_trace[i_frame] );
+            do
+            {
+                *--p_digit = hex_digits[value & 0xf];
+                value >>= 4;
+            } while( value != 0 );
+            r_sink.write( "at 0x", 5 );
+            r_sink.write( p_digit, address + sizeof( address ) - p_digit );
+        }
+    }
+#endif
+};
+
+template< typename T >
+size_t serialize_to_buffer( const T & r_item, char * p_buffer, size_t buffer_size )
+{
+    RichBufferSink sink( p_buffer, buffer_size );
+    RichSerializer< RichBufferSink >( sink ).write( r_item );
+    return sink.finish();
+}
+
+template< typename T >
+bool serialize_to_fd( const T & r_item, int fd )
+{
+    RichFdSink sink( fd );
+    RichSerializer< RichFdSink >( sink ).write( r_item );
+    return sink.finish();
+}
+
+}   // namespace detail
+
+inline size_t rich_serialize( const RichException & r_exception, char * p_buffer, size_t buffer_size )
+{
+    return detail::serialize_to_buffer( r_exception, p_buffer, buffer_size );
+}
+inline size_t rich_serialize( const RichExceptionNode & r_node, char * p_buffer, size_t buffer_size )
+{
+    return detail::serialize_to_buffer( r_node, p_buffer, buffer_size );
+}
+inline size_t rich_serialize( const RichExceptionParams & r_params, char * p_buffer, size_t buffer_size )
+{
+    return detail::serialize_to_buffer( r_params, p_buffer, buffer_size );
+}
+inline size_t rich_serialize( const RichExceptionParameter & r_param, char * p_buffer, size_t buffer_size )
+{
+    return detail::serialize_to_buffer( r_param, p_buffer, buffer_size );
+}
+
+inline bool rich_serialize_fd( const RichException & r_exception, int fd )
+{
+    return detail::serialize_to_fd( r_exception, fd );
+}
+inline bool rich_serialize_fd( const RichExceptionNode & r_node, int fd )
+{
+    return detail::serialize_to_fd( r_node, fd );
+}
+
+}   // Namespace namespace rich_excep
+
+#endif  // RICH_EXCEPTION_SERIALIZE
@@ -0,0 +1,323 @@
+//----------------------------------------------------------------------------
+// Copyright (c) 2015, Codalogic Ltd (http://www.codalogic.com)
+// All rights reserved.
+//
+// The license for this file is based on the BSD-3-Clause license
+// (http://www.opensource.org/licenses/BSD-3-Clause).
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//
+// - Redistributions of source code must retain the above copyright notice,
+//   this list of conditions and the following disclaimer.
+// - Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+// - Neither the name Codalogic Ltd nor the names of its contributors may be
+//   used to endorse or promote products derived from this software without
+//   specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//----------------------------------------------------------------------------
+
+//----------------------------------------------------------------------------
+// StaticRichException records a chain of exceptions without allocating any
+// memory, so that rich diagnostics can be thrown even when memory is
+// exhausted.  For example:
+//
+//      catch( std::bad_alloc & )
+//      {
+//          throw StaticRichException<>( "com.codalogic.cache.full", "Unable to grow cache" )
+//                  .add( "entries", n_entries );
+//      }
+//
+// Up to max_nodes nodes, each with up to max_params parameters, are stored
+// within the object itself, as is up to max_bytes of text that is too long
+// to be stored within a parameter's value.  The constructors and add() never
+// throw.  Instead, anything that doesn't fit is left out (or, for text,
+// shortened) and is_truncated() reports that this happened.  When wrapping
+// a cause with more nodes than fit, its root cause and as many of its most
+// recent nodes as fit are kept, and elided_count() says how many exceptions
+// were left out between them.  (With RICH_EXCEPTION_COMPACT, they are also
+// shown as "... N more" when rendered.)
+//
+// Parameter values must be those that can be recorded without allocating:
+// text, built-in types and types for which RichLazyCapture is enabled.
+//
+// A StaticRichException is a RichException, so it can be caught, searched,
+// rendered, serialized and dispatched in the same way, and it can wrap a
+// RichException or another StaticRichException as its cause.  Copies of a
+// StaticRichException are independent of the original, so copying costs the
+// size of the object.  Anything else that would share its nodes, such as a
+// RichException copied or chained from it, or a RichExceptionHandle made from
+// it, gets an allocated copy of them instead, so where memory may be
+// exhausted, catch it by reference.
+//----------------------------------------------------------------------------
+
+#ifndef RICH_EXCEPTION_STATIC
+#define RICH_EXCEPTION_STATIC
+
+#include "rich-exception.h"
+
+#include <new>
+#include <cassert>
+
+namespace rich_excep {
+
+template< size_t max_nodes = 4, size_t max_params = RichExceptionParams::inline_capacity, size_t max_bytes = 256 >
+class StaticRichException : public RichException
+{
+private:
+    // More parameters than this would need an allocated array
+    typedef char max_params_must_be_stored_inline[max_params <= RichExceptionParams::inline_capacity ? 1 : -1];
+    typedef char max_nodes_must_not_be_0[max_nodes > 0 ? 1 : -1];
+
+    union
+    {
+        char bytes[max_nodes * sizeof( detail::RichParamsNode )];
+        void * p_align;
+        double d_align;
+        long long ll_align;
+    } node_storage;
+    size_t n_nodes;
+    char text[max_bytes + 1];   // For text too long to store in a RichExceptionValue, recorded as literals
+    size_t n_text_used;
+    bool was_truncated;
+    size_t n_elided;
+
+    detail::RichParamsNode * node( size_t i ) { return reinterpret_cast< detail::RichParamsNode * >( node_storage.bytes ) + i; }
+    const detail::RichParamsNode * node( size_t i ) const { return reinterpret_cast< const detail::RichParamsNode * >( node_storage.bytes ) + i; }
+
+public:
+    StaticRichException(
+            const char * const error_uri_in,
+            const char * const description_in ) RICH_EXCEPTION_NOEXCEPT
+    {
+        reset();
+        push_back( error_uri_in, description_in );
+    }
+    StaticRichException(
+            const char * const error_uri_in,
+            const char * const description_in,
+            const RichException & r_cause_in ) RICH_EXCEPTION_NOEXCEPT   // Including another StaticRichException
+    {
+        reset();
+        push_back( error_uri_in, description_in );
+        copy_chain( r_cause_in, 0, 0 );
+    }
+    StaticRichException( const StaticRichException & r_rhs ) RICH_EXCEPTION_NOEXCEPT
+        :
+        RichException()
+    {
+        reset();
+        was_truncated = r_rhs.was_truncated;
+        n_elided = r_rhs.n_elided;
+        memcpy( text, r_rhs.text, r_rhs.n_text_used );
+        n_text_used = r_rhs.n_text_used;
+        copy_chain( r_rhs, r_rhs.text, r_rhs.text + r_rhs.n_text_used );
+    }
+    virtual ~StaticRichException() throw()
+    {
+        if( p_head == node( 0 ) )
+            p_head = 0;     // Otherwise it has been assigned an allocated chain, which ~RichException() releases
+        while( n_nodes > 0 )
+            node( --n_nodes )->~RichParamsNode();
+    }
+
+    StaticRichException & add(
+            const char * const name_in,
+            const char * p_value_in ) RICH_EXCEPTION_NOEXCEPT
+    {
+        if( ! p_value_in )
+            p_value_in = "";
+        append_text( front_node(), name_in, p_value_in, strlen( p_value_in ) );
+        return *this;
+    }
+    StaticRichException & add(
+            const char * const name_in,
+            const std::string & value_in ) RICH_EXCEPTION_NOEXCEPT
+    {
+        append_text( front_node(), name_in, value_in.data(), value_in.size() );
+        return *this;
+    }
+    StaticRichException & add(
+            const char * const name_in,
+            RichLiteral value_in ) RICH_EXCEPTION_NOEXCEPT
+    {
+        append( front_node(), name_in, RichExceptionValue( value_in ) );
+        return *this;
+    }
+    template< typename T >
+    StaticRichException & add(
+            const char * const name_in,
+            const T & value_in ) RICH_EXCEPTION_NOEXCEPT
+    {
+#if ! defined( RICH_EXCEPTION_EAGER_FORMAT )
+        typedef char value_must_be_recorded_without_allocating[
+                detail::RichFastFormat< T >::is_fast || detail::RichTextPointer< T >::is_text || RichLazyCapture< T >::enabled ? 1 : -1];
+#else
+        typedef char value_must_be_recorded_without_allocating[
+                detail::RichFastFormat< T >::is_fast || detail::RichTextPointer< T >::is_text ? 1 : -1];
+#endif
+        (void)sizeof( value_must_be_recorded_without_allocating );
+        add_value( name_in, value_in, detail::RichBoolType< detail::RichTextPointer< T >::is_text >() );
+        return *this;
+    }
+
+    bool is_truncated() const { return was_truncated; }
+    size_t elided_count() const { return n_elided; }
+
+private:
+    StaticRichException & operator = ( const StaticRichException & );   // Not implemented
+
+    void reset()
+    {
+        n_nodes = 0;
+        n_text_used = 0;
+        was_truncated = false;
+        n_elided = 0;
+    }
+
+    detail::RichParamsNode & front_node() { return *node( 0 ); }
+
+    detail::RichParamsNode * push_back( const char * const error_uri_in, const char * const description_in )
+    {
+        if( n_nodes == max_nodes )
+        {
+            was_truncated = true;
+            return 0;
+        }
+        detail::RichParamsNode * p_node = ::new( static_cast< void * >( node( n_nodes ) ) ) detail::RichParamsNode( error_uri_in, description_in );
+        p_node->is_embedded = true;
+        if( n_nodes > 0 )
+            node( n_nodes - 1 )->p_next = p_node;
+        else
+            p_head = p_node;
+        ++n_nodes;
+        for( size_t i = 0; i < n_nodes; ++i )
+            node( i )->chain_size = n_nodes - i;
+        return p_node;
+    }
+
+    // Literal values whose text is within [p_source_text_begin, p_source_text_end)
+    // refer to the text of the StaticRichException being copied, and are
+    // re-pointed at the copy's text.  When wrapping a cause, its literal
+    // values are copied into the text, as they may refer to the text of a
+    // StaticRichException that won't outlive this one.
+    //
+    // If the chain doesn't fit, its root cause and as many of its most
+    // recent nodes as fit are kept, and the nodes between them are elided.
+    void copy_chain( const RichException & r_source, const char * p_source_text_begin, const char * p_source_text_end )
+    {
+        bool is_same_type = p_source_text_begin != 0;
+        size_t n_source = r_source.size();
+        size_t n_room = max_nodes - n_nodes;
+        size_t n_most_recent = n_source <= n_room ? n_source : n_room > 0 ? n_room - 1 : 0;
+        size_t n_elided_here = 0;
+        size_t position = 0;
+        for( const_iterator i( r_source.begin() ), i_end( r_source.end() ); i != i_end; ++i, ++position )
+        {
+            if( position >= n_most_recent && ! ( position + 1 == n_source && n_nodes < max_nodes ) )
+            {
+                n_elided_here += i->repeat_count() + i->omitted_count();
+                was_truncated = true;
+                continue;
+            }
+            mark_elided( n_elided_here );
+            detail::RichParamsNode * p_node = push_back( i->error_uri, i->description );
+            copy_node_counts( *p_node, *i );
+            for( size_t i_param = 0; i_param < i->error_params.size(); ++i_param )
+            {
+                const RichExceptionParameter & r_param( i->error_params[i_param] );
+                char scratch[RichExceptionValue::inline_capacity];
+                size_t length = 0;
+                const char * p_text = r_param.value.has_text() ? r_param.value.text( scratch, length ) : 0;
+                if( r_param.value.native_kind() == detail::value_literal && is_same_type )
+                {
+                    if( p_text >= p_source_text_begin && p_text < p_source_text_end )
+                        p_text = text + ( p_text - p_source_text_begin );
+                    append( *p_node, r_param.name, RichExceptionValue( rich_literal( p_text, length ) ) );
+                }
+                else if( r_param.value.native_kind() == detail::value_literal || length > RichExceptionValue::inline_capacity )
+                    append_text( *p_node, r_param.name, p_text, length );
+                else
+                    append( *p_node, r_param.name, r_param.value );
+            }
+        }
+        mark_elided( n_elided_here );
+    }
+
+    void mark_elided( size_t & r_n_elided_here )     // Records elided exceptions against the node above them
+    {
+        if( r_n_elided_here == 0 )
+            return;
+        n_elided += r_n_elided_here;
+#if defined( RICH_EXCEPTION_COMPACT )
+        node( n_nodes - 1 )->n_omitted += r_n_elided_here;
+#endif
+        r_n_elided_here = 0;
+    }
+
+    static void copy_node_counts( RichExceptionNode & r_node, const RichExceptionNode & r_source )
+    {
+#if defined( RICH_EXCEPTION_STACK )
+        r_node.stack_trace = r_source.stack_trace;
+#endif
+#if defined( RICH_EXCEPTION_COMPACT )
+        r_node.n_repeats = r_source.n_repeats;
+        r_node.n_omitted = r_source.n_omitted;
+#endif
+        (void)r_node;
+        (void)r_source;
+    }
+
+    template< typename T >
+    void add_value( const char * const name_in, const T & value_in, detail::RichBoolType< true > )    // Pointers to characters
+    {
+        add( name_in, reinterpret_cast< const char * >( value_in ) );
+    }
+    template< typename T >
+    void add_value( const char * const name_in, const T & value_in, detail::RichBoolType< false > )
+    {
+        append( front_node(), name_in, RichExceptionValue( value_in ) );
+    }
+
+    void append( detail::RichParamsNode & r_node, const char * const name_in, const RichExceptionValue & value_in )
+    {
+        if( r_node.params.size() == max_params )
+            was_truncated = true;
+        else
+            r_node.params.add( name_in, value_in );   // Values that are not allocated are copied without allocating
+    }
+
+    void append_text( detail::RichParamsNode & r_node, const char * const name_in, const char * p_text_in, size_t length_in )
+    {
+        if( length_in <= RichExceptionValue::inline_capacity )
+        {
+            append( r_node, name_in, RichExceptionValue( p_text_in, length_in ) );
+            return;
+        }
+        size_t length = (std::min)( length_in, max_bytes - n_text_used );
+        if( length < length_in )
+            was_truncated = true;
+        char * p_text = text + n_text_used;
+        memcpy( p_text, p_text_in, length );
+        n_text_used += length;
+        append( r_node, name_in, RichExceptionValue( rich_literal( p_text, length ) ) );
+    }
+};
+
+}   // Namespace namespace rich_excep
+
+#endif  // RICH_EXCEPTION_STATIC
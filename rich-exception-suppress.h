@@ -0,0 +1,273 @@
+//----------------------------------------------------------------------------
+// Copyright (c) 2015, Codalogic Ltd (http://www.codalogic.com)
+// All rights reserved.
+//
+// The license for this file is based on the BSD-3-Clause license
+// (http://www.opensource.org/licenses/BSD-3-Clause).
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//
+// - Redistributions of source code must retain the above copyright notice,
+//   this list of conditions and the following disclaimer.
+// - Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+// - Neither the name Codalogic Ltd nor the names of its contributors may be
+//   used to endorse or promote products derived from this software without
+//   specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//----------------------------------------------------------------------------
+
+//----------------------------------------------------------------------------
+// Suppression of repeated log messages.
+//
+// rich_fingerprint() hashes the sequence of error URIs in a chain, and
+// optionally the names and values of their parameters, without allocating
+// memory.  Chains with the same fingerprint are, for logging purposes, the
+// same error.
+//
+// RichLogSuppressor uses fingerprints to decide, before any text is
+// formatted, whether each occurrence of an error should be logged in full,
+// logged as a summary of the occurrences that were dropped, or dropped.
+// For example:
+//
+//      RichLogSuppressor suppressor( std::chrono::seconds( 10 ) );
+//      ...
+//      catch( const RichException & e )
+//      {
+//          RichLogDecision decision( suppressor.decide( rich_fingerprint( e ) ) );
+//          if( decision.action == log_full )
+//              log << e;
+//          else if( decision.action == log_summary )
+//              log << e.main_error_uri() << ": " << decision.n_suppressed << " more in the last " << ...;
+//      }
+//
+// The first n_full_per_interval occurrences of an error are logged in full
+// and further occurrences are dropped.  The first occurrence after interval
+// has passed is logged as a summary, if any were dropped, and starts a new
+// interval.  So an error that recurs continuously is logged in full once,
+// then summarised once per interval.
+//
+// RichLogSuppressor remembers up to capacity errors.  When full, the error
+// least recently seen in the same set of 4 entries is forgotten, and so is
+// next logged in full.  It is divided into independently locked shards, so
+// threads logging different errors rarely contend.  (Requires C++11.)
+//----------------------------------------------------------------------------
+
+#ifndef RICH_EXCEPTION_SUPPRESS
+#define RICH_EXCEPTION_SUPPRESS
+
+#include "rich-exception.h"
+
+#if defined( RICH_EXCEPTION_CXX11 )
+    #include <chrono>
+    #include <mutex>
+    #include <vector>
+#endif
+
+namespace rich_excep {
+
+typedef unsigned long long RichFingerprint;
+
+enum RichFingerprintContent { fingerprint_uris, fingerprint_uris_and_params };
+
+namespace detail {
+
+inline RichFingerprint combine_fingerprint( RichFingerprint fingerprint, unsigned long long value )
+{
+    fingerprint = (fingerprint ^ value) * 0x9e3779b97f4a7c15ULL;
+    return fingerprint ^ (fingerprint >> 32);
+}
+
+inline unsigned long long hash_text( const char * p_text, size_t length )
+{
+    unsigned long long hash = fnv_offset_basis;
+    for( size_t i = 0; i < length; ++i )
+        hash = (hash ^ static_cast< unsigned char >( p_text[i] )) * fnv_prime;
+    return hash;
+}
+
+}   // namespace detail
+
+// Tchain is RichException, StaticRichException, RichError or RichExceptionView.
+// Values of user types captured via RichLazyCapture have no text without
+// being streamed, so only their presence is included in the fingerprint.
+template< typename Tchain >
+RichFingerprint rich_fingerprint( const Tchain & r_chain, RichFingerprintContent content = fingerprint_uris )
+{
+    RichFingerprint fingerprint = detail::fnv_offset_basis;
+    for( typename Tchain::const_iterator i( r_chain.begin() ), i_end( r_chain.end() ); i != i_end; ++i )
+    {
+        fingerprint = detail::combine_fingerprint( fingerprint, i->error_uri_id );
+        if( content == fingerprint_uris_and_params )
+        {
+            for( size_t i_param = 0; i_param < i->error_params.size(); ++i_param )
+            {
+                const RichExceptionParameter & r_param( i->error_params[i_param] );
+                fingerprint = detail::combine_fingerprint( fingerprint, detail::hash_uri( r_param.name ) );
+                char scratch[RichExceptionValue::inline_capacity];
+                size_t length = 0;
+                const char * p_text = r_param.value.has_text() ? r_param.value.text( scratch, length ) : "";
+                fingerprint = detail::combine_fingerprint( fingerprint, detail::hash_text( p_text, length ) );
+            }
+        }
+    }
+    return fingerprint;
+}
+
+#if defined( RICH_EXCEPTION_CXX11 )
+
+enum RichLogAction { log_full, log_summary, log_drop };
+
+struct RichLogDecision
+{
+    RichLogAction action;
+    unsigned long long n_suppressed;                    // For log_summary, the number of occurrences dropped
+    std::chrono::steady_clock::duration period;         // For log_summary, the time over which they were dropped
+};
+
+class RichLogSuppressor
+{
+public:
+    typedef std::chrono::steady_clock clock;
+
+private:
+    static const size_t n_shards = 16;
+    static const size_t n_ways = 4;
+
+    struct Entry
+    {
+        RichFingerprint fingerprint;
+        clock::time_point interval_start;
+        clock::time_point last_seen;
+        unsigned long long n_suppressed;
+        size_t n_full;          // Logged in full in this interval
+        bool is_used;
+
+        Entry() : fingerprint( 0 ), n_suppressed( 0 ), n_full( 0 ), is_used( false ) {}
+    };
+
+    struct Shard
+    {
+        std::mutex mutex;
+        std::vector< Entry > entries;   // n_sets * n_ways, each set being n_ways consecutive entries
+        char padding[64];               // Keeps the shards' mutexes on different cache lines
+    };
+
+    const clock::duration interval;
+    const size_t n_full_per_interval;
+    size_t n_sets;                      // Per shard.  A power of 2
+    Shard shards[n_shards];
+
+public:
+    explicit RichLogSuppressor(
+            clock::duration interval_in = std::chrono::seconds( 10 ),
+            size_t n_full_per_interval_in = 1,
+            size_t capacity_in = 4096 )
+        :
+        interval( interval_in ),
+        n_full_per_interval( n_full_per_interval_in ),
+        n_sets( 1 )
+    {
+        while( n_sets * n_ways * n_shards < capacity_in )
+            n_sets *= 2;
+        for( size_t i = 0; i < n_shards; ++i )
+            shards[i].entries.resize( n_sets * n_ways );
+    }
+
+    size_t capacity() const { return n_sets * n_ways * n_shards; }
+
+    RichLogDecision decide( RichFingerprint fingerprint ) { return decide( fingerprint, clock::now() ); }
+    RichLogDecision decide( RichFingerprint fingerprint, clock::time_point now )
+    {
+        Shard & r_shard( shards[fingerprint % n_shards] );
+        std::lock_guard< std::mutex > lock( r_shard.mutex );
+        Entry & r_entry( find( r_shard, fingerprint ) );
+        RichLogDecision decision = { log_drop, 0, clock::duration::zero() };
+        if( ! r_entry.is_used || r_entry.fingerprint != fingerprint )
+        {
+            r_entry = Entry();
+            r_entry.fingerprint = fingerprint;
+            r_entry.is_used = true;
+            r_entry.interval_start = now;
+            r_entry.n_full = 1;
+            decision.action = log_full;
+        }
+        else if( now - r_entry.interval_start >= interval )
+        {
+            if( r_entry.n_suppressed > 0 )
+            {
+                decision.action = log_summary;
+                decision.n_suppressed = r_entry.n_suppressed;
+                decision.period = now - r_entry.interval_start;
+                r_entry.n_full = n_full_per_interval;   // The summary stands for this interval's full logs
+            }
+            else
+            {
+                decision.action = log_full;
+                r_entry.n_full = 1;
+            }
+            r_entry.interval_start = now;
+            r_entry.n_suppressed = 0;
+        }
+        else if( r_entry.n_full < n_full_per_interval )
+        {
+            decision.action = log_full;
+            ++r_entry.n_full;
+        }
+        else
+            ++r_entry.n_suppressed;
+        r_entry.last_seen = now;
+        return decision;
+    }
+
+    void clear()
+    {
+        for( size_t i = 0; i < n_shards; ++i )
+        {
+            std::lock_guard< std::mutex > lock( shards[i].mutex );
+            std::fill( shards[i].entries.begin(), shards[i].entries.end(), Entry() );
+        }
+    }
+
+private:
+    RichLogSuppressor( const RichLogSuppressor & );                 // Not implemented
+    RichLogSuppressor & operator = ( const RichLogSuppressor & );   // Not implemented
+
+    // Returns the entry for the fingerprint if present, or else the entry
+    // to replace with it
+    Entry & find( Shard & r_shard, RichFingerprint fingerprint )
+    {
+        Entry * p_set = &r_shard.entries[( (fingerprint / n_shards) & (n_sets - 1) ) * n_ways];
+        Entry * p_victim = p_set;
+        for( size_t i = 0; i < n_ways; ++i )
+        {
+            if( p_set[i].is_used && p_set[i].fingerprint == fingerprint )
+                return p_set[i];
+            if( ! p_set[i].is_used )
+                p_victim = &p_set[i];
+            else if( p_victim->is_used && p_set[i].last_seen < p_victim->last_seen )
+                p_victim = &p_set[i];
+        }
+        return *p_victim;
+    }
+};
+
+#endif
+
+}   // Namespace namespace rich_excep
+
+#endif  // RICH_EXCEPTION_SUPPRESS
@@ -0,0 +1,510 @@
+//----------------------------------------------------------------------------
+// Copyright (c) 2015, Codalogic Ltd (http://www.codalogic.com)
+// All rights reserved.
+//
+// The license for this file is based on the BSD-3-Clause license
+// (http://www.opensource.org/licenses/BSD-3-Clause).
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//
+// - Redistributions of source code must retain the above copyright notice,
+//   this list of conditions and the following disclaimer.
+// - Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+// - Neither the name Codalogic Ltd nor the names of its contributors may be
+//   used to endorse or promote products derived from this software without
+//   specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//----------------------------------------------------------------------------
+
+//----------------------------------------------------------------------------
+// A compact binary encoding of RichException chains, for passing exceptions
+// between processes over pipes, sockets or shared memory.
+//
+// rich_wire_encode() encodes a RichException, most recent node first, and
+// RichExceptionView reads the encoded bytes in place, without copying or
+// allocating, via an API that mirrors that of RichException, e.g.:
+//
+//      std::string bytes( rich_wire_encode( e ) );
+//      ...
+//      RichExceptionView view( bytes.data(), bytes.size() );
+//      if( view.is_valid() )
+//          for( RichExceptionView::const_iterator i( view.begin() ), i_end( view.end() ); i != i_end; ++i )
+//              if( i->error_params.has( "name" ) )
+//                  log( i->error_uri, i->error_params.get( "name" ) );
+//
+// The text returned by the view points into the encoded bytes, so they must
+// outlive the view and anything obtained from it.  The bytes are fully
+// validated when the view is constructed, so malformed or truncated input
+// results in an invalid, empty view rather than out of bounds reads.
+//
+// The format is a 3 byte header ('R', 'X', version) followed by:
+//      count               Number of nodes
+//      count x node
+// where a node is:
+//      string              error_uri
+//      string              description
+//      count               Number of parameters
+//      count x { string name, string value }
+// counts and string lengths are unsigned LEB128 varints, and strings are
+// followed by a nul so that they can be read as C strings.  Parameter values
+// are encoded as their text.
+//----------------------------------------------------------------------------
+
+#ifndef RICH_EXCEPTION_WIRE
+#define RICH_EXCEPTION_WIRE
+
+#include "rich-exception.h"
+
+#include <string>
+#include <cstring>
+#include <iterator>
+#include <ostream>
+#include <sstream>
+
+namespace rich_excep {
+
+static const unsigned char rich_wire_version = 1;
+
+namespace detail {
+
+static const size_t wire_header_size = 3;
+
+class RichWireWriter
+{
+    // Writes as much as fits in the buffer, while counting the total size
+private:
+    unsigned char * p_buffer;
+    size_t buffer_size;
+    size_t n_total;
+
+public:
+    RichWireWriter( void * p_buffer_in, size_t buffer_size_in )
+        : p_buffer( static_cast< unsigned char * >( p_buffer_in ) ), buffer_size( buffer_size_in ), n_total( 0 )
+    {}
+
+    size_t size() const { return n_total; }
+
+    void byte( unsigned char value )
+    {
+        if( n_total < buffer_size )
+            p_buffer[n_total] = value;
+        ++n_total;
+    }
+    void varint( unsigned long long value )
+    {
+        while( value >= 0x80 )
+        {
+            byte( static_cast< unsigned char >( value | 0x80 ) );
+            value >>= 7;
+        }
+        byte( static_cast< unsigned char >( value ) );
+    }
+    void string( const char * p_text, size_t length )
+    {
+        varint( length );
+        if( n_total < buffer_size )
+            memcpy( p_buffer + n_total, p_text, (std::min)( length, buffer_size - n_total ) );
+        n_total += length;
+        byte( 0 );
+    }
+    void string( const char * p_text )
+    {
+        if( ! p_text )
+            p_text = "";
+        string( p_text, strlen( p_text ) );
+    }
+    void value( const RichExceptionValue & r_value )
+    {
+        if( r_value.has_text() )
+        {
+            char scratch[RichExceptionValue::inline_capacity];
+            size_t length;
+            const char * p_text = r_value.text( scratch, length );
+            string( p_text, length );
+        }
+        else
+        {
+            const std::string & r_text( r_value.str() );
+            string( r_text.data(), r_text.size() );
+        }
+    }
+};
+
+class RichWireReader
+{
+    // Every read is bounds checked.  Once a read fails, all later reads fail.
+private:
+    const unsigned char * p_next;
+    const unsigned char * p_end;
+
+public:
+    RichWireReader( const void * p_begin_in, const void * p_end_in )
+        :
+        p_next( static_cast< const unsigned char * >( p_begin_in ) ),
+        p_end( static_cast< const unsigned char * >( p_end_in ) )
+    {}
+
+    bool is_ok() const { return p_next != 0; }
+    const char * position() const { return reinterpret_cast< const char * >( p_next ); }
+
+    bool byte( unsigned char * p_value )
+    {
+        if( ! p_next || p_next == p_end )
+            return fail();
+        *p_value = *p_next++;
+        return true;
+    }
+    bool varint( unsigned long long * p_value )
+    {
+        unsigned long long value = 0;
+        for( unsigned int shift = 0; shift < 64; shift += 7 )
+        {
+            unsigned char next_byte;
+            if( ! byte( &next_byte ) )
+                return false;
+            value |= static_cast< unsigned long long >( next_byte & 0x7f ) << shift;
+            if( (next_byte & 0x80) == 0 )
+            {
+                *p_value = value;
+                return true;
+            }
+        }
+        return fail();
+    }
+    bool count( size_t * p_count )     // Each counted item takes at least one byte
+    {
+        unsigned long long value;
+        if( ! varint( &value ) || value > static_cast< unsigned long long >( p_end - p_next ) )
+            return fail();
+        *p_count = static_cast< size_t >( value );
+        return true;
+    }
+    bool string( const char ** pp_text, size_t * p_length )
+    {
+        unsigned long long length;
+        if( ! varint( &length ) || length >= static_cast< unsigned long long >( p_end - p_next ) || p_next[length] != 0 )
+            return fail();
+        *pp_text = reinterpret_cast< const char * >( p_next );
+        *p_length = static_cast< size_t >( length );
+        p_next += length + 1;
+        return true;
+    }
+    bool skip_string()
+    {
+        const char * p_text;
+        size_t length;
+        return string( &p_text, &length );
+    }
+
+private:
+    bool fail()
+    {
+        p_next = 0;
+        return false;
+    }
+};
+
+}   // namespace detail
+
+// Encodes r_exception into p_buffer, returning the number of bytes in the
+// encoding.  If that is more than buffer_size, the buffer contents are
+// incomplete, but the encoding can be repeated with a large enough buffer.
+inline size_t rich_wire_encode( const RichException & r_exception, void * p_buffer, size_t buffer_size )
+{
+    detail::RichWireWriter writer( p_buffer, buffer_size );
+    writer.byte( 'R' );
+    writer.byte( 'X' );
+    writer.byte( rich_wire_version );
+    writer.varint( r_exception.size() );
+    for( RichException::const_iterator i( r_exception.begin() ), i_end( r_exception.end() ); i != i_end; ++i )
+    {
+        writer.string( i->error_uri );
+        writer.string( i->description );
+        writer.varint( i->error_params.size() );
+        for( size_t i_param = 0; i_param < i->error_params.size(); ++i_param )
+        {
+            writer.string( i->error_params[i_param].name );
+            writer.value( i->error_params[i_param].value );
+        }
+    }
+    return writer.size();
+}
+
+inline std::string rich_wire_encode( const RichException & r_exception )
+{
+    std::string encoded( rich_wire_encode( r_exception, 0, 0 ), '\0' );
+    rich_wire_encode( r_exception, &encoded[0], encoded.size() );
+    return encoded;
+}
+
+class RichExceptionParamsView
+{
+    // Mirrors the read-only API of RichExceptionParams.  Parameters are
+    // returned by value, with values referring to the encoded text.
+    // operator [] walks the encoded parameters, so is O(i).
+private:
+    const char * p_first;
+    const char * p_end;
+    size_t n_params;
+
+public:
+    RichExceptionParamsView() : p_first( 0 ), p_end( 0 ), n_params( 0 ) {}
+    RichExceptionParamsView( const char * p_first_in, const char * p_end_in, size_t n_params_in )
+        : p_first( p_first_in ), p_end( p_end_in ), n_params( n_params_in )
+    {}
+
+    bool empty() const { return n_params == 0; }
+    size_t size() const { return n_params; }
+
+    RichExceptionParameter operator []( size_t i ) const
+    {
+        assert( i < n_params );
+        detail::RichWireReader reader( p_first, p_end );
+        for( ; i > 0; --i )
+            reader.skip_string(), reader.skip_string();
+        return read_parameter( reader );
+    }
+
+    bool has( const char * name_in ) const
+    {
+        const char * p_value;
+        size_t value_length;
+        return find( name_in, &p_value, &value_length );
+    }
+    std::string get( const char * name_in ) const   // Returns "" if name_in is not present
+    {
+        return get_value( name_in ).str();
+    }
+    RichExceptionValue get_value( const char * name_in ) const  // Refers to the encoded bytes rather than copying them
+    {
+        const char * p_value;
+        size_t value_length;
+        if( find( name_in, &p_value, &value_length ) )
+            return RichExceptionValue( rich_literal( p_value, value_length ) );
+        return RichExceptionValue();
+    }
+
+    std::string to_string() const
+    {
+        std::stringstream ss;
+        ss << *this;
+        return ss.str();
+    }
+
+    friend std::ostream & operator << ( std::ostream & os, const RichExceptionParamsView & r_params )
+    {
+        detail::RichWireReader reader( r_params.p_first, r_params.p_end );
+        for( size_t i = 0; i < r_params.n_params; ++i )
+        {
+            if( i != 0 )
+                os << ", ";
+            os << read_parameter( reader );
+        }
+        return os;
+    }
+
+private:
+    static RichExceptionParameter read_parameter( detail::RichWireReader & r_reader )
+    {
+        const char * p_name = "";
+        const char * p_value = "";
+        size_t name_length = 0;
+        size_t value_length = 0;
+        r_reader.string( &p_name, &name_length );
+        r_reader.string( &p_value, &value_length );
+        return RichExceptionParameter( p_name, RichExceptionValue( rich_literal( p_value, value_length ) ) );
+    }
+
+    bool find( const char * name_in, const char ** pp_value, size_t * p_value_length ) const
+    {
+        detail::RichWireReader reader( p_first, p_end );
+        for( size_t i = 0; i < n_params; ++i )
+        {
+            const char * p_name;
+            size_t name_length;
+            if( ! reader.string( &p_name, &name_length ) || ! reader.string( pp_value, p_value_length ) )
+                return false;
+            if( strcmp( p_name, name_in ) == 0 )
+                return true;
+        }
+        return false;
+    }
+};
+
+struct RichExceptionNodeView
+{
+    const char * error_uri;
+    RichUriId error_uri_id;     // rich_uri_id( error_uri )
+    RichExceptionParamsView error_params;
+    const char * description;
+
+    RichExceptionNodeView() : error_uri( "" ), error_uri_id( 0 ), description( "" ) {}
+
+    bool is( RichUriId error_uri_id_in ) const { return error_uri_id == error_uri_id_in; }
+
+    std::string to_string() const
+    {
+        std::stringstream ss;
+        ss << *this;
+        return ss.str();
+    }
+
+    friend std::ostream & operator << ( std::ostream & os, const RichExceptionNodeView & r_node )
+    {
+        os << r_node.error_uri;
+        if( ! r_node.error_params.empty() )
+            os << " (" << r_node.error_params << ")";
+        os << ": " << r_node.description;
+        return os;
+    }
+};
+
+class RichExceptionView
+{
+private:
+    const char * p_first_node;
+    const char * p_end;
+    size_t n_nodes;
+    size_t n_encoded_bytes;
+
+public:
+    class const_iterator
+    {
+    private:
+        const char * p_next_node;
+        const char * p_end;
+        size_t n_remaining;
+        RichExceptionNodeView node;
+
+    public:
+        typedef std::forward_iterator_tag iterator_category;
+        typedef RichExceptionNodeView value_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef const RichExceptionNodeView * pointer;
+        typedef const RichExceptionNodeView & reference;
+
+        const_iterator() : p_next_node( 0 ), p_end( 0 ), n_remaining( 0 ) {}
+        const_iterator( const char * p_first_node_in, const char * p_end_in, size_t n_nodes_in )
+            : p_next_node( p_first_node_in ), p_end( p_end_in ), n_remaining( n_nodes_in )
+        {
+            read_node();
+        }
+
+        reference operator * () const { return node; }
+        pointer operator -> () const { return &node; }
+        const_iterator & operator ++ () { --n_remaining; read_node(); return *this; }
+        const_iterator operator ++ ( int ) { const_iterator prev( *this ); ++*this; return prev; }
+        bool operator == ( const const_iterator & r_rhs ) const { return n_remaining == r_rhs.n_remaining; }
+        bool operator != ( const const_iterator & r_rhs ) const { return n_remaining != r_rhs.n_remaining; }
+
+    private:
+        void read_node()
+        {
+            if( n_remaining == 0 )
+                return;
+            detail::RichWireReader reader( p_next_node, p_end );
+            node = RichExceptionNodeView();
+            size_t length;
+            size_t n_params = 0;
+            reader.string( &node.error_uri, &length );
+            reader.string( &node.description, &length );
+            reader.count( &n_params );
+            const char * p_params = reader.position();
+            for( size_t i = 0; i < n_params; ++i )
+                reader.skip_string(), reader.skip_string();
+            p_next_node = reader.position();
+            node.error_uri_id = detail::hash_uri( node.error_uri );
+            node.error_params = RichExceptionParamsView( p_params, p_next_node, n_params );
+        }
+    };
+
+    // p_data must point to an encoding made by rich_wire_encode().  Bytes
+    // beyond the end of the encoding are ignored (see encoded_size()).
+    RichExceptionView( const void * p_data, size_t size_in )
+        : p_first_node( 0 ), p_end( 0 ), n_nodes( 0 ), n_encoded_bytes( 0 )
+    {
+        const char * p_begin = static_cast< const char * >( p_data );
+        detail::RichWireReader reader( p_begin, p_begin + size_in );
+        unsigned char magic_r, magic_x, version;
+        size_t n_nodes_in;
+        if( ! reader.byte( &magic_r ) || ! reader.byte( &magic_x ) || ! reader.byte( &version ) ||
+                magic_r != 'R' || magic_x != 'X' || version != rich_wire_version ||
+                ! reader.count( &n_nodes_in ) )
+            return;
+        const char * p_first_node_in = reader.position();
+        for( size_t i_node = 0; i_node < n_nodes_in; ++i_node )
+        {
+            size_t n_params;
+            if( ! reader.skip_string() || ! reader.skip_string() || ! reader.count( &n_params ) )
+                return;
+            for( size_t i_param = 0; i_param < n_params; ++i_param )
+                if( ! reader.skip_string() || ! reader.skip_string() )
+                    return;
+        }
+        p_first_node = p_first_node_in;
+        p_end = reader.position();
+        n_nodes = n_nodes_in;
+        n_encoded_bytes = p_end - p_begin;
+    }
+
+    bool is_valid() const { return n_encoded_bytes != 0; }
+    size_t encoded_size() const { return n_encoded_bytes; }     // 0 if not valid
+
+    bool empty() const { return n_nodes == 0; }
+    size_t size() const { return n_nodes; }
+
+    const_iterator begin() const { return const_iterator( p_first_node, p_end, n_nodes ); }
+    const_iterator end() const { return const_iterator(); }
+    RichExceptionNodeView front() const { return empty() ? RichExceptionNodeView() : *begin(); }
+
+    const char * what() const { return empty() ? "<Undescribed RichException>" : front().description; }
+    const char * main_error_uri() const { return empty() ? "<Unspecified error_uri>" : front().error_uri; }
+    RichUriId main_error_uri_id() const { return empty() ? 0 : front().error_uri_id; }
+    bool is( RichUriId error_uri_id_in ) const { return ! empty() && front().is( error_uri_id_in ); }
+
+    const_iterator find( RichUriId error_uri_id_in ) const     // Returns the most recent node with the id, or end()
+    {
+        const_iterator i( begin() ), i_end( end() );
+        while( i != i_end && ! i->is( error_uri_id_in ) )
+            ++i;
+        return i;
+    }
+    bool has( RichUriId error_uri_id_in ) const { return find( error_uri_id_in ) != end(); }
+
+    std::string to_string() const
+    {
+        std::stringstream ss;
+        ss << *this;
+        return ss.str();
+    }
+
+    friend std::ostream & operator << ( std::ostream & os, const RichExceptionView & r_view )
+    {
+        size_t indent = 0;
+        for( const_iterator i( r_view.begin() ), i_end( r_view.end() ); i != i_end; ++i, indent += 2 )
+        {
+            detail::write_indent( os, indent );
+            os << *i << "\n";
+        }
+        return os;
+    }
+};
+
+}   // Namespace namespace rich_excep
+
+#endif  // RICH_EXCEPTION_WIRE
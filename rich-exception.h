@@ -37,49 +37,1678 @@
 #include <exception>
 #include <string>
 #include <vector>
-#include <list>
 #include <ostream>
 #include <sstream>
 #include <cassert>
 #include <algorithm>
+#include <iterator>
 #include <cstring>
+#include <cstddef>
+#include <new>
+#include <limits>
+#include <cstdio>
+
+#if defined(_MSC_VER)
+    #include <intrin.h>
+#endif
+
+#if __cplusplus >= 201703L
+    #include <charconv>
+#endif
+
+#if __cplusplus >= 201103L || (defined(_MSC_VER) && _MSC_VER >= 1900)
+    #define RICH_EXCEPTION_CXX11 1
+#endif
+
+#if defined( RICH_EXCEPTION_CXX11 )
+    #define RICH_EXCEPTION_MOVE( x ) std::move( x )
+    #define RICH_EXCEPTION_LVALUE_QUALIFIER &
+    #define RICH_EXCEPTION_NOEXCEPT noexcept
+#else
+    #define RICH_EXCEPTION_MOVE( x ) x
+    #define RICH_EXCEPTION_LVALUE_QUALIFIER
+    #define RICH_EXCEPTION_NOEXCEPT throw()
+#endif
+
+#if defined( RICH_EXCEPTION_CXX11 )
+    #include <utility>
+    #include <type_traits>
+    #include <atomic>
+    #include <mutex>
+    #include <unordered_map>
+#endif
+
+#if defined(_MSC_VER) && _MSC_VER < 1900
+    #define RICH_EXCEPTION_SNPRINTF _snprintf
+#else
+    #define RICH_EXCEPTION_SNPRINTF snprintf
+#endif
+
+#if defined( RICH_EXCEPTION_USE_ARENA )
+    #if ! defined( RICH_EXCEPTION_CXX11 )
+        #error "RICH_EXCEPTION_USE_ARENA requires C++11 or later"
+    #endif
+    #ifndef RICH_EXCEPTION_ARENA_BLOCK_SIZE
+        #define RICH_EXCEPTION_ARENA_BLOCK_SIZE 8192
+    #endif
+#endif
+
+#if defined( RICH_EXCEPTION_STATS )
+    #if ! defined( RICH_EXCEPTION_CXX11 )
+        #error "RICH_EXCEPTION_STATS requires C++11 or later"
+    #endif
+    #ifndef RICH_EXCEPTION_STATS_SHARD_CAPACITY
+        #define RICH_EXCEPTION_STATS_SHARD_CAPACITY 256     // Must be a power of 2
+    #endif
+#endif
+
+#if defined( RICH_EXCEPTION_INSTRUMENT )
+    #if ! defined( RICH_EXCEPTION_CXX11 )
+        #error "RICH_EXCEPTION_INSTRUMENT requires C++11 or later"
+    #endif
+    #include <chrono>
+    #include <map>
+    #if ( defined( __GNUC__ ) || defined( __clang__ ) ) && ( defined( __x86_64__ ) || defined( __i386__ ) )
+        #include <x86intrin.h>
+        #define RICH_EXCEPTION_HAS_RDTSC 1
+    #elif defined( _MSC_VER ) && ( defined( _M_X64 ) || defined( _M_IX86 ) )
+        #define RICH_EXCEPTION_HAS_RDTSC 1
+    #endif
+#endif
+
+#if defined( RICH_EXCEPTION_STACK )
+    #if ! defined( RICH_EXCEPTION_CXX11 )
+        #error "RICH_EXCEPTION_STACK requires C++11 or later"
+    #endif
+    #ifndef RICH_EXCEPTION_STACK_DEPTH
+        #define RICH_EXCEPTION_STACK_DEPTH 16
+    #endif
+    #include <cstdint>
+    #if defined( _WIN32 )
+        #ifndef WIN32_LEAN_AND_MEAN
+            #define WIN32_LEAN_AND_MEAN
+        #endif
+        #include <windows.h>
+        #include <dbghelp.h>
+        #if defined( _MSC_VER )
+            #pragma comment( lib, "dbghelp.lib" )
+        #endif
+    #else
+        #include <dlfcn.h>
+        #include <cxxabi.h>
+        #include <cstdlib>
+        #include <pthread.h>
+        #if ( defined( __GNUC__ ) || defined( __clang__ ) ) && \
+                ( defined( __x86_64__ ) || defined( __i386__ ) || defined( __aarch64__ ) ) && \
+                ( defined( __linux__ ) || defined( __APPLE__ ) )
+            #define RICH_EXCEPTION_STACK_FRAME_POINTERS 1
+        #else
+            #include <execinfo.h>
+        #endif
+    #endif
+    #if defined( _MSC_VER )
+        #define RICH_EXCEPTION_NOINLINE __declspec( noinline )
+    #else
+        #define RICH_EXCEPTION_NOINLINE __attribute__(( noinline ))
+    #endif
+#endif
+
+#if defined( RICH_EXCEPTION_COMPACT )
+    #ifndef RICH_EXCEPTION_MAX_CHAIN_DEPTH
+        #define RICH_EXCEPTION_MAX_CHAIN_DEPTH 32   // Must be at least 2
+    #endif
+#endif
 
 namespace rich_excep {
 
+//----------------------------------------------------------------------------
+// All memory used to record a chain of RichExceptionNodes (the nodes
+// themselves and their parameter arrays) is obtained via rich_allocate() and
+// released via rich_deallocate().
+//
+// By default these forward to ::operator new and ::operator delete.  If
+// RICH_EXCEPTION_USE_ARENA is defined, allocations are carved out of a
+// per-thread arena of RICH_EXCEPTION_ARENA_BLOCK_SIZE byte blocks.  Each
+// block counts its live allocations, so once the outermost exception that
+// uses a block is destroyed the block is reset and re-used by the next
+// exception thrown on that thread.  Allocations may be released on a
+// different thread to the one that made them.
+//----------------------------------------------------------------------------
+
+namespace detail {
+
+// Thread-safe reference count used to share nodes between exceptions
+class RichRefCount
+{
+private:
+#if defined( RICH_EXCEPTION_CXX11 )
+    std::atomic< long > count;
+#elif defined( _MSC_VER )
+    long volatile count;
+#else
+    long count;
+#endif
+
+    RichRefCount( const RichRefCount & );               // Not implemented
+    RichRefCount & operator = ( const RichRefCount & ); // Not implemented
+
+public:
+    explicit RichRefCount( long count_in ) : count( count_in ) {}
+
+#if defined( RICH_EXCEPTION_CXX11 )
+    void increment() { count.fetch_add( 1, std::memory_order_relaxed ); }
+    bool decrement() { return count.fetch_sub( 1, std::memory_order_acq_rel ) == 1; }   // Returns true on reaching 0
+    bool is_unique() const { return count.load( std::memory_order_acquire ) == 1; }
+#elif defined( __GNUC__ )
+    void increment() { __sync_fetch_and_add( &count, 1 ); }
+    bool decrement() { return __sync_sub_and_fetch( &count, 1 ) == 0; }
+    bool is_unique() const { return __sync_fetch_and_add( const_cast< long * >( &count ), 0 ) == 1; }
+#elif defined( _MSC_VER )
+    void increment() { _InterlockedIncrement( &count ); }
+    bool decrement() { return _InterlockedDecrement( &count ) == 0; }
+    bool is_unique() const { return _InterlockedCompareExchange( const_cast< long volatile * >( &count ), 0, 0 ) == 1; }
+#else
+    // No atomic operations available; exceptions sharing nodes must not be
+    // used from multiple threads at once.
+    void increment() { ++count; }
+    bool decrement() { return --count == 0; }
+    bool is_unique() const { return count == 1; }
+#endif
+};
+
+#if defined( RICH_EXCEPTION_INSTRUMENT )
+
+struct RichAllocationCounts
+{
+    unsigned long long n_allocations;
+    unsigned long long n_bytes;
+};
+
+inline RichAllocationCounts & this_thread_allocation_counts()
+{
+    static thread_local RichAllocationCounts counts = { 0, 0 };
+    return counts;
+}
+
+inline void count_allocation( size_t size )
+{
+    RichAllocationCounts & r_counts( this_thread_allocation_counts() );
+    ++r_counts.n_allocations;
+    r_counts.n_bytes += size;
+}
+
+#define RICH_EXCEPTION_COUNT_ALLOCATION( size ) detail::count_allocation( size )
+
+#else
+
+#define RICH_EXCEPTION_COUNT_ALLOCATION( size ) ((void)0)
+
+#endif
+
+#if defined( RICH_EXCEPTION_USE_ARENA )
+
+class RichArena
+{
+private:
+    struct Block
+    {
+        std::atomic< long > n_refs;     // Live allocations, plus 1 while the block is owned by a thread's arena
+        size_t used;
+    };
+    struct Header   // Precedes every allocation so it can be returned to its block
+    {
+        Block * p_block;
+    };
+
+    static size_t round_up( size_t size ) { return (size + alignment - 1) & ~(alignment - 1); }
+
+    static const size_t alignment = 16;
+    static const size_t header_size = 16;
+    static const size_t block_header_size = 32;
+    static const size_t block_payload_size = RICH_EXCEPTION_ARENA_BLOCK_SIZE - block_header_size;
+
+    Block * p_current;
+
+    static void release( Block * p_block )
+    {
+        if( p_block->n_refs.fetch_sub( 1, std::memory_order_acq_rel ) == 1 )
+            ::operator delete( p_block );
+    }
+
+    void new_block()
+    {
+        if( p_current )
+            release( p_current );
+        p_current = static_cast< Block * >( ::operator new( RICH_EXCEPTION_ARENA_BLOCK_SIZE ) );
+        new( &p_current->n_refs ) std::atomic< long >( 1 );
+        p_current->used = 0;
+    }
+
+public:
+    RichArena() : p_current( 0 ) {}
+    ~RichArena()
+    {
+        if( p_current )
+            release( p_current );
+    }
+
+    void * allocate( size_t size )
+    {
+        size_t needed = header_size + round_up( size );
+        if( needed > block_payload_size )
+        {
+            Header * p_header = static_cast< Header * >( ::operator new( needed ) );
+            p_header->p_block = 0;
+            return reinterpret_cast< char * >( p_header ) + header_size;
+        }
+
+        // Only this thread adds references to p_current, so if the arena holds
+        // the only reference nothing allocated from it is still alive.
+        if( p_current && p_current->n_refs.load( std::memory_order_acquire ) == 1 )
+            p_current->used = 0;
+        if( ! p_current || p_current->used + needed > block_payload_size )
+            new_block();
+
+        Header * p_header = reinterpret_cast< Header * >(
+                reinterpret_cast< char * >( p_current ) + block_header_size + p_current->used );
+        p_header->p_block = p_current;
+        p_current->used += needed;
+        p_current->n_refs.fetch_add( 1, std::memory_order_relaxed );
+        return reinterpret_cast< char * >( p_header ) + header_size;
+    }
+
+    static void deallocate( void * p )
+    {
+        Header * p_header = reinterpret_cast< Header * >( static_cast< char * >( p ) - header_size );
+        if( p_header->p_block )
+            release( p_header->p_block );
+        else
+            ::operator delete( p_header );
+    }
+
+    static RichArena & this_thread()
+    {
+        static thread_local RichArena arena;
+        return arena;
+    }
+};
+
+struct RichAllocateTag {};
+static const RichAllocateTag rich_allocation = RichAllocateTag();
+
+inline void * rich_allocate( size_t size ) { RICH_EXCEPTION_COUNT_ALLOCATION( size ); return RichArena::this_thread().allocate( size ); }
+inline void rich_deallocate( void * p ) { RichArena::deallocate( p ); }
+
+#else
+
+struct RichAllocateTag {};
+static const RichAllocateTag rich_allocation = RichAllocateTag();
+
+inline void * rich_allocate( size_t size ) { RICH_EXCEPTION_COUNT_ALLOCATION( size ); return ::operator new( size ); }
+inline void rich_deallocate( void * p ) { ::operator delete( p ); }
+
+#endif
+
+
+//----------------------------------------------------------------------------
+// Fast formatting of parameter values.
+//
+// RichFastFormat< T >::format() writes the text of a built-in value directly
+// into a caller supplied buffer of at least max_fast_format_size characters
+// and returns the number of characters written.  The text produced is the
+// same as that produced by a default std::ostream, but without constructing
+// a stream.  Types without a RichFastFormat specialisation are formatted
+// using operator <<.
+//----------------------------------------------------------------------------
+
+static const size_t max_fast_format_size = 22;
+
+inline size_t format_unsigned( char * p_buffer, unsigned long long value )
+{
+    static const char digit_pairs[] =
+            "00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+            "40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+            "8081828384858687888990919293949596979899";
+    char digits[20];
+    char * p_digit = digits + sizeof( digits );
+    while( value >= 100 )
+    {
+        const char * p_pair = digit_pairs + (value % 100) * 2;
+        value /= 100;
+        *--p_digit = p_pair[1];
+        *--p_digit = p_pair[0];
+    }
+    if( value >= 10 )
+    {
+        const char * p_pair = digit_pairs + value * 2;
+        *--p_digit = p_pair[1];
+        *--p_digit = p_pair[0];
+    }
+    else
+        *--p_digit = static_cast< char >( '0' + value );
+    size_t length = digits + sizeof( digits ) - p_digit;
+    memcpy( p_buffer, p_digit, length );
+    return length;
+}
+
+inline size_t format_signed( char * p_buffer, long long value )
+{
+    if( value >= 0 )
+        return format_unsigned( p_buffer, static_cast< unsigned long long >( value ) );
+    *p_buffer = '-';
+    return 1 + format_unsigned( p_buffer + 1, 0ULL - static_cast< unsigned long long >( value ) );
+}
+
+inline size_t format_double( char * p_buffer, double value )
+{
+    // Equivalent to the default std::ostream precision of 6 significant digits
+#if defined( __cpp_lib_to_chars ) && __cpp_lib_to_chars >= 201611L
+    return std::to_chars( p_buffer, p_buffer + max_fast_format_size, value, std::chars_format::general, 6 ).ptr - p_buffer;
+#else
+    int length = RICH_EXCEPTION_SNPRINTF( p_buffer, max_fast_format_size + 1, "%.6g", value );
+    return length < 0 ? 0 : static_cast< size_t >( length );
+#endif
+}
+
+inline size_t format_long_double( char * p_buffer, long double value )
+{
+    int length = RICH_EXCEPTION_SNPRINTF( p_buffer, max_fast_format_size + 1, "%.6Lg", value );
+    return length < 0 ? 0 : static_cast< size_t >( length );
+}
+
+inline size_t format_pointer( char * p_buffer, const void * p_value )
+{
+    size_t value = reinterpret_cast< size_t >( p_value );
+    if( value == 0 )
+    {
+        *p_buffer = '0';
+        return 1;
+    }
+    char digits[sizeof( size_t ) * 2];
+    char * p_digit = digits + sizeof( digits );
+    for( ; value; value >>= 4 )
+        *--p_digit = "0123456789abcdef"[value & 0xf];
+    size_t length = digits + sizeof( digits ) - p_digit;
+    p_buffer[0] = '0';
+    p_buffer[1] = 'x';
+    memcpy( p_buffer + 2, p_digit, length );
+    return length + 2;
+}
+
+// The native forms in which a RichExceptionValue can hold a value
+enum RichValueKind
+{
+    value_text,         // Formatted text held by the value
+    value_literal,      // Pointer to text with static storage duration
+    value_signed,
+    value_unsigned,
+    value_double,
+    value_bool,
+    value_char,
+    value_pointer,
+    value_user          // Opted-in user type formatted via operator <<
+};
+
+template< typename T >
+struct RichFastFormat
+{
+    enum { is_fast = false };
+};
+
+#define RICH_EXCEPTION_FAST_FORMAT( type, formatter, cast_type, kind_in ) \
+    template<> \
+    struct RichFastFormat< type > \
+    { \
+        enum { is_fast = true, kind = kind_in }; \
+        typedef cast_type capture_type; \
+        static size_t format( char * p_buffer, type value ) { return formatter( p_buffer, static_cast< cast_type >( value ) ); } \
+    };
+
+RICH_EXCEPTION_FAST_FORMAT( short, format_signed, long long, value_signed )
+RICH_EXCEPTION_FAST_FORMAT( int, format_signed, long long, value_signed )
+RICH_EXCEPTION_FAST_FORMAT( long, format_signed, long long, value_signed )
+RICH_EXCEPTION_FAST_FORMAT( long long, format_signed, long long, value_signed )
+RICH_EXCEPTION_FAST_FORMAT( unsigned short, format_unsigned, unsigned long long, value_unsigned )
+RICH_EXCEPTION_FAST_FORMAT( unsigned int, format_unsigned, unsigned long long, value_unsigned )
+RICH_EXCEPTION_FAST_FORMAT( unsigned long, format_unsigned, unsigned long long, value_unsigned )
+RICH_EXCEPTION_FAST_FORMAT( unsigned long long, format_unsigned, unsigned long long, value_unsigned )
+RICH_EXCEPTION_FAST_FORMAT( float, format_double, double, value_double )
+RICH_EXCEPTION_FAST_FORMAT( double, format_double, double, value_double )
+RICH_EXCEPTION_FAST_FORMAT( long double, format_long_double, long double, value_text )  // Too big to hold natively
+
+#undef RICH_EXCEPTION_FAST_FORMAT
+
+inline size_t format_bool( char * p_buffer, bool value ) { *p_buffer = value ? '1' : '0'; return 1; }
+inline size_t format_char( char * p_buffer, char value ) { *p_buffer = value; return 1; }
+
+template<>
+struct RichFastFormat< bool >
+{
+    enum { is_fast = true, kind = value_bool };
+    typedef bool capture_type;
+    static size_t format( char * p_buffer, bool value ) { return format_bool( p_buffer, value ); }
+};
+
+template<>
+struct RichFastFormat< char >
+{
+    enum { is_fast = true, kind = value_char };
+    typedef char capture_type;
+    static size_t format( char * p_buffer, char value ) { return format_char( p_buffer, value ); }
+};
+template<>
+struct RichFastFormat< signed char > : public RichFastFormat< char > {};
+template<>
+struct RichFastFormat< unsigned char > : public RichFastFormat< char > {};
+
+template< typename T >
+struct RichFastFormat< T * >
+{
+    enum { is_fast = true, kind = value_pointer };
+    typedef const void * capture_type;
+    static size_t format( char * p_buffer, const T * p_value ) { return format_pointer( p_buffer, p_value ); }
+};
+
+// Pointers to characters are strings, as for std::ostream, so they are
+// recorded as text rather than by the pointer kernel
+template< typename T >
+struct RichTextPointer
+{
+    enum { is_text = false };
+};
+
+#define RICH_EXCEPTION_TEXT_POINTER( type ) \
+    template<> \
+    struct RichFastFormat< type > \
+    { \
+        enum { is_fast = false }; \
+    }; \
+    template<> \
+    struct RichTextPointer< type > \
+    { \
+        enum { is_text = true }; \
+    };
+
+RICH_EXCEPTION_TEXT_POINTER( char * )
+RICH_EXCEPTION_TEXT_POINTER( const char * )
+RICH_EXCEPTION_TEXT_POINTER( signed char * )
+RICH_EXCEPTION_TEXT_POINTER( const signed char * )
+RICH_EXCEPTION_TEXT_POINTER( unsigned char * )
+RICH_EXCEPTION_TEXT_POINTER( const unsigned char * )
+
+#undef RICH_EXCEPTION_TEXT_POINTER
+
+template< bool b >
+struct RichBoolType {};
+
+template< typename T >
+void stream_user_value( std::ostream & os, const void * p_value )
+{
+    os << *static_cast< const T * >( p_value );
+}
+
+}   // namespace detail
+
+//----------------------------------------------------------------------------
+// Error URI identifiers.
+//
+// Each error_uri maps to a stable RichUriId, being the 64-bit FNV-1a hash of
+// its text, so the same URI has the same id in every process and every
+// build.  Each RichExceptionNode records the id of its error_uri, so
+// exceptions can be classified by comparing integers rather than strings.
+// With C++11, rich_uri_id() is constexpr, so ids of literals can be used as
+// case labels and template arguments:
+//
+//      switch( e.main_error_uri_id() )
+//      {
+//      case rich_uri_id( "com.codalogic.file.noopen" ): ...
+//      }
+//
+// The constexpr form recurses once per character, so rich_uri_id() is only
+// for constants.  Ids of URIs known only at run time, such as those read
+// from a wire encoding, are computed with the iterative detail::hash_uri().
+//
+// RichUriRegistry records the text of URIs so ids can be turned back into
+// URIs, for example when reporting metrics keyed by id.
+//----------------------------------------------------------------------------
+
+typedef unsigned long long RichUriId;
+
+namespace detail {
+
+static const RichUriId fnv_offset_basis = 14695981039346656037ULL;
+static const RichUriId fnv_prime = 1099511628211ULL;
+
+inline RichUriId hash_uri( const char * p_uri )
+{
+    RichUriId hash = fnv_offset_basis;
+    if( p_uri )
+        for( ; *p_uri; ++p_uri )
+            hash = (hash ^ static_cast< unsigned char >( *p_uri )) * fnv_prime;
+    return hash;
+}
+
+#if defined( RICH_EXCEPTION_CXX11 )
+constexpr RichUriId constexpr_hash_uri( const char * p_uri, RichUriId hash )
+{
+    return *p_uri ? constexpr_hash_uri( p_uri + 1, (hash ^ static_cast< unsigned char >( *p_uri )) * fnv_prime ) : hash;
+}
+#endif
+
+}   // namespace detail
+
+#if defined( RICH_EXCEPTION_CXX11 )
+constexpr RichUriId rich_uri_id( const char * p_uri )
+{
+    return detail::constexpr_hash_uri( p_uri, detail::fnv_offset_basis );
+}
+#else
+inline RichUriId rich_uri_id( const char * p_uri )
+{
+    return detail::hash_uri( p_uri );
+}
+#endif
+
+#if defined( RICH_EXCEPTION_CXX11 )
+
+class RichUriRegistry
+{
+    // Thread-safe.  Interned URIs are copied, so dynamically built URIs
+    // need not outlive their registration.
+private:
+    mutable std::mutex mutex;
+    std::unordered_map< RichUriId, std::string > uris;
+    size_t n_collisions;
+
+public:
+    RichUriRegistry() : n_collisions( 0 ) {}
+
+    RichUriId intern( const char * p_uri )
+    {
+        RichUriId id = detail::hash_uri( p_uri );
+        std::lock_guard< std::mutex > lock( mutex );
+        std::pair< std::unordered_map< RichUriId, std::string >::iterator, bool > inserted =
+                uris.insert( std::make_pair( id, std::string( p_uri ) ) );
+        if( ! inserted.second && inserted.first->second != p_uri )
+            ++n_collisions;     // Two different URIs with the same id.  Very unlikely, but worth knowing about.
+        return id;
+    }
+    const char * find( RichUriId id ) const     // Returns 0 if id has not been interned
+    {
+        std::lock_guard< std::mutex > lock( mutex );
+        std::unordered_map< RichUriId, std::string >::const_iterator i = uris.find( id );
+        return i != uris.end() ? i->second.c_str() : 0;     // Safe as entries are never removed
+    }
+    size_t size() const
+    {
+        std::lock_guard< std::mutex > lock( mutex );
+        return uris.size();
+    }
+    size_t collisions() const
+    {
+        std::lock_guard< std::mutex > lock( mutex );
+        return n_collisions;
+    }
+
+    static RichUriRegistry & instance()
+    {
+        static RichUriRegistry registry;
+        return registry;
+    }
+};
+
+#endif
+
+//----------------------------------------------------------------------------
+// If RICH_EXCEPTION_INSTRUMENT is defined (C++11 or later is required), the
+// cost of constructing RichExceptions, calling add() on them, chaining them
+// to earlier exceptions and rendering them (via to_string() or operator <<)
+// is recorded for each main_error_uri().  The costs recorded are the number
+// of allocations and bytes obtained via rich_allocate() and the elapsed CPU
+// cycles (or nanoseconds where a cycle counter is not available).  For
+// example:
+//
+//      RichInstrumentation::instance().dump( std::cerr );
+//
+// When RICH_EXCEPTION_INSTRUMENT is not defined, none of this is compiled.
+//----------------------------------------------------------------------------
+
+#if defined( RICH_EXCEPTION_INSTRUMENT )
+
+enum RichInstrumentedOperation
+{
+    instrument_construct,
+    instrument_add,
+    instrument_chain,
+    instrument_render,
+    n_instrumented_operations
+};
+
+inline const char * instrumented_operation_name( RichInstrumentedOperation operation )
+{
+    static const char * const names[n_instrumented_operations] = { "construct", "add", "chain", "render" };
+    return names[operation];
+}
+
+struct RichOperationCost
+{
+    unsigned long long n_operations;
+    unsigned long long n_allocations;
+    unsigned long long n_bytes;
+    unsigned long long n_cycles;
+};
+
+struct RichInstrumentRecord
+{
+    std::string error_uri;
+    RichOperationCost costs[n_instrumented_operations];
+
+    const RichOperationCost & operator [] ( RichInstrumentedOperation operation ) const { return costs[operation]; }
+};
+
+class RichInstrumentation
+{
+    // Thread-safe.
+private:
+    mutable std::mutex mutex;
+    std::unordered_map< RichUriId, RichInstrumentRecord > records;
+
+public:
+    void record(
+            const char * p_error_uri,
+            RichInstrumentedOperation operation,
+            unsigned long long n_allocations,
+            unsigned long long n_bytes,
+            unsigned long long n_cycles )
+    {
+        std::lock_guard< std::mutex > lock( mutex );
+        std::unordered_map< RichUriId, RichInstrumentRecord >::iterator i = records.find( detail::hash_uri( p_error_uri ) );
+        if( i == records.end() )
+        {
+            RichInstrumentRecord new_record = RichInstrumentRecord();
+            new_record.error_uri = p_error_uri;
+            i = records.insert( std::make_pair( detail::hash_uri( p_error_uri ), new_record ) ).first;
+        }
+        RichOperationCost & r_cost( i->second.costs[operation] );
+        ++r_cost.n_operations;
+        r_cost.n_allocations += n_allocations;
+        r_cost.n_bytes += n_bytes;
+        r_cost.n_cycles += n_cycles;
+    }
+
+    std::vector< RichInstrumentRecord > snapshot() const     // Ordered by error URI
+    {
+        std::map< std::string, RichInstrumentRecord > ordered;
+        {
+            std::lock_guard< std::mutex > lock( mutex );
+            for( std::unordered_map< RichUriId, RichInstrumentRecord >::const_iterator i( records.begin() ), i_end( records.end() );
+                    i != i_end;
+                    ++i )
+                ordered.insert( std::make_pair( i->second.error_uri, i->second ) );
+        }
+        std::vector< RichInstrumentRecord > result;
+        result.reserve( ordered.size() );
+        for( std::map< std::string, RichInstrumentRecord >::const_iterator i( ordered.begin() ), i_end( ordered.end() );
+                i != i_end;
+                ++i )
+            result.push_back( i->second );
+        return result;
+    }
+
+    void reset()
+    {
+        std::lock_guard< std::mutex > lock( mutex );
+        records.clear();
+    }
+
+    // Writes one line per URI and operation performed, e.g.:
+    //      com.codalogic.nexp.file construct n=2 allocations=2 bytes=288 cycles=1470
+    void dump( std::ostream & os ) const
+    {
+        std::vector< RichInstrumentRecord > current( snapshot() );
+        for( size_t i = 0; i < current.size(); ++i )
+            for( int operation = 0; operation < n_instrumented_operations; ++operation )
+            {
+                const RichOperationCost & r_cost( current[i].costs[operation] );
+                if( r_cost.n_operations > 0 )
+                    os << current[i].error_uri << " " << instrumented_operation_name( static_cast< RichInstrumentedOperation >( operation ) ) <<
+                            " n=" << r_cost.n_operations <<
+                            " allocations=" << r_cost.n_allocations <<
+                            " bytes=" << r_cost.n_bytes <<
+                            " cycles=" << r_cost.n_cycles << "\n";
+            }
+    }
+
+    static RichInstrumentation & instance()
+    {
+        static RichInstrumentation instrumentation;
+        return instrumentation;
+    }
+};
+
+namespace detail {
+
+inline unsigned long long rich_cycles()
+{
+#if defined( RICH_EXCEPTION_HAS_RDTSC )
+    return __rdtsc();
+#else
+    return static_cast< unsigned long long >( std::chrono::duration_cast< std::chrono::nanoseconds >(
+            std::chrono::steady_clock::now().time_since_epoch() ).count() );
+#endif
+}
+
+class RichInstrumentScope
+{
+private:
+    RichAllocationCounts at_start;
+    unsigned long long cycles_at_start;
+
+public:
+    RichInstrumentScope() : at_start( this_thread_allocation_counts() ), cycles_at_start( rich_cycles() ) {}
+
+    void finish( RichInstrumentedOperation operation, const char * p_error_uri ) const
+    {
+        unsigned long long n_cycles = rich_cycles() - cycles_at_start;
+        const RichAllocationCounts & r_now( this_thread_allocation_counts() );
+        RichInstrumentation::instance().record( p_error_uri, operation,
+                r_now.n_allocations - at_start.n_allocations,
+                r_now.n_bytes - at_start.n_bytes,
+                n_cycles );
+    }
+};
+
+}   // namespace detail
+
+#define RICH_EXCEPTION_INSTRUMENT_BEGIN() detail::RichInstrumentScope rich_instrument_scope
+#define RICH_EXCEPTION_INSTRUMENT_END( operation, p_error_uri ) rich_instrument_scope.finish( operation, p_error_uri )
+
+#else
+
+#define RICH_EXCEPTION_INSTRUMENT_BEGIN()
+#define RICH_EXCEPTION_INSTRUMENT_END( operation, p_error_uri ) ((void)0)
+
+#endif
+
+//----------------------------------------------------------------------------
+// If RICH_EXCEPTION_STATS is defined (C++11 or later is required), every
+// RichExceptionNode that is constructed is counted against its error URI as
+// "raised", and every exception that becomes the cause of a new exception
+// is counted as "wrapped".  Each thread counts into its own shard, so
+// counting takes no locks and threads do not contend on shared cache lines.
+// A shard is handed on to a new thread when its thread exits, so counts are
+// never lost.
+//
+// RichExceptionStats::snapshot() merges the shards, e.g.:
+//
+//      RichExceptionStats before( RichExceptionStats::snapshot() );
+//      ...
+//      std::vector< RichUriCount > worst( RichExceptionStats::snapshot().since( before ).top( 10 ) );
+//
+// Each shard tracks up to RICH_EXCEPTION_STATS_SHARD_CAPACITY distinct URIs.
+// Exceptions with further URIs are only counted in untracked().
+//----------------------------------------------------------------------------
+
+#if defined( RICH_EXCEPTION_STATS )
+
+struct RichUriCount
+{
+    const char * error_uri;
+    RichUriId error_uri_id;
+    unsigned long long n_raised;
+    unsigned long long n_wrapped;
+};
+
+namespace detail {
+
+class RichStatsShard
+{
+    // Only the thread owning a shard writes to it, so counters are updated
+    // with plain loads and stores rather than locked read-modify-writes.
+    // Other threads may read it at any time.
+public:
+    static const size_t capacity = RICH_EXCEPTION_STATS_SHARD_CAPACITY;
+
+private:
+    struct Slot
+    {
+        std::atomic< RichUriId > error_uri_id;     // 0 marks an empty slot
+        std::atomic< const char * > p_error_uri;
+        std::atomic< unsigned long long > n_raised;
+        std::atomic< unsigned long long > n_wrapped;
+    };
+
+    Slot slots[capacity];
+    std::atomic< unsigned long long > n_untracked;
+
+public:
+    std::atomic< bool > is_owned;
+    RichStatsShard * p_next;    // Protected by RichStatsRegistry
+
+    RichStatsShard() : n_untracked( 0 ), is_owned( true ), p_next( 0 )
+    {
+        for( size_t i = 0; i < capacity; ++i )
+        {
+            slots[i].error_uri_id.store( 0, std::memory_order_relaxed );
+            slots[i].p_error_uri.store( 0, std::memory_order_relaxed );
+            slots[i].n_raised.store( 0, std::memory_order_relaxed );
+            slots[i].n_wrapped.store( 0, std::memory_order_relaxed );
+        }
+    }
+
+    void count( const char * p_error_uri, RichUriId error_uri_id, bool is_raised )
+    {
+        if( error_uri_id == 0 )
+            error_uri_id = 1;
+        size_t i_slot = static_cast< size_t >( error_uri_id ) & (capacity - 1);
+        for( size_t n_probes = 0; n_probes < capacity; ++n_probes, i_slot = (i_slot + 1) & (capacity - 1) )
+        {
+            Slot & r_slot( slots[i_slot] );
+            RichUriId slot_id = r_slot.error_uri_id.load( std::memory_order_relaxed );
+            if( slot_id == 0 )
+            {
+                r_slot.p_error_uri.store( p_error_uri, std::memory_order_relaxed );
+                r_slot.error_uri_id.store( error_uri_id, std::memory_order_release );
+                slot_id = error_uri_id;
+            }
+            if( slot_id == error_uri_id )
+            {
+                bump( is_raised ? r_slot.n_raised : r_slot.n_wrapped );
+                return;
+            }
+        }
+        bump( n_untracked );
+    }
+
+    template< typename Tvisitor >
+    void visit( Tvisitor & r_visitor ) const
+    {
+        for( size_t i = 0; i < capacity; ++i )
+        {
+            const Slot & r_slot( slots[i] );
+            RichUriId slot_id = r_slot.error_uri_id.load( std::memory_order_acquire );
+            if( slot_id != 0 )
+            {
+                RichUriCount count = {
+                        r_slot.p_error_uri.load( std::memory_order_relaxed ),
+                        slot_id,
+                        r_slot.n_raised.load( std::memory_order_relaxed ),
+                        r_slot.n_wrapped.load( std::memory_order_relaxed ) };
+                r_visitor.add( count );
+            }
+        }
+        r_visitor.add_untracked( n_untracked.load( std::memory_order_relaxed ) );
+    }
+
+private:
+    static void bump( std::atomic< unsigned long long > & r_counter )
+    {
+        r_counter.store( r_counter.load( std::memory_order_relaxed ) + 1, std::memory_order_relaxed );
+    }
+};
+
+class RichStatsRegistry
+{
+    // The mutex is only taken when a thread first counts an exception, when
+    // a thread exits and when a snapshot is taken.  Shards are never freed.
+private:
+    std::mutex mutex;
+    RichStatsShard * p_shards;
+
+public:
+    RichStatsRegistry() : p_shards( 0 ) {}
+
+    RichStatsShard * acquire()
+    {
+        std::lock_guard< std::mutex > lock( mutex );
+        for( RichStatsShard * p_shard = p_shards; p_shard; p_shard = p_shard->p_next )
+            if( ! p_shard->is_owned.load( std::memory_order_acquire ) )
+            {
+                p_shard->is_owned.store( true, std::memory_order_relaxed );
+                return p_shard;
+            }
+        RichStatsShard * p_shard = new RichStatsShard;
+        p_shard->p_next = p_shards;
+        p_shards = p_shard;
+        return p_shard;
+    }
+    void release( RichStatsShard * p_shard )
+    {
+        std::lock_guard< std::mutex > lock( mutex );
+        p_shard->is_owned.store( false, std::memory_order_release );
+    }
+
+    template< typename Tvisitor >
+    void visit( Tvisitor & r_visitor )
+    {
+        std::lock_guard< std::mutex > lock( mutex );
+        for( const RichStatsShard * p_shard = p_shards; p_shard; p_shard = p_shard->p_next )
+            p_shard->visit( r_visitor );
+    }
+
+    static RichStatsRegistry & instance()
+    {
+        // Deliberately leaked so that threads exiting during static
+        // destruction can still release their shards
+        static RichStatsRegistry * p_registry = new RichStatsRegistry;
+        return *p_registry;
+    }
+};
+
+class RichStatsShardOwner
+{
+private:
+    RichStatsShard * p_shard;
+
+public:
+    RichStatsShardOwner() : p_shard( RichStatsRegistry::instance().acquire() ) {}
+    ~RichStatsShardOwner() { RichStatsRegistry::instance().release( p_shard ); }
+
+    RichStatsShard & shard() { return *p_shard; }
+};
+
+inline void count_uri( const char * p_error_uri, RichUriId error_uri_id, bool is_raised )
+{
+    static thread_local RichStatsShardOwner owner;
+    owner.shard().count( p_error_uri, error_uri_id, is_raised );
+}
+
+}   // namespace detail
+
+class RichExceptionStats
+{
+    // A snapshot of the counts, ordered by error URI id
+private:
+    std::vector< RichUriCount > uri_counts;
+    unsigned long long n_untracked;
+
+    struct Merger
+    {
+        std::unordered_map< RichUriId, RichUriCount > merged;
+        unsigned long long n_untracked;
+
+        Merger() : n_untracked( 0 ) {}
+
+        void add( const RichUriCount & r_count )
+        {
+            std::pair< std::unordered_map< RichUriId, RichUriCount >::iterator, bool > inserted =
+                    merged.insert( std::make_pair( r_count.error_uri_id, r_count ) );
+            if( ! inserted.second )
+            {
+                inserted.first->second.n_raised += r_count.n_raised;
+                inserted.first->second.n_wrapped += r_count.n_wrapped;
+            }
+        }
+        void add_untracked( unsigned long long n ) { n_untracked += n; }
+
+        void store( RichExceptionStats * p_stats ) const
+        {
+            p_stats->uri_counts.clear();
+            p_stats->uri_counts.reserve( merged.size() );
+            for( std::unordered_map< RichUriId, RichUriCount >::const_iterator i( merged.begin() ), i_end( merged.end() );
+                    i != i_end;
+                    ++i )
+                p_stats->uri_counts.push_back( i->second );
+            std::sort( p_stats->uri_counts.begin(), p_stats->uri_counts.end(), has_lower_id );
+            p_stats->n_untracked = n_untracked;
+        }
+    };
+
+    static bool has_lower_id( const RichUriCount & r_lhs, const RichUriCount & r_rhs )
+    {
+        return r_lhs.error_uri_id < r_rhs.error_uri_id;
+    }
+    static bool is_raised_more( const RichUriCount & r_lhs, const RichUriCount & r_rhs )
+    {
+        if( r_lhs.n_raised != r_rhs.n_raised )
+            return r_lhs.n_raised > r_rhs.n_raised;
+        return r_lhs.n_wrapped > r_rhs.n_wrapped;
+    }
+
+public:
+    RichExceptionStats() : n_untracked( 0 ) {}
+
+    static RichExceptionStats snapshot()
+    {
+        Merger merger;
+        detail::RichStatsRegistry::instance().visit( merger );
+        RichExceptionStats stats;
+        merger.store( &stats );
+        return stats;
+    }
+
+    const std::vector< RichUriCount > & counts() const { return uri_counts; }
+    unsigned long long untracked() const { return n_untracked; }
+
+    const RichUriCount * find( RichUriId error_uri_id ) const     // Returns 0 if not counted
+    {
+        RichUriCount key = RichUriCount();
+        key.error_uri_id = error_uri_id ? error_uri_id : 1;
+        std::vector< RichUriCount >::const_iterator i =
+                std::lower_bound( uri_counts.begin(), uri_counts.end(), key, has_lower_id );
+        return i != uri_counts.end() && i->error_uri_id == key.error_uri_id ? &*i : 0;
+    }
+    unsigned long long raised( RichUriId error_uri_id ) const
+    {
+        const RichUriCount * p_count = find( error_uri_id );
+        return p_count ? p_count->n_raised : 0;
+    }
+    unsigned long long wrapped( RichUriId error_uri_id ) const
+    {
+        const RichUriCount * p_count = find( error_uri_id );
+        return p_count ? p_count->n_wrapped : 0;
+    }
+
+    RichExceptionStats & merge( const RichExceptionStats & r_other )   // e.g. to combine snapshots from several processes
+    {
+        Merger merger;
+        for( size_t i = 0; i < uri_counts.size(); ++i )
+            merger.add( uri_counts[i] );
+        for( size_t i = 0; i < r_other.uri_counts.size(); ++i )
+            merger.add( r_other.uri_counts[i] );
+        merger.add_untracked( n_untracked + r_other.n_untracked );
+        merger.store( this );
+        return *this;
+    }
+
+    RichExceptionStats since( const RichExceptionStats & r_earlier ) const    // The counts made after r_earlier was taken
+    {
+        RichExceptionStats delta;
+        for( size_t i = 0; i < uri_counts.size(); ++i )
+        {
+            RichUriCount count = uri_counts[i];
+            if( const RichUriCount * p_earlier = r_earlier.find( count.error_uri_id ) )
+            {
+                count.n_raised -= p_earlier->n_raised;
+                count.n_wrapped -= p_earlier->n_wrapped;
+            }
+            if( count.n_raised > 0 || count.n_wrapped > 0 )
+                delta.uri_counts.push_back( count );
+        }
+        delta.n_untracked = n_untracked - r_earlier.n_untracked;
+        return delta;
+    }
+
+    std::vector< RichUriCount > top( size_t n ) const     // The n most raised URIs, most raised first
+    {
+        std::vector< RichUriCount > result( uri_counts );
+        n = (std::min)( n, result.size() );
+        std::partial_sort( result.begin(), result.begin() + n, result.end(), is_raised_more );
+        result.resize( n );
+        return result;
+    }
+};
+
+#define RICH_EXCEPTION_STATS_COUNT( r_node, is_raised ) detail::count_uri( (r_node).error_uri, (r_node).error_uri_id, is_raised )
+
+#else
+
+#define RICH_EXCEPTION_STATS_COUNT( r_node, is_raised ) ((void)0)
+
+#endif
+
+//----------------------------------------------------------------------------
+// By default, built-in parameter values are captured in their native form
+// and only converted to text when the text is asked for.  Defining
+// RICH_EXCEPTION_EAGER_FORMAT formats all values when they are added.
+//
+// Small user types can also be captured natively by specialising
+// RichLazyCapture.  Only do this for trivially copyable types of at most
+// max_lazy_capture_size bytes whose operator << does not depend on anything
+// the value refers to, e.g.:
+//
+//      namespace rich_excep {
+//      template<> struct RichLazyCapture< Point > { enum { enabled = true }; };
+//      }
+//
+// Text with static storage duration can be recorded without copying it by
+// wrapping it in rich_literal().
+//----------------------------------------------------------------------------
+
+static const size_t max_lazy_capture_size = 16;
+
+template< typename T >
+struct RichLazyCapture
+{
+    enum { enabled = false };
+};
+
+struct RichLiteral
+{
+    const char * text;
+    size_t length;
+};
+
+inline RichLiteral rich_literal( const char * p_text ) { RichLiteral literal = { p_text, strlen( p_text ) }; return literal; }
+inline RichLiteral rich_literal( const char * p_text, size_t length ) { RichLiteral literal = { p_text, length }; return literal; }
+
+class RichExceptionValue
+{
+    // Holds a parameter value either as text or, until its text is asked
+    // for, as the native value it was created from.  Text of up to
+    // inline_capacity characters is stored within the object itself; longer
+    // text is allocated via rich_allocate().
+    //
+    // A RichExceptionValue is never modified by reading it, so const
+    // instances can be safely read from multiple threads.
+    //
+    // RichExceptionParameter::value used to be a std::string.  A
+    // RichExceptionValue converts to a std::string, and has the empty(),
+    // size(), length() and comparison members of one, but not c_str() or
+    // data(): a value held natively has no text to point to until it is
+    // formatted, and formatting it on reading would modify it.  Use str()
+    // for those, e.g. r_param.value.str().c_str().
+public:
+    static const size_t inline_capacity = detail::max_fast_format_size;
+
+private:
+    union
+    {
+        char inline_text[inline_capacity + 1];
+        char * p_text;
+        const char * p_literal;
+        long long signed_value;
+        unsigned long long unsigned_value;
+        double double_value;
+        bool bool_value;
+        char char_value;
+        const void * pointer_value;
+        struct
+        {
+            union
+            {
+                unsigned char bytes[max_lazy_capture_size];
+                double d_align;
+                void * p_align;
+                long long ll_align;
+            } value;
+            void (* p_stream)( std::ostream &, const void * );
+        } user;
+    } storage;
+    unsigned int text_size;    // Of the text for value_text and value_literal kinds
+    unsigned char kind;
+
+    bool is_allocated() const { return kind == detail::value_text && text_size > inline_capacity; }
+
+    void assign( const char * p_text_in, size_t length_in )
+    {
+        kind = detail::value_text;
+        text_size = static_cast< unsigned int >( length_in );
+        char * p_to = storage.inline_text;
+        if( is_allocated() )
+            p_to = storage.p_text = static_cast< char * >( detail::rich_allocate( text_size + 1 ) );
+        memcpy( p_to, p_text_in, text_size );
+        p_to[text_size] = '\0';
+    }
+    void assign_c_string( const char * p_text_in ) { assign( p_text_in ? p_text_in : "", p_text_in ? strlen( p_text_in ) : 0 ); }
+    template< typename T >
+    void assign_formatted( const T & value_in, detail::RichBoolType< true > )
+    {
+#if ! defined( RICH_EXCEPTION_EAGER_FORMAT )
+        assign_fast( value_in, detail::RichBoolType< static_cast< int >( detail::RichFastFormat< T >::kind ) != detail::value_text >() );
+#else
+        assign_fast( value_in, detail::RichBoolType< false >() );
+#endif
+    }
+    template< typename T >
+    void assign_fast( const T & value_in, detail::RichBoolType< true > )
+    {
+        kind = static_cast< unsigned char >( detail::RichFastFormat< T >::kind );
+        capture( static_cast< typename detail::RichFastFormat< T >::capture_type >( value_in ) );
+    }
+    template< typename T >
+    void assign_fast( const T & value_in, detail::RichBoolType< false > )
+    {
+        kind = detail::value_text;
+        text_size = static_cast< unsigned int >( detail::RichFastFormat< T >::format( storage.inline_text, value_in ) );
+        storage.inline_text[text_size] = '\0';
+    }
+    template< typename T >
+    void assign_formatted( const T & value_in, detail::RichBoolType< false > )
+    {
+        assign_user( value_in, detail::RichBoolType< RichLazyCapture< T >::enabled >() );
+    }
+    template< typename T >
+    void assign_user( const T & value_in, detail::RichBoolType< true > )
+    {
+#if defined( RICH_EXCEPTION_CXX11 )
+        static_assert( std::is_trivially_copyable< T >::value, "RichLazyCapture may only be enabled for trivially copyable types" );
+#endif
+        typedef char value_must_fit[sizeof( T ) <= max_lazy_capture_size ? 1 : -1];
+        (void)sizeof( value_must_fit );
+#if ! defined( RICH_EXCEPTION_EAGER_FORMAT )
+        kind = detail::value_user;
+        memcpy( storage.user.value.bytes, &value_in, sizeof( T ) );
+        storage.user.p_stream = &detail::stream_user_value< T >;
+#else
+        assign_user( value_in, detail::RichBoolType< false >() );
+#endif
+    }
+    template< typename T >
+    void assign_user( const T & value_in, detail::RichBoolType< false > )
+    {
+        std::ostringstream ss;
+        ss << value_in;
+        const std::string & r_text( ss.str() );
+        assign( r_text.data(), r_text.size() );
+    }
+    void capture( long long value_in ) { storage.signed_value = value_in; }
+    void capture( unsigned long long value_in ) { storage.unsigned_value = value_in; }
+    void capture( double value_in ) { storage.double_value = value_in; }
+    void capture( bool value_in ) { storage.bool_value = value_in; }
+    void capture( char value_in ) { storage.char_value = value_in; }
+    void capture( const void * value_in ) { storage.pointer_value = value_in; }
+
+    void release()
+    {
+        if( is_allocated() )
+            detail::rich_deallocate( storage.p_text );
+    }
+
+public:
+    RichExceptionValue() : text_size( 0 ), kind( detail::value_text ) { storage.inline_text[0] = '\0'; }
+    RichExceptionValue( const char * p_text_in, size_t length_in ) { assign( p_text_in, length_in ); }
+    RichExceptionValue( const std::string & r_value_in ) { assign( r_value_in.data(), r_value_in.size() ); }
+    RichExceptionValue( const char * p_text_in ) { assign_c_string( p_text_in ); }
+    RichExceptionValue( char * p_text_in ) { assign_c_string( p_text_in ); }
+    RichExceptionValue( const signed char * p_text_in ) { assign_c_string( reinterpret_cast< const char * >( p_text_in ) ); }
+    RichExceptionValue( signed char * p_text_in ) { assign_c_string( reinterpret_cast< const char * >( p_text_in ) ); }
+    RichExceptionValue( const unsigned char * p_text_in ) { assign_c_string( reinterpret_cast< const char * >( p_text_in ) ); }
+    RichExceptionValue( unsigned char * p_text_in ) { assign_c_string( reinterpret_cast< const char * >( p_text_in ) ); }
+    RichExceptionValue( RichLiteral literal_in )
+        :
+        text_size( static_cast< unsigned int >( literal_in.length ) ),
+        kind( detail::value_literal )
+    {
+        storage.p_literal = literal_in.text;
+    }
+    template< typename T >
+    explicit RichExceptionValue( const T & value_in )
+    {
+        assign_formatted( value_in, detail::RichBoolType< detail::RichFastFormat< T >::is_fast >() );
+    }
+    RichExceptionValue( const RichExceptionValue & r_rhs )
+    {
+        if( r_rhs.is_allocated() )
+            assign( r_rhs.storage.p_text, r_rhs.text_size );
+        else
+        {
+            storage = r_rhs.storage;
+            text_size = r_rhs.text_size;
+            kind = r_rhs.kind;
+        }
+    }
+    RichExceptionValue & operator = ( const RichExceptionValue & r_rhs )
+    {
+        if( this != &r_rhs )
+        {
+            RichExceptionValue copy( r_rhs );
+            swap( copy );
+        }
+        return *this;
+    }
+#if defined( RICH_EXCEPTION_CXX11 )
+    RichExceptionValue( RichExceptionValue && r_rhs ) noexcept
+        :
+        storage( r_rhs.storage ),
+        text_size( r_rhs.text_size ),
+        kind( r_rhs.kind )
+    {
+        r_rhs.kind = detail::value_text;
+        r_rhs.text_size = 0;
+    }
+    RichExceptionValue & operator = ( RichExceptionValue && r_rhs ) noexcept
+    {
+        swap( r_rhs );
+        return *this;
+    }
+#endif
+    ~RichExceptionValue() { release(); }
+
+    void swap( RichExceptionValue & r_rhs )
+    {
+        std::swap( storage, r_rhs.storage );
+        std::swap( text_size, r_rhs.text_size );
+        std::swap( kind, r_rhs.kind );
+    }
+
+    // The native form of the value.  Values of kind value_user have no text
+    // until streamed.
+    detail::RichValueKind native_kind() const { return static_cast< detail::RichValueKind >( kind ); }
+    bool has_text() const { return kind != detail::value_user; }
+
+    // Returns the text of the value and sets r_length to its length.  Values
+    // held natively are formatted into p_scratch, which must be at least
+    // inline_capacity characters long.  Does not allocate memory.  Must not
+    // be called unless has_text() is true.
+    const char * text( char * p_scratch, size_t & r_length ) const
+    {
+        switch( kind )
+        {
+        case detail::value_text:
+            r_length = text_size;
+            return is_allocated() ? storage.p_text : storage.inline_text;
+        case detail::value_literal:
+            r_length = text_size;
+            return storage.p_literal;
+        case detail::value_signed: r_length = detail::format_signed( p_scratch, storage.signed_value ); break;
+        case detail::value_unsigned: r_length = detail::format_unsigned( p_scratch, storage.unsigned_value ); break;
+        case detail::value_double: r_length = detail::format_double( p_scratch, storage.double_value ); break;
+        case detail::value_bool: r_length = detail::format_bool( p_scratch, storage.bool_value ); break;
+        case detail::value_char: r_length = detail::format_char( p_scratch, storage.char_value ); break;
+        case detail::value_pointer: r_length = detail::format_pointer( p_scratch, storage.pointer_value ); break;
+        default:
+            assert( false );
+            r_length = 0;
+        }
+        return p_scratch;
+    }
+
+    bool empty() const { return size() == 0; }
+    size_t length() const { return size(); }
+    size_t size() const
+    {
+        if( ! has_text() )
+            return str().size();
+        char scratch[inline_capacity];
+        size_t text_length;
+        text( scratch, text_length );
+        return text_length;
+    }
+    std::string str() const
+    {
+        if( ! has_text() )
+        {
+            std::ostringstream ss;
+            ss << *this;
+            return ss.str();
+        }
+        char scratch[inline_capacity];
+        size_t text_length;
+        const char * p_text = text( scratch, text_length );
+        return std::string( p_text, text_length );
+    }
+    operator std::string () const { return str(); }
+
+    bool equals( const char * p_text_in, size_t length_in ) const
+    {
+        if( ! has_text() )
+            return str() == std::string( p_text_in, length_in );
+        char scratch[inline_capacity];
+        size_t text_length;
+        const char * p_text = text( scratch, text_length );
+        return text_length == length_in && memcmp( p_text, p_text_in, text_length ) == 0;
+    }
+
+    friend bool operator == ( const RichExceptionValue & r_lhs, const RichExceptionValue & r_rhs )
+    {
+        const std::string & r_rhs_text( r_rhs.str() );
+        return r_lhs.equals( r_rhs_text.data(), r_rhs_text.size() );
+    }
+    friend bool operator == ( const RichExceptionValue & r_lhs, const char * p_rhs )
+        { return r_lhs.equals( p_rhs, strlen( p_rhs ) ); }
+    friend bool operator == ( const char * p_lhs, const RichExceptionValue & r_rhs )
+        { return r_rhs.equals( p_lhs, strlen( p_lhs ) ); }
+    friend bool operator == ( const RichExceptionValue & r_lhs, const std::string & r_rhs )
+        { return r_lhs.equals( r_rhs.data(), r_rhs.size() ); }
+    friend bool operator == ( const std::string & r_lhs, const RichExceptionValue & r_rhs )
+        { return r_rhs.equals( r_lhs.data(), r_lhs.size() ); }
+    template< typename T >
+    friend bool operator != ( const RichExceptionValue & r_lhs, const T & r_rhs ) { return ! (r_lhs == r_rhs); }
+
+    friend std::ostream & operator << ( std::ostream & os, const RichExceptionValue & r_value )
+    {
+        if( ! r_value.has_text() )
+        {
+            r_value.storage.user.p_stream( os, r_value.storage.user.value.bytes );
+            return os;
+        }
+        char scratch[inline_capacity];
+        size_t text_length;
+        const char * p_text = r_value.text( scratch, text_length );
+        os.write( p_text, text_length );
+        return os;
+    }
+};
+
 struct RichExceptionParameter
 {
     // RichExceptionParameter ends up being immutable because it can only be accessed by const reference.
 
     const char * name;
-    std::string value;
+    RichExceptionValue value;
 
     RichExceptionParameter(
             const char * const name_in,
-            const std::string value_in )
+            const std::string & value_in )
         :
         name( name_in ),
         value( value_in )
     {}
+    RichExceptionParameter(
+            const char * const name_in,
+            const RichExceptionValue & value_in )
+        :
+        name( name_in ),
+        value( value_in )
+    {}
+#if defined( RICH_EXCEPTION_CXX11 )
+    RichExceptionParameter(
+            const char * const name_in,
+            RichExceptionValue && value_in )
+        :
+        name( name_in ),
+        value( std::move( value_in ) )
+    {}
+#endif
+
+    friend std::ostream & operator << ( std::ostream & os, const RichExceptionParameter & r_params )
+    {
+        os << r_params.name << ": " << r_params.value;
+        return os;
+    }
+};
+
+class RichExceptionParams
+{
+    // The first inline_capacity parameters are stored within the object
+    // itself.  Only if more are added is an array allocated via
+    // rich_allocate().
+    //
+    // Names are compared by pointer before being compared by strcmp(), as
+    // they are usually string literals.  Once there are more than
+    // index_threshold parameters, a hash index of the names is maintained
+    // as parameters are added, so has() and get() no longer need to compare
+    // against every name.
+public:
+    static const size_t inline_capacity = 4;
+    static const size_t index_threshold = 8;
+
+private:
+    struct IndexSlot
+    {
+        unsigned int name_hash;
+        unsigned int param;     // Index of parameter + 1, or 0 if the slot is unused
+    };
+
+    size_t n_params;
+    size_t capacity;
+    RichExceptionParameter * p_params;  // Either inline_params() or an allocated array
+    IndexSlot * p_index;                // Open addressed hash table, or 0 if not indexed
+    size_t index_capacity;              // A power of 2
+    union
+    {
+        char bytes[inline_capacity * sizeof( RichExceptionParameter )];
+        void * p_align;
+        double d_align;
+    } inline_storage;
+
+    RichExceptionParameter * inline_params() { return reinterpret_cast< RichExceptionParameter * >( inline_storage.bytes ); }
+    bool is_inline() const { return capacity == inline_capacity; }
+
+    void append( const char * const name_in, const RichExceptionValue & value_in )
+    {
+        if( n_params == capacity )
+            grow();
+        new( p_params + n_params ) RichExceptionParameter( name_in, value_in );
+        appended();
+    }
+#if defined( RICH_EXCEPTION_CXX11 )
+    void append( const char * const name_in, RichExceptionValue && value_in )
+    {
+        if( n_params == capacity )
+            grow();
+        new( p_params + n_params ) RichExceptionParameter( name_in, std::move( value_in ) );
+        appended();
+    }
+#endif
+    void appended()
+    {
+        ++n_params;
+        if( p_index && n_params * 2 <= index_capacity )
+            index_insert( n_params - 1 );
+        else if( n_params > index_threshold )
+            rebuild_index();
+    }
+
+    static bool names_match( const char * p_lhs, const char * p_rhs )
+    {
+        return p_lhs == p_rhs || strcmp( p_lhs, p_rhs ) == 0;
+    }
+    static unsigned int hash_name( const char * p_name )
+    {
+        RichUriId hash = detail::hash_uri( p_name );
+        return static_cast< unsigned int >( hash ^ (hash >> 32) );
+    }
+    void index_insert( size_t param )
+    {
+        unsigned int name_hash = hash_name( p_params[param].name );
+        size_t slot = name_hash & (index_capacity - 1);
+        while( p_index[slot].param )
+            slot = (slot + 1) & (index_capacity - 1);
+        p_index[slot].name_hash = name_hash;
+        p_index[slot].param = static_cast< unsigned int >( param + 1 );
+    }
+    void rebuild_index()
+    {
+        size_t new_index_capacity = p_index ? index_capacity * 2 : 32;
+        while( new_index_capacity < n_params * 2 )
+            new_index_capacity *= 2;
+        release_index();
+        try
+        {
+            p_index = static_cast< IndexSlot * >( detail::rich_allocate( new_index_capacity * sizeof( IndexSlot ) ) );
+        }
+        catch( std::bad_alloc & )
+        {
+            return;     // The index is only an optimisation, so carry on without it
+        }
+        index_capacity = new_index_capacity;
+        memset( p_index, 0, index_capacity * sizeof( IndexSlot ) );
+        for( size_t i = 0; i < n_params; ++i )   // In order, so that with duplicate names the first is found first
+            index_insert( i );
+    }
+    void release_index()
+    {
+        if( p_index )
+            detail::rich_deallocate( p_index );
+        p_index = 0;
+        index_capacity = 0;
+    }
 
-    friend std::ostream & operator << ( std::ostream & os, const RichExceptionParameter & r_params )
+    const RichExceptionParameter * find( const char * name_in ) const
     {
-        os << r_params.name << ": " << r_params.value;
-        return os;
+        if( p_index )
+        {
+            unsigned int name_hash = hash_name( name_in );
+            for( size_t slot = name_hash & (index_capacity - 1);
+                    p_index[slot].param;
+                    slot = (slot + 1) & (index_capacity - 1) )
+            {
+                const RichExceptionParameter * p_param = p_params + p_index[slot].param - 1;
+                if( p_index[slot].name_hash == name_hash && names_match( name_in, p_param->name ) )
+                    return p_param;
+            }
+            return 0;
+        }
+        const RichExceptionParameter * p_found = std::find_if( p_params, p_params + n_params, find_name_predicate( name_in ) );
+        return p_found != p_params + n_params ? p_found : 0;
+    }
+    void grow()
+    {
+        size_t new_capacity = capacity * 2;
+        RichExceptionParameter * p_new_params = static_cast< RichExceptionParameter * >(
+                detail::rich_allocate( new_capacity * sizeof( RichExceptionParameter ) ) );
+        size_t n_copied = 0;
+        try
+        {
+            for( ; n_copied < n_params; ++n_copied )
+                new( p_new_params + n_copied ) RichExceptionParameter( RICH_EXCEPTION_MOVE( p_params[n_copied] ) );
+        }
+        catch( ... )
+        {
+            destroy( p_new_params, n_copied );
+            detail::rich_deallocate( p_new_params );
+            throw;
+        }
+        release();
+        p_params = p_new_params;
+        capacity = new_capacity;
+    }
+    static void destroy( RichExceptionParameter * p_first, size_t n )
+    {
+        for( size_t i = 0; i < n; ++i )
+            p_first[i].~RichExceptionParameter();
+    }
+    void release()
+    {
+        destroy( p_params, n_params );
+        if( ! is_inline() )
+            detail::rich_deallocate( p_params );
+    }
+    void reset()
+    {
+        n_params = 0;
+        capacity = inline_capacity;
+        p_params = inline_params();
+        p_index = 0;
+        index_capacity = 0;
     }
-};
 
-class RichExceptionParams
-{
-private:
-    typedef std::vector< RichExceptionParameter > params_t;
-    params_t params;
+    void take( RichExceptionParams & r_rhs ) RICH_EXCEPTION_NOEXCEPT    // Requires this to be empty
+    {
+        if( r_rhs.is_inline() )
+        {
+            for( size_t i = 0; i < r_rhs.n_params; ++i )
+            {
+#if defined( RICH_EXCEPTION_CXX11 )
+                new( p_params + i ) RichExceptionParameter( std::move( r_rhs.p_params[i] ) );
+#else
+                new( p_params + i ) RichExceptionParameter( r_rhs.p_params[i].name, RichExceptionValue() );
+                p_params[i].value.swap( r_rhs.p_params[i].value );
+#endif
+            }
+            n_params = r_rhs.n_params;
+            r_rhs.release();
+        }
+        else
+        {
+            n_params = r_rhs.n_params;
+            capacity = r_rhs.capacity;
+            p_params = r_rhs.p_params;
+            p_index = r_rhs.p_index;
+            index_capacity = r_rhs.index_capacity;
+        }
+        r_rhs.reset();
+    }
 
 public:
-    RichExceptionParams() {}
+    RichExceptionParams() { reset(); }
     RichExceptionParams(
             const char * const name_in,
             const std::string & value_in )
     {
+        reset();
         add( name_in, value_in );
     }
     template< typename T >
@@ -87,105 +1716,754 @@ public:
             const char * const name_in,
             const T & value_in )
     {
+        reset();
         add( name_in, value_in );
     }
+    RichExceptionParams( const RichExceptionParams & r_rhs )
+    {
+        reset();
+        try
+        {
+            for( size_t i = 0; i < r_rhs.n_params; ++i )
+                append( r_rhs.p_params[i].name, r_rhs.p_params[i].value );
+        }
+        catch( ... )
+        {
+            release();
+            release_index();
+            throw;
+        }
+    }
+    RichExceptionParams & operator = ( const RichExceptionParams & r_rhs )
+    {
+        if( this != &r_rhs )
+        {
+            RichExceptionParams copy( r_rhs );  // If this throws, *this is unchanged
+            release();
+            release_index();
+            reset();
+            take( copy );
+        }
+        return *this;
+    }
+#if defined( RICH_EXCEPTION_CXX11 )
+    RichExceptionParams( RichExceptionParams && r_rhs ) noexcept
+    {
+        reset();
+        take( r_rhs );
+    }
+    RichExceptionParams & operator = ( RichExceptionParams && r_rhs ) noexcept
+    {
+        if( this != &r_rhs )
+        {
+            release();
+            release_index();
+            reset();
+            take( r_rhs );
+        }
+        return *this;
+    }
+#endif
+    ~RichExceptionParams()
+    {
+        release();
+        release_index();
+    }
 
+    // With C++11, add() on a temporary returns an rvalue so that the
+    // parameters can be moved rather than copied into a RichException.
     RichExceptionParams & add(
             const char * const name_in,
-            const std::string & value_in )
+            const std::string & value_in ) RICH_EXCEPTION_LVALUE_QUALIFIER
     {
-        params.push_back( RichExceptionParameter( name_in, value_in ) );
+        append( name_in, RichExceptionValue( value_in ) );
         return *this;
     }
     template< typename T >
     RichExceptionParams & add(
             const char * const name_in,
-            const T & value_in )
+            const T & value_in ) RICH_EXCEPTION_LVALUE_QUALIFIER
     {
-        std::stringstream ss;
-        ss << value_in;
-        params.push_back( RichExceptionParameter( name_in, ss.str() ) );
+        append( name_in, RichExceptionValue( value_in ) );
         return *this;
     }
+#if defined( RICH_EXCEPTION_CXX11 )
+    RichExceptionParams && add(
+            const char * const name_in,
+            const std::string & value_in ) &&
+    {
+        return std::move( add( name_in, value_in ) );
+    }
+    template< typename T >
+    RichExceptionParams && add(
+            const char * const name_in,
+            const T & value_in ) &&
+    {
+        return std::move( add( name_in, value_in ) );
+    }
+#endif
+
+    bool empty() const { return n_params == 0; }
+    size_t size() const { return n_params; }
+    const RichExceptionParameter & operator []( size_t i ) const { assert( i < n_params ); return p_params[i]; }
+
+    class find_name_predicate
+    {
+    private:
+        const char * seeking;
+    public:
+        find_name_predicate( const char * seeking_in ) : seeking( seeking_in ) {}
+        bool operator () ( const RichExceptionParameter & at ) { return names_match( seeking, at.name ); }
+    };
+    bool has( const char * name_in ) const
+    {
+        return find( name_in ) != 0;
+    }
+    // get() returns the text of the named parameter, or "" if there is no
+    // such parameter.  get_value() returns the value itself, without
+    // formatting or copying it.
+    std::string get( const char * name_in ) const   // Would use operator [], but conflicts with operator [](size_t)
+    {
+        return get_value( name_in ).str();
+    }
+    const RichExceptionValue & get_value( const char * name_in ) const
+    {
+        const RichExceptionParameter * p_found = find( name_in );
+        if( p_found )
+            return p_found->value;
+        return param_not_found();
+    }
+    // Looks up n_names names in a single pass, setting pp_values_out[i] to
+    // the value of names_in[i], or to 0 if there is no such parameter.
+    // Returns the number of names found.
+    size_t get_many( const char * const * names_in, size_t n_names, const RichExceptionValue ** pp_values_out ) const
+    {
+        size_t n_found = 0;
+        std::fill( pp_values_out, pp_values_out + n_names, static_cast< const RichExceptionValue * >( 0 ) );
+        if( p_index )
+        {
+            for( size_t i_name = 0; i_name < n_names; ++i_name )
+                if( const RichExceptionParameter * p_found = find( names_in[i_name] ) )
+                {
+                    pp_values_out[i_name] = &p_found->value;
+                    ++n_found;
+                }
+            return n_found;
+        }
+        for( size_t i_param = 0; i_param < n_params && n_found < n_names; ++i_param )
+            for( size_t i_name = 0; i_name < n_names; ++i_name )
+                if( ! pp_values_out[i_name] && names_match( names_in[i_name], p_params[i_param].name ) )
+                {
+                    pp_values_out[i_name] = &p_params[i_param].value;
+                    ++n_found;
+                }
+        return n_found;
+    }
+    static const RichExceptionValue & param_not_found()
+    {
+        static RichExceptionValue not_found;
+        return not_found;
+    }
+
+    std::string to_string() const
+    {
+        std::stringstream ss;
+        ss << *this;
+        return ss.str();
+    }
+
+    friend std::ostream & operator << ( std::ostream & os, const RichExceptionParams & r_params )
+    {
+        for( size_t i = 0; i < r_params.n_params; ++i )
+        {
+            if( i != 0 )
+                os << ", ";
+            os << r_params.p_params[i];
+        }
+        return os;
+    }
+};
+
+namespace detail {
+
+// Tsink is a std::ostream, or anything else with a write( const char *, size )
+// member, such as the sinks used by RichSerializer
+template< typename Tsink >
+void write_indent( Tsink & r_sink, size_t indent )
+{
+    static const char spaces[] = "                ";
+    while( indent > 0 )
+    {
+        size_t n_spaces = (std::min)( indent, sizeof( spaces ) - 1 );
+        r_sink.write( spaces, n_spaces );
+        indent -= n_spaces;
+    }
+}
+
+}   // namespace detail
+
+#if defined( RICH_EXCEPTION_STACK )
+
+//----------------------------------------------------------------------------
+// If RICH_EXCEPTION_STACK is defined, each RichExceptionNode records the
+// return addresses of up to RICH_EXCEPTION_STACK_DEPTH of the functions that
+// led to it being created.  Only the raw addresses are recorded when the
+// node is constructed.  They are converted to function names when the
+// exception is rendered by to_string() or operator <<, and the names are
+// cached for the life of the process so each address is only looked up once.
+//
+// With GCC and Clang on x86 and ARM64 Linux and macOS the addresses are
+// found by following the chain of frame pointers, which takes tens of
+// nanoseconds.  Compile with -fno-omit-frame-pointer to get complete traces,
+// and link with -rdynamic so that function names can be found.  Without frame
+// pointers a trace stops at the first function that doesn't keep one.  The
+// walk never leaves the thread's stack, so it is safe either way.  Other
+// platforms use RtlCaptureStackBackTrace() or backtrace().
+//
+// Capture can be switched off and on at run-time using
+// RichStackTrace::enable_capture().
+//----------------------------------------------------------------------------
+
+namespace detail {
+
+inline std::atomic< bool > & stack_capture_enabled()
+{
+    static std::atomic< bool > is_enabled( true );
+    return is_enabled;
+}
+
+#if defined( RICH_EXCEPTION_STACK_FRAME_POINTERS )
+inline const char * find_stack_top()
+{
+#if defined( __APPLE__ )
+    return static_cast< const char * >( pthread_get_stackaddr_np( pthread_self() ) );
+#else
+    pthread_attr_t attr;
+    if( pthread_getattr_np( pthread_self(), &attr ) != 0 )
+        return 0;
+    void * p_stack = 0;
+    size_t stack_size = 0;
+    int result = pthread_attr_getstack( &attr, &p_stack, &stack_size );
+    pthread_attr_destroy( &attr );
+    return result == 0 ? static_cast< const char * >( p_stack ) + stack_size : 0;
+#endif
+}
+
+inline const char * this_thread_stack_top()
+{
+    static thread_local const char * p_top = find_stack_top();
+    return p_top;
+}
+#endif
+
+// Records the return address of the caller of capture_stack() and those of
+// the functions above it
+RICH_EXCEPTION_NOINLINE inline size_t capture_stack( void ** p_frames, size_t max_frames )
+{
+#if defined( RICH_EXCEPTION_STACK_FRAME_POINTERS )
+    // Each frame starts with the caller's frame pointer followed by the
+    // return address into the caller.  Callers' frames are at higher
+    // addresses, so stop if a frame doesn't move towards the stack's top.
+    const char * p_top = this_thread_stack_top();
+    if( ! p_top )
+        return 0;
+    void * const * p_frame = static_cast< void * const * >( __builtin_frame_address( 0 ) );
+    size_t n_frames = 0;
+    while( n_frames < max_frames &&
+            reinterpret_cast< const char * >( p_frame + 2 ) <= p_top &&
+            ( reinterpret_cast< uintptr_t >( p_frame ) & ( sizeof( void * ) - 1 ) ) == 0 &&
+            p_frame[1] != 0 )
+    {
+        p_frames[n_frames++] = p_frame[1];
+        void * const * p_caller = static_cast< void * const * >( p_frame[0] );
+        if( p_caller <= p_frame )
+            break;
+        p_frame = p_caller;
+    }
+    return n_frames;
+#elif defined( _WIN32 )
+    return RtlCaptureStackBackTrace( 1, static_cast< DWORD >( max_frames ), p_frames, 0 );
+#else
+    void * p_all_frames[RICH_EXCEPTION_STACK_DEPTH + 1];
+    int n_all_frames = backtrace( p_all_frames, static_cast< int >( (std::min)( max_frames, size_t( RICH_EXCEPTION_STACK_DEPTH ) ) + 1 ) );
+    if( n_all_frames <= 1 )
+        return 0;
+    std::copy( p_all_frames + 1, p_all_frames + n_all_frames, p_frames );   // Skip capture_stack()'s own frame
+    return n_all_frames - 1;
+#endif
+}
+
+class RichSymbolCache
+{
+private:
+    std::mutex mutex;
+    std::unordered_map< const void *, std::string > symbols;
+
+public:
+    static RichSymbolCache & instance()
+    {
+        static RichSymbolCache * p_instance = new RichSymbolCache;  // Leaked so traces can be rendered during static destruction
+        return *p_instance;
+    }
+
+    std::string symbol( const void * p_address )
+    {
+        std::lock_guard< std::mutex > lock( mutex );
+        std::unordered_map< const void *, std::string >::const_iterator i( symbols.find( p_address ) );
+        if( i == symbols.end() )
+            i = symbols.emplace( p_address, look_up( p_address ) ).first;
+        return i->second;
+    }
+
+private:
+    static std::string hex( uintptr_t value )
+    {
+        char buffer[2 + 2 * sizeof( uintptr_t ) + 1];
+        RICH_EXCEPTION_SNPRINTF( buffer, sizeof( buffer ), "0x%llx", static_cast< unsigned long long >( value ) );
+        return buffer;
+    }
+
+    static std::string look_up( const void * p_address )
+    {
+        // A return address can be the first byte of the next function, so
+        // look up the address of the call instruction instead
+        const char * p_call = static_cast< const char * >( p_address ) - 1;
+        uintptr_t address = reinterpret_cast< uintptr_t >( p_address );
+#if defined( _WIN32 )
+        // DbgHelp is single threaded, which the cache's mutex takes care of
+        HANDLE process = GetCurrentProcess();
+        static const bool is_initialised = SymInitialize( process, 0, TRUE ) != FALSE;
+        DWORD64 buffer[( sizeof( SYMBOL_INFO ) + 256 + sizeof( DWORD64 ) - 1 ) / sizeof( DWORD64 )];
+        SYMBOL_INFO * p_symbol = reinterpret_cast< SYMBOL_INFO * >( buffer );
+        p_symbol->SizeOfStruct = sizeof( SYMBOL_INFO );
+        p_symbol->MaxNameLen = 255;
+        DWORD64 displacement = 0;
+        if( is_initialised && SymFromAddr( process, reinterpret_cast< DWORD64 >( p_call ), &displacement, p_symbol ) )
+            return std::string( p_symbol->Name ) + "+" + hex( static_cast< uintptr_t >( displacement + 1 ) );
+#else
+        Dl_info info;
+        if( dladdr( p_call, &info ) != 0 )
+        {
+            if( info.dli_sname && info.dli_saddr )
+            {
+                int status = 0;
+                char * p_demangled = abi::__cxa_demangle( info.dli_sname, 0, 0, &status );
+                std::string name( p_demangled && status == 0 ? p_demangled : info.dli_sname );
+                free( p_demangled );
+                return name + "+" + hex( address - reinterpret_cast< uintptr_t >( info.dli_saddr ) );
+            }
+            if( info.dli_fname && info.dli_fbase )
+            {
+                const char * p_file = strrchr( info.dli_fname, '/' );
+                return std::string( p_file ? p_file + 1 : info.dli_fname ) + "+" +
+                        hex( address - reinterpret_cast< uintptr_t >( info.dli_fbase ) );
+            }
+        }
+#endif
+        return hex( address );
+    }
+};
+
+}   // namespace detail
+
+class RichStackTrace
+{
+private:
+    void * frames[RICH_EXCEPTION_STACK_DEPTH];
+    size_t n_frames;
+
+public:
+    RichStackTrace() : n_frames( 0 ) {}
+
+    static void enable_capture( bool is_enabled_in ) { detail::stack_capture_enabled().store( is_enabled_in, std::memory_order_relaxed ); }
+    static bool is_capture_enabled() { return detail::stack_capture_enabled().load( std::memory_order_relaxed ); }
+
+    void capture()
+    {
+        n_frames = is_capture_enabled() ? detail::capture_stack( frames, RICH_EXCEPTION_STACK_DEPTH ) : 0;
+    }
+
+    bool empty() const { return n_frames == 0; }
+    size_t size() const { return n_frames; }
+    const void * operator[]( size_t i ) const { assert( i < n_frames ); return frames[i]; }
+
+    // Looks up the function name and offset for frame i.  If no name can be
+    // found the module and offset, or just the address, is returned.
+    std::string symbol( size_t i ) const
+    {
+        assert( i < n_frames );
+        return detail::RichSymbolCache::instance().symbol( frames[i] );
+    }
+
+    // The first frames are those of the constructors that captured the
+    // trace.  Where their names can be found they are left out when the
+    // trace is rendered.
+    size_t first_reported_frame() const
+    {
+        for( size_t i = 0; i < n_frames; ++i )
+            if( symbol( i ).find( "rich_excep::" ) == std::string::npos )
+                return i;
+        return 0;
+    }
+
+    void write( std::ostream & os, size_t indent ) const
+    {
+        for( size_t i = first_reported_frame(); i < n_frames; ++i )
+        {
+            detail::write_indent( os, indent );
+            os << "at " << symbol( i ) << "\n";
+        }
+    }
+};
+
+#endif
+
+template< size_t max_nodes, size_t max_params, size_t max_bytes >
+class StaticRichException;    // See rich-exception-static.h
+
+// A RichExceptionNode records one exception in a chain.  Nodes come in two
+// layouts: detail::RichParamsNode, which stores parameters, and the much
+// smaller detail::RichUriNode, which doesn't, for exceptions whose capture
+// policy discards them (see rich-exception-policy.h).  The error_params of a
+// node without parameter storage refer to a shared, empty
+// RichExceptionParams.
+struct RichExceptionNode
+{
+    const char * const error_uri;   // of the form "com.codalogic.mymodule.myerror" or ".mymodule.myerror"
+    const RichUriId error_uri_id;   // rich_uri_id( error_uri )
+    const RichExceptionParams & error_params;
+    const char * const description; // Human readable description
+#if defined( RICH_EXCEPTION_STACK )
+    RichStackTrace stack_trace;     // Where the node was created
+#endif
+
+private:
+    friend class RichException;
+    template< size_t max_nodes, size_t max_params, size_t max_bytes >
+    friend class StaticRichException;
+
+    // Nodes are shared between copies of exceptions, and are immutable once
+    // shared.  Each node holds a reference to the node after it.
+    RichExceptionParams * p_params; // The storage error_params refers to, or 0 if the layout has none
+    RichExceptionNode * p_next;     // The node describing the cause of this one, or 0 at the root cause
+    size_t chain_size;              // Number of nodes from this one to the root cause inclusive
+    mutable detail::RichRefCount n_refs;
+    bool is_embedded;               // Stored within a StaticRichException, so never shared or deleted
+#if defined( RICH_EXCEPTION_COMPACT )
+    size_t n_repeats;               // Identical consecutive exceptions merged into this node
+    size_t n_omitted;               // Exceptions dropped between this node and p_next to cap the depth
+#endif
+
+    static const RichExceptionParams & no_params()
+    {
+        static const RichExceptionParams empty;
+        return empty;
+    }
+
+protected:
+    // p_params_in is the derived layout's (not yet constructed) parameter
+    // storage, or 0
+    RichExceptionNode(
+            const char * const error_uri_in,
+            const char * const description_in,
+            RichExceptionParams * p_params_in )
+        :
+        error_uri( error_uri_in ),
+        error_uri_id( detail::hash_uri( error_uri_in ) ),
+        error_params( p_params_in ? *p_params_in : no_params() ),
+        description( description_in ),
+        p_params( p_params_in ),
+        p_next( 0 ),
+        chain_size( 1 ),
+        n_refs( 1 ),
+        is_embedded( false )
+#if defined( RICH_EXCEPTION_COMPACT )
+        ,
+        n_repeats( 1 ),
+        n_omitted( 0 )
+#endif
+    {
+#if defined( RICH_EXCEPTION_STACK )
+        stack_trace.capture();
+#endif
+    }
+    // Copies everything but the parameters and the links
+    RichExceptionNode( const RichExceptionNode & r_rhs, RichExceptionParams * p_params_in )
+        :
+        error_uri( r_rhs.error_uri ),
+        error_uri_id( r_rhs.error_uri_id ),
+        error_params( p_params_in ? *p_params_in : no_params() ),
+        description( r_rhs.description ),
+#if defined( RICH_EXCEPTION_STACK )
+        stack_trace( r_rhs.stack_trace ),
+#endif
+        p_params( p_params_in ),
+        p_next( 0 ),
+        chain_size( 1 ),
+        n_refs( 1 ),
+        is_embedded( false )
+#if defined( RICH_EXCEPTION_COMPACT )
+        ,
+        n_repeats( r_rhs.n_repeats ),
+        n_omitted( r_rhs.n_omitted )
+#endif
+    {
+    }
+
+    virtual RichExceptionNode * clone() const = 0;     // An unlinked copy with the same layout
+
+public:
+    virtual ~RichExceptionNode() {}
+
+    const RichExceptionNode * next() const { return p_next; }
+
+    bool has_params_storage() const { return p_params != 0; }
+
+    // With RICH_EXCEPTION_COMPACT, the number of identical consecutive
+    // exceptions this node stands for, and the number of exceptions omitted
+    // between it and next() to cap the depth of the chain
+#if defined( RICH_EXCEPTION_COMPACT )
+    size_t repeat_count() const { return n_repeats; }
+    size_t omitted_count() const { return n_omitted; }
+#else
+    size_t repeat_count() const { return 1; }
+    size_t omitted_count() const { return 0; }
+#endif
+
+    bool is_repeat_of( const RichExceptionNode & r_other ) const
+    {
+        return error_uri_id == r_other.error_uri_id &&
+                strcmp( error_uri, r_other.error_uri ) == 0 &&
+                strcmp( description, r_other.description ) == 0;
+    }
+
+    bool is( RichUriId error_uri_id_in ) const { return error_uri_id == error_uri_id_in; }
+
+    std::string to_string() const
+    {
+        std::stringstream ss;
+        ss << *this;
+        return ss.str();
+    }
+
+    friend std::ostream & operator << ( std::ostream & os, const RichExceptionNode & r_node )
+    {
+        os << r_node.error_uri;
+        if( ! r_node.error_params.empty() )
+            os << " (" << r_node.error_params << ")";
+        os << ": " << r_node.description;
+        if( r_node.repeat_count() > 1 )
+            os << " (x" << r_node.repeat_count() << ")";
+        return os;
+    }
+
+    // Nodes are always allocated via rich_allocate()
+    static void * operator new( size_t size, detail::RichAllocateTag ) { return detail::rich_allocate( size ); }
+    static void operator delete( void * p, detail::RichAllocateTag ) { detail::rich_deallocate( p ); }
+    static void operator delete( void * p ) { detail::rich_deallocate( p ); }
+
+private:
+    RichExceptionNode( const RichExceptionNode & );                 // Not implemented
+    RichExceptionNode & operator = ( const RichExceptionNode & );   // Not implemented
+};
+
+namespace detail {
+
+struct RichCopyLiteralsTag {};
+
+class RichParamsNode : public RichExceptionNode
+{
+public:
+    RichExceptionParams params;
+
+    RichParamsNode(
+            const char * const error_uri_in,
+            const char * const description_in )
+        :
+        RichExceptionNode( error_uri_in, description_in, &params )
+    {}
+    RichParamsNode(
+            const char * const error_uri_in,
+            const RichExceptionParams & error_params_in,
+            const char * const description_in )
+        :
+        RichExceptionNode( error_uri_in, description_in, &params ),
+        params( error_params_in )
+    {}
+#if defined( RICH_EXCEPTION_CXX11 )
+    RichParamsNode(
+            const char * const error_uri_in,
+            RichExceptionParams && error_params_in,
+            const char * const description_in )
+        :
+        RichExceptionNode( error_uri_in, description_in, &params ),
+        params( std::move( error_params_in ) )
+    {}
+#endif
+    explicit RichParamsNode( const RichExceptionNode & r_rhs )     // Copies a node of either layout
+        :
+        RichExceptionNode( r_rhs, &params ),
+        params( r_rhs.error_params )
+    {}
+    RichParamsNode( const RichExceptionNode & r_rhs, RichCopyLiteralsTag )  // Also copies the text of literal values
+        :
+        RichExceptionNode( r_rhs, &params )
+    {
+        for( size_t i = 0; i < r_rhs.error_params.size(); ++i )
+        {
+            const RichExceptionParameter & r_param( r_rhs.error_params[i] );
+            if( r_param.value.native_kind() == value_literal )
+            {
+                size_t length = 0;
+                const char * p_text = r_param.value.text( 0, length );    // Literals don't use the scratch buffer
+                params.add( r_param.name, RichExceptionValue( p_text, length ) );
+            }
+            else
+                params.add( r_param.name, r_param.value );
+        }
+    }
+
+protected:
+    virtual RichExceptionNode * clone() const { return new( rich_allocation ) RichParamsNode( *this ); }
+
+private:
+    RichParamsNode( const RichParamsNode & r_rhs )
+        :
+        RichExceptionNode( r_rhs, &params ),
+        params( r_rhs.params )
+    {}
+    RichParamsNode & operator = ( const RichParamsNode & );     // Not implemented
+};
+
+class RichUriNode : public RichExceptionNode
+{
+public:
+    RichUriNode(
+            const char * const error_uri_in,
+            const char * const description_in )
+        :
+        RichExceptionNode( error_uri_in, description_in, 0 )
+    {}
 
-    bool empty() const { return params.empty(); }
-    size_t size() const { return params.size(); }
-    const RichExceptionParameter & operator []( size_t i ) const { return params[i]; }
+protected:
+    virtual RichExceptionNode * clone() const { return new( rich_allocation ) RichUriNode( *this ); }
 
-    class find_name_predicate
-    {
-    private:
-        const char * seeking;
-    public:
-        find_name_predicate( const char * seeking_in ) : seeking( seeking_in ) {}
-        bool operator () ( const RichExceptionParameter & at ) { return strcmp( seeking, at.name ) == 0; }
-    };
-    bool has( const char * name_in ) const
+private:
+    RichUriNode( const RichUriNode & r_rhs ) : RichExceptionNode( r_rhs, 0 ) {}
+    RichUriNode & operator = ( const RichUriNode & );   // Not implemented
+};
+
+// Makes the node for an exception that chooses its own node layout
+class RichNodeFactory
+{
+public:
+    virtual RichExceptionNode * make() const = 0;
+
+protected:
+    ~RichNodeFactory() {}
+};
+
+// The nodes of a chain in order from the head, so that iterators can step
+// towards the head without rescanning the chain.  Made by an iterator when
+// it first needs to step backwards, and shared by copies of that iterator.
+class RichNodePath
+{
+private:
+    RichRefCount n_refs;
+    size_t n_nodes;
+
+    // The node pointers follow the object in the same allocation
+    const RichExceptionNode * * nodes() { return reinterpret_cast< const RichExceptionNode * * >( this + 1 ); }
+    const RichExceptionNode * const * nodes() const { return reinterpret_cast< const RichExceptionNode * const * >( this + 1 ); }
+
+    RichNodePath( const RichExceptionNode * p_head, size_t n_nodes_in ) : n_refs( 1 ), n_nodes( n_nodes_in )
     {
-        return std::find_if( params.begin(), params.end(), find_name_predicate( name_in ) ) != params.end();
+        for( size_t i = 0; i < n_nodes; ++i, p_head = p_head->next() )
+            nodes()[i] = p_head;
     }
-    const std::string & get( const char * name_in ) const   // Would use operator [], but conflicts with operator [](size_t)
+    ~RichNodePath() {}
+    RichNodePath( const RichNodePath & );               // Not implemented
+    RichNodePath & operator = ( const RichNodePath & ); // Not implemented
+
+public:
+    // Returns 0 if memory is exhausted, in which case at() walks the chain instead
+    static RichNodePath * make( const RichExceptionNode * p_head, size_t n_nodes_in )
     {
-        params_t::const_iterator i = std::find_if( params.begin(), params.end(), find_name_predicate( name_in ) );
-        if( i != params.end() )
-            return i->value;
-        return param_not_found();
+        void * p_memory = 0;
+        try
+        {
+            p_memory = rich_allocate( sizeof( RichNodePath ) + n_nodes_in * sizeof( const RichExceptionNode * ) );
+        }
+        catch( const std::bad_alloc & )
+        {
+            return 0;
+        }
+        return ::new( p_memory ) RichNodePath( p_head, n_nodes_in );
     }
-    static const std::string & param_not_found()
+    static RichNodePath * share( RichNodePath * p_path )
     {
-        static std::string not_found;
-        return not_found;
+        if( p_path )
+            p_path->n_refs.increment();
+        return p_path;
     }
-
-    std::string to_string() const
+    static void release( RichNodePath * p_path )
     {
-        std::stringstream ss;
-        ss << *this;
-        return ss.str();
+        if( p_path && p_path->n_refs.decrement() )
+        {
+            p_path->~RichNodePath();
+            rich_deallocate( p_path );
+        }
     }
 
-    friend std::ostream & operator << ( std::ostream & os, const RichExceptionParams & r_params )
+    // The node at position (counting from 0 at p_head) of the chain
+    static const RichExceptionNode * at( const RichNodePath * p_path, const RichExceptionNode * p_head, size_t position )
     {
-        bool is_first = true;
-        for( params_t::const_iterator i( r_params.params.begin() ),
-                    i_end( r_params.params.end() );
-                i != i_end;
-                ++i )
-        {
-            if( ! is_first )
-                os << ", ";
-            os << *i;
-            is_first = false;
-        }
-        return os;
+        if( p_path )
+            return p_path->nodes()[position];
+        for( ; position > 0; --position )
+            p_head = p_head->next();
+        return p_head;
     }
 };
 
-struct RichExceptionNode
+}   // namespace detail
+
+// A RichExceptionNode is shared between the exceptions whose chains include
+// it, and it can't be copied.  A RichExceptionNodeSnapshot is a copyable
+// value holding the same details, for code that needs to keep a node after
+// its exception has gone:
+//     RichExceptionNodeSnapshot node( *rich_exception.begin() );
+struct RichExceptionNodeSnapshot
 {
-    const char * const error_uri;   // of the form "com.codalogic.mymodule.myerror" or ".mymodule.myerror"
+    const char * error_uri;
+    RichUriId error_uri_id;
     RichExceptionParams error_params;
-    const char * const description; // Human readable description
+    const char * description;
+#if defined( RICH_EXCEPTION_STACK )
+    RichStackTrace stack_trace;
+#endif
+    size_t n_repeats;
+    size_t n_omitted;
 
-    RichExceptionNode(
-            const char * const error_uri_in,
-            const char * const description_in )
-        :
-        error_uri( error_uri_in ),
-        description( description_in )
-    {
-    }
-    RichExceptionNode(
-            const char * const error_uri_in,
-            const RichExceptionParams & error_params_in,
-            const char * const description_in )
+    RichExceptionNodeSnapshot( const RichExceptionNode & r_node )
         :
-        error_uri( error_uri_in ),
-        error_params( error_params_in ),
-        description( description_in )
+        error_uri( r_node.error_uri ),
+        error_uri_id( r_node.error_uri_id ),
+        error_params( r_node.error_params ),
+        description( r_node.description ),
+#if defined( RICH_EXCEPTION_STACK )
+        stack_trace( r_node.stack_trace ),
+#endif
+        n_repeats( r_node.repeat_count() ),
+        n_omitted( r_node.omitted_count() )
     {
     }
 
+    size_t repeat_count() const { return n_repeats; }
+    size_t omitted_count() const { return n_omitted; }
+
+    bool is( RichUriId error_uri_id_in ) const { return error_uri_id == error_uri_id_in; }
+
     std::string to_string() const
     {
         std::stringstream ss;
@@ -193,12 +2471,14 @@ struct RichExceptionNode
         return ss.str();
     }
 
-    friend std::ostream & operator << ( std::ostream & os, const RichExceptionNode & r_node )
+    friend std::ostream & operator << ( std::ostream & os, const RichExceptionNodeSnapshot & r_node )
     {
         os << r_node.error_uri;
         if( ! r_node.error_params.empty() )
             os << " (" << r_node.error_params << ")";
         os << ": " << r_node.description;
+        if( r_node.repeat_count() > 1 )
+            os << " (x" << r_node.repeat_count() << ")";
         return os;
     }
 };
@@ -206,91 +2486,689 @@ struct RichExceptionNode
 class RichException : public std::exception
 {
 private:
-    typedef std::list< RichExceptionNode > nodes_t;
-    mutable nodes_t nodes;
+    // The nodes form an intrusive singly-linked chain from the most recent
+    // exception (p_head) to the root cause.  Copies of an exception share
+    // its nodes, so copying costs a single reference count increment, and
+    // chaining a new exception onto a previous one prepends a node without
+    // touching the previous nodes.
+    RichExceptionNode * p_head;
 
 public:
-    typedef nodes_t::const_iterator const_iterator;
-    typedef nodes_t::const_reverse_iterator const_reverse_iterator;
-    typedef nodes_t::const_reference const_reference;
+    typedef const RichExceptionNode & const_reference;
+
+    class const_iterator
+    {
+        // Steps towards the root cause by following the links between nodes.
+        // Stepping towards the head uses a RichNodePath, made on the first step
+        // back, so traversing the chain in either direction is linear.
+    private:
+        const RichExceptionNode * p_head;
+        const RichExceptionNode * p_node;   // 0 at end()
+        size_t position;                    // Of p_node, counting from 0 at the head
+        detail::RichNodePath * p_path;
+
+    public:
+        typedef std::bidirectional_iterator_tag iterator_category;
+        typedef RichExceptionNode value_type;
+        typedef ptrdiff_t difference_type;
+        typedef const RichExceptionNode * pointer;
+        typedef const RichExceptionNode & reference;
+
+        const_iterator() : p_head( 0 ), p_node( 0 ), position( 0 ), p_path( 0 ) {}
+        const_iterator( const RichExceptionNode * p_head_in, const RichExceptionNode * p_node_in, size_t position_in, detail::RichNodePath * p_path_in = 0 )
+            : p_head( p_head_in ), p_node( p_node_in ), position( position_in ), p_path( detail::RichNodePath::share( p_path_in ) )
+        {}
+        const_iterator( const const_iterator & r_rhs )
+            : p_head( r_rhs.p_head ), p_node( r_rhs.p_node ), position( r_rhs.position ), p_path( detail::RichNodePath::share( r_rhs.p_path ) )
+        {}
+        const_iterator & operator = ( const const_iterator & r_rhs )
+        {
+            detail::RichNodePath * p_prev_path = p_path;
+            p_head = r_rhs.p_head;
+            p_node = r_rhs.p_node;
+            position = r_rhs.position;
+            p_path = detail::RichNodePath::share( r_rhs.p_path );
+            detail::RichNodePath::release( p_prev_path );
+            return *this;
+        }
+        ~const_iterator() { detail::RichNodePath::release( p_path ); }
+
+        reference operator * () const { return *p_node; }
+        pointer operator -> () const { return p_node; }
+        const_iterator & operator ++ () { p_node = p_node->next(); ++position; return *this; }
+        const_iterator operator ++ ( int ) { const_iterator prev( *this ); ++*this; return prev; }
+        const_iterator & operator -- ()
+        {
+            if( ! p_path )
+                p_path = detail::RichNodePath::make( p_head, p_head ? p_head->chain_size : 0 );
+            p_node = detail::RichNodePath::at( p_path, p_head, --position );
+            return *this;
+        }
+        const_iterator operator -- ( int ) { const_iterator prev( *this ); --*this; return prev; }
+        bool operator == ( const const_iterator & r_rhs ) const { return p_node == r_rhs.p_node; }
+        bool operator != ( const const_iterator & r_rhs ) const { return p_node != r_rhs.p_node; }
+    };
+
+    class const_reverse_iterator
+    {
+        // Steps from the root cause towards the head using a RichNodePath made
+        // by rbegin(), so a full traversal is linear.  (If memory is exhausted
+        // there's no path, and each node is found by walking from the head.)
+    private:
+        const RichExceptionNode * p_head;
+        size_t n_remaining;     // Position + 1 of the current node, counting from the head
+        detail::RichNodePath * p_path;
+
+        const RichExceptionNode * current() const { return detail::RichNodePath::at( p_path, p_head, n_remaining - 1 ); }
+
+    public:
+        typedef std::bidirectional_iterator_tag iterator_category;
+        typedef RichExceptionNode value_type;
+        typedef ptrdiff_t difference_type;
+        typedef const RichExceptionNode * pointer;
+        typedef const RichExceptionNode & reference;
+
+        const_reverse_iterator() : p_head( 0 ), n_remaining( 0 ), p_path( 0 ) {}
+        const_reverse_iterator( const RichExceptionNode * p_head_in, size_t n_remaining_in, detail::RichNodePath * p_path_in = 0 )
+            : p_head( p_head_in ), n_remaining( n_remaining_in ), p_path( detail::RichNodePath::share( p_path_in ) )
+        {}
+        const_reverse_iterator( const const_reverse_iterator & r_rhs )
+            : p_head( r_rhs.p_head ), n_remaining( r_rhs.n_remaining ), p_path( detail::RichNodePath::share( r_rhs.p_path ) )
+        {}
+        const_reverse_iterator & operator = ( const const_reverse_iterator & r_rhs )
+        {
+            detail::RichNodePath * p_prev_path = p_path;
+            p_head = r_rhs.p_head;
+            n_remaining = r_rhs.n_remaining;
+            p_path = detail::RichNodePath::share( r_rhs.p_path );
+            detail::RichNodePath::release( p_prev_path );
+            return *this;
+        }
+        ~const_reverse_iterator() { detail::RichNodePath::release( p_path ); }
+
+        reference operator * () const { return *current(); }
+        pointer operator -> () const { return current(); }
+        const_reverse_iterator & operator ++ () { --n_remaining; return *this; }
+        const_reverse_iterator operator ++ ( int ) { const_reverse_iterator prev( *this ); ++*this; return prev; }
+        const_reverse_iterator & operator -- ()
+        {
+            if( ! p_path && n_remaining > 0 )
+                p_path = detail::RichNodePath::make( p_head, p_head->chain_size );
+            ++n_remaining;
+            return *this;
+        }
+        const_reverse_iterator operator -- ( int ) { const_reverse_iterator prev( *this ); --*this; return prev; }
+        bool operator == ( const const_reverse_iterator & r_rhs ) const { return n_remaining == r_rhs.n_remaining; }
+        bool operator != ( const const_reverse_iterator & r_rhs ) const { return n_remaining != r_rhs.n_remaining; }
+
+        // As for std::reverse_iterator, the forward iterator one past the current node
+        const_iterator base() const
+        {
+            if( n_remaining == 0 )
+                return const_iterator( p_head, p_head, 0, p_path );
+            return const_iterator( p_head, current()->next(), n_remaining, p_path );
+        }
+    };
 
     RichException(
             const char * const error_uri_in,
             const char * const description_in,
             RichException * p_prev_rich_exception = 0 )
+        :
+        p_head( 0 )
+    {
+        RICH_EXCEPTION_INSTRUMENT_BEGIN();
+        push_front( new( detail::rich_allocation ) detail::RichParamsNode( error_uri_in, description_in ),
+                    p_prev_rich_exception );
+        RICH_EXCEPTION_INSTRUMENT_END( size() > 1 ? instrument_chain : instrument_construct, main_error_uri() );
+    }
+    RichException(
+            const char * const error_uri_in,
+            const RichExceptionParams & error_params_in,
+            const char * const description_in,
+            RichException * p_prev_rich_exception = 0 )
+        :
+        p_head( 0 )
+    {
+        RICH_EXCEPTION_INSTRUMENT_BEGIN();
+        push_front( new( detail::rich_allocation ) detail::RichParamsNode( error_uri_in, error_params_in, description_in ),
+                    p_prev_rich_exception );
+        RICH_EXCEPTION_INSTRUMENT_END( size() > 1 ? instrument_chain : instrument_construct, main_error_uri() );
+    }
+    // Chaining via a const reference shares the nodes of the previous
+    // exception without modifying it, so it remains usable, including by
+    // other threads (see RichExceptionHandle), e.g.:
+    //      catch( const FileException & e )
+    //      {
+    //          throw DatabaseException( row, column, e );
+    //      }
+    RichException(
+            const char * const error_uri_in,
+            const char * const description_in,
+            const RichException & r_prev_rich_exception )
+        :
+        p_head( 0 )
     {
-        if( p_prev_rich_exception )
-            nodes.swap( p_prev_rich_exception->nodes );
-        nodes.push_front( RichExceptionNode( error_uri_in, description_in ) );
+        RICH_EXCEPTION_INSTRUMENT_BEGIN();
+        push_front_shared( new( detail::rich_allocation ) detail::RichParamsNode( error_uri_in, description_in ),
+                    r_prev_rich_exception );
+        RICH_EXCEPTION_INSTRUMENT_END( size() > 1 ? instrument_chain : instrument_construct, main_error_uri() );
     }
     RichException(
             const char * const error_uri_in,
             const RichExceptionParams & error_params_in,
             const char * const description_in,
+            const RichException & r_prev_rich_exception )
+        :
+        p_head( 0 )
+    {
+        RICH_EXCEPTION_INSTRUMENT_BEGIN();
+        push_front_shared( new( detail::rich_allocation ) detail::RichParamsNode( error_uri_in, error_params_in, description_in ),
+                    r_prev_rich_exception );
+        RICH_EXCEPTION_INSTRUMENT_END( size() > 1 ? instrument_chain : instrument_construct, main_error_uri() );
+    }
+#if defined( RICH_EXCEPTION_CXX11 )
+    RichException(
+            const char * const error_uri_in,
+            RichExceptionParams && error_params_in,
+            const char * const description_in,
+            const RichException & r_prev_rich_exception )
+        :
+        p_head( 0 )
+    {
+        RICH_EXCEPTION_INSTRUMENT_BEGIN();
+        push_front_shared( new( detail::rich_allocation ) detail::RichParamsNode( error_uri_in, std::move( error_params_in ), description_in ),
+                    r_prev_rich_exception );
+        RICH_EXCEPTION_INSTRUMENT_END( size() > 1 ? instrument_chain : instrument_construct, main_error_uri() );
+    }
+
+    // Chaining via an rvalue reference takes the nodes of the previous
+    // exception without copying them, e.g.:
+    //      catch( FileException & e )
+    //      {
+    //          throw DatabaseException( row, column, std::move( e ) );
+    //      }
+    RichException(
+            const char * const error_uri_in,
+            const char * const description_in,
+            RichException && r_prev_rich_exception )
+        :
+        p_head( 0 )
+    {
+        RICH_EXCEPTION_INSTRUMENT_BEGIN();
+        push_front( new( detail::rich_allocation ) detail::RichParamsNode( error_uri_in, description_in ),
+                    &r_prev_rich_exception );
+        RICH_EXCEPTION_INSTRUMENT_END( size() > 1 ? instrument_chain : instrument_construct, main_error_uri() );
+    }
+    RichException(
+            const char * const error_uri_in,
+            RichExceptionParams && error_params_in,
+            const char * const description_in,
             RichException * p_prev_rich_exception = 0 )
+        :
+        p_head( 0 )
+    {
+        RICH_EXCEPTION_INSTRUMENT_BEGIN();
+        push_front( new( detail::rich_allocation ) detail::RichParamsNode( error_uri_in, std::move( error_params_in ), description_in ),
+                    p_prev_rich_exception );
+        RICH_EXCEPTION_INSTRUMENT_END( size() > 1 ? instrument_chain : instrument_construct, main_error_uri() );
+    }
+    RichException(
+            const char * const error_uri_in,
+            RichExceptionParams && error_params_in,
+            const char * const description_in,
+            RichException && r_prev_rich_exception )
+        :
+        p_head( 0 )
+    {
+        RICH_EXCEPTION_INSTRUMENT_BEGIN();
+        push_front( new( detail::rich_allocation ) detail::RichParamsNode( error_uri_in, std::move( error_params_in ), description_in ),
+                    &r_prev_rich_exception );
+        RICH_EXCEPTION_INSTRUMENT_END( size() > 1 ? instrument_chain : instrument_construct, main_error_uri() );
+    }
+    // Moving from a StaticRichException copies its nodes (see
+    // share_chain()), which may throw std::bad_alloc, so these aren't
+    // noexcept.  Otherwise they never throw.
+    RichException( RichException && r_rhs )
+        :
+        std::exception( r_rhs ),
+        p_head( r_rhs.p_head )
+    {
+        if( is_embedded( p_head ) )
+            p_head = copy_embedded_chain( p_head );
+        else
+            r_rhs.p_head = 0;
+    }
+    RichException & operator = ( RichException && r_rhs )
+    {
+        if( is_embedded( p_head ) || is_embedded( r_rhs.p_head ) )
+            return *this = static_cast< const RichException & >( r_rhs );
+        std::swap( p_head, r_rhs.p_head );
+        return *this;
+    }
+#endif
+    RichException( const RichException & r_rhs )
+        :
+        std::exception( r_rhs ),
+        p_head( share_chain( r_rhs.p_head ) )
+    {
+    }
+    RichException & operator = ( const RichException & r_rhs )
+    {
+        if( this != &r_rhs )
+        {
+            RichException copy( r_rhs );
+            std::swap( p_head, copy.p_head );
+        }
+        return *this;
+    }
+    virtual ~RichException() throw()
     {
-        if( p_prev_rich_exception )
-            nodes.swap( p_prev_rich_exception->nodes );
-        nodes.push_front( RichExceptionNode( error_uri_in, error_params_in, description_in ) );
+        release_chain( p_head );
     }
-    virtual ~RichException() throw() {}
 
+    // With C++11, add() on a temporary returns an rvalue so that
+    // "throw RichException( ... ).add( ... )" moves rather than copies.
     RichException & add(
             const char * const name_in,
-            const std::string & value_in )
+            const std::string & value_in ) RICH_EXCEPTION_LVALUE_QUALIFIER
     {
-        assert( ! nodes.empty() );
-        nodes.front().error_params.add( name_in, value_in );
+        RICH_EXCEPTION_INSTRUMENT_BEGIN();
+        writable_params().add( name_in, value_in );
+        RICH_EXCEPTION_INSTRUMENT_END( instrument_add, main_error_uri() );
         return *this;
     }
     template< typename T >
     RichException & add(
             const char * const name_in,
-            const T & value_in )
+            const T & value_in ) RICH_EXCEPTION_LVALUE_QUALIFIER
     {
-        assert( ! nodes.empty() );
-        nodes.front().error_params.add( name_in, value_in );
+        RICH_EXCEPTION_INSTRUMENT_BEGIN();
+        writable_params().add( name_in, value_in );
+        RICH_EXCEPTION_INSTRUMENT_END( instrument_add, main_error_uri() );
         return *this;
     }
+#if defined( RICH_EXCEPTION_CXX11 )
+    RichException && add(
+            const char * const name_in,
+            const std::string & value_in ) &&
+    {
+        return std::move( add( name_in, value_in ) );
+    }
+    template< typename T >
+    RichException && add(
+            const char * const name_in,
+            const T & value_in ) &&
+    {
+        return std::move( add( name_in, value_in ) );
+    }
+#endif
 
     virtual const char * what() const throw()
     {
-        if( ! nodes.empty() )
-            return nodes.front().description;
+        if( p_head )
+            return p_head->description;
         return "<Undescribed RichException>";
     }
     virtual const char * main_error_uri() const
     {
-        if( ! nodes.empty() )
-            return nodes.front().error_uri;
+        if( p_head )
+            return p_head->error_uri;
         return "<Unspecified error_uri>";
     }
 
-    bool empty() const { return nodes.empty(); }
-    size_t size() const { return nodes.size(); }
+    RichUriId main_error_uri_id() const     // Returns 0 if there are no nodes
+    {
+        if( p_head )
+            return p_head->error_uri_id;
+        return 0;
+    }
+    bool is( RichUriId error_uri_id_in ) const { return p_head && p_head->is( error_uri_id_in ); }
+
+    const_iterator find( RichUriId error_uri_id_in ) const     // Returns the most recent node with the id, or end()
+    {
+        const RichExceptionNode * p_node = p_head;
+        while( p_node && ! p_node->is( error_uri_id_in ) )
+            p_node = p_node->next();
+        return const_iterator( p_head, p_node, p_node ? p_head->chain_size - p_node->chain_size : size() );
+    }
+    bool has( RichUriId error_uri_id_in ) const { return find( error_uri_id_in ) != end(); }
 
-    const_reference front() const { return nodes.front(); }
-    const_iterator begin() const { return nodes.begin(); }
-    const_iterator end() const { return nodes.end(); }
-    const_reverse_iterator rbegin() const { return nodes.rbegin(); }
-    const_reverse_iterator rend() const { return nodes.rend(); }
+    bool empty() const { return p_head == 0; }
+    size_t size() const { return p_head ? p_head->chain_size : 0; }
+
+    const_reference front() const { return *p_head; }
+    const_iterator begin() const { return const_iterator( p_head, p_head, 0 ); }
+    const_iterator end() const { return const_iterator( p_head, 0, size() ); }
+    const_reverse_iterator rbegin() const
+    {
+        detail::RichNodePath * p_path = size() > 1 ? detail::RichNodePath::make( p_head, size() ) : 0;
+        const_reverse_iterator i_begin( p_head, size(), p_path );
+        detail::RichNodePath::release( p_path );
+        return i_begin;
+    }
+    const_reverse_iterator rend() const { return const_reverse_iterator( p_head, 0 ); }
 
     std::string to_string() const
     {
+        RICH_EXCEPTION_INSTRUMENT_BEGIN();
         std::stringstream ss;
-        ss << *this;
-        return ss.str();
+        write( ss );
+        std::string result( ss.str() );
+        RICH_EXCEPTION_INSTRUMENT_END( instrument_render, main_error_uri() );
+        return result;
     }
 
     friend std::ostream & operator << ( std::ostream & os, const RichException & r_exception )
     {
-        size_t indent = 0;
-        for( RichException::const_iterator i( r_exception.begin() ), i_end( r_exception.end() );
-                i != i_end;
-                ++i, indent += 2 )
-            os << std::string( indent, ' ' ) << *i << "\n";
+        RICH_EXCEPTION_INSTRUMENT_BEGIN();
+        r_exception.write( os );
+        RICH_EXCEPTION_INSTRUMENT_END( instrument_render, r_exception.main_error_uri() );
         return os;
     }
+
+private:
+    void write( std::ostream & os ) const
+    {
+        size_t indent = 0;
+        for( const_iterator i( begin() ), i_end( end() ); i != i_end; ++i, indent += 2 )
+        {
+            detail::write_indent( os, indent );
+            os << *i << "\n";
+#if defined( RICH_EXCEPTION_STACK )
+            i->stack_trace.write( os, indent + 4 );
+#endif
+            if( i->omitted_count() > 0 )
+            {
+                indent += 2;
+                detail::write_indent( os, indent );
+                os << "... " << i->omitted_count() << " more\n";
+            }
+        }
+    }
+
+    friend class RichExceptionHandle;
+    template< size_t max_nodes, size_t max_params, size_t max_bytes >
+    friend class StaticRichException;
+
+    RichException() : p_head( 0 ) {}    // Only for empty RichExceptionHandles, and StaticRichExceptions, which link their own nodes
+
+protected:
+    // For exceptions that choose the layout of their nodes (see
+    // rich-exception-policy.h)
+    explicit RichException(
+            const detail::RichNodeFactory & r_node_factory,
+            RichException * p_prev_rich_exception = 0 )
+        :
+        p_head( 0 )
+    {
+        RICH_EXCEPTION_INSTRUMENT_BEGIN();
+        push_front( r_node_factory.make(), p_prev_rich_exception );
+        RICH_EXCEPTION_INSTRUMENT_END( size() > 1 ? instrument_chain : instrument_construct, main_error_uri() );
+    }
+    RichException(
+            const detail::RichNodeFactory & r_node_factory,
+            const RichException & r_prev_rich_exception )
+        :
+        p_head( 0 )
+    {
+        RICH_EXCEPTION_INSTRUMENT_BEGIN();
+        push_front_shared( r_node_factory.make(), r_prev_rich_exception );
+        RICH_EXCEPTION_INSTRUMENT_END( size() > 1 ? instrument_chain : instrument_construct, main_error_uri() );
+    }
+#if defined( RICH_EXCEPTION_CXX11 )
+    RichException(
+            const detail::RichNodeFactory & r_node_factory,
+            RichException && r_prev_rich_exception )
+        :
+        p_head( 0 )
+    {
+        RICH_EXCEPTION_INSTRUMENT_BEGIN();
+        push_front( r_node_factory.make(), &r_prev_rich_exception );
+        RICH_EXCEPTION_INSTRUMENT_END( size() > 1 ? instrument_chain : instrument_construct, main_error_uri() );
+    }
+#endif
+
+private:
+
+    void push_front( RichExceptionNode * p_node, RichException * p_prev_rich_exception )
+    {
+        RichExceptionNode * p_next = 0;
+        if( p_prev_rich_exception && is_embedded( p_prev_rich_exception->p_head ) )
+            p_next = copy_embedded_chain( p_prev_rich_exception->p_head );
+        else if( p_prev_rich_exception )
+        {
+            p_next = p_prev_rich_exception->p_head;
+            p_prev_rich_exception->p_head = 0;
+        }
+        link( p_node, p_next );
+    }
+    void push_front_shared( RichExceptionNode * p_node, const RichException & r_prev_rich_exception )
+    {
+        link( p_node, share_chain( r_prev_rich_exception.p_head ) );
+    }
+    void link( RichExceptionNode * p_node, RichExceptionNode * p_next )    // Takes ownership of a reference to p_next
+    {
+        if( p_next )
+            RICH_EXCEPTION_STATS_COUNT( *p_next, false );
+#if defined( RICH_EXCEPTION_COMPACT )
+        if( p_next && p_node->is_repeat_of( *p_next ) )
+        {
+            // The new node replaces the one it repeats, keeping its own
+            // parameters, so that retry loops don't grow the chain
+            p_node->n_repeats += p_next->n_repeats;
+            p_node->n_omitted = p_next->n_omitted;
+            RichExceptionNode * p_repeated = p_next;
+            p_next = p_repeated->p_next;
+            if( p_next )
+                p_next->n_refs.increment();
+            release_chain( p_repeated );
+        }
+#endif
+        p_node->p_next = p_next;
+        if( p_next )
+            p_node->chain_size = p_next->chain_size + 1;
+        p_head = p_node;
+        RICH_EXCEPTION_STATS_COUNT( *p_node, true );
+#if defined( RICH_EXCEPTION_COMPACT )
+        while( p_head->chain_size > RICH_EXCEPTION_MAX_CHAIN_DEPTH )
+            drop_innermost_layer();
+#endif
+    }
+
+#if defined( RICH_EXCEPTION_COMPACT )
+    void drop_innermost_layer()
+    {
+        // Keeps the outermost RICH_EXCEPTION_MAX_CHAIN_DEPTH - 1 nodes and
+        // the root cause, dropping the node above the root cause.  Each kept
+        // node above the dropped one has its chain_size changed, so any of
+        // them that are shared with other exceptions are copied first.
+        // Copying a node makes the node after it shared, so once one node
+        // is copied, all the nodes after it down to the dropped one are too.
+        typedef char max_chain_depth_must_be_at_least_2[RICH_EXCEPTION_MAX_CHAIN_DEPTH >= 2 ? 1 : -1];
+        (void)sizeof( max_chain_depth_must_be_at_least_2 );
+        RichExceptionNode * p_node = p_head;    // Only just linked, so never shared
+        for( size_t depth = 0; ; ++depth )
+        {
+            --p_node->chain_size;
+            if( depth + 2 >= RICH_EXCEPTION_MAX_CHAIN_DEPTH )
+                break;
+            RichExceptionNode * p_next = p_node->p_next;
+            if( ! p_next->n_refs.is_unique() )
+            {
+                RichExceptionNode * p_copy = p_next->clone();
+                p_copy->p_next = p_next->p_next;
+                p_copy->chain_size = p_next->chain_size;
+                p_copy->p_next->n_refs.increment();
+                release_chain( p_next );
+                p_node->p_next = p_copy;
+                p_next = p_copy;
+            }
+            p_node = p_next;
+        }
+        RichExceptionNode * p_dropped = p_node->p_next;
+        p_node->n_omitted += p_dropped->n_repeats + p_dropped->n_omitted;
+        p_node->p_next = p_dropped->p_next;
+        p_node->p_next->n_refs.increment();
+        release_chain( p_dropped );
+    }
+#endif
+
+    RichExceptionParams & writable_params()
+    {
+        // Copy on write.  Only the head node is ever modified, and only
+        // the copy needs to be made when it is shared, or when it has no
+        // parameter storage.
+        assert( p_head );
+        if( ! p_head->n_refs.is_unique() || ! p_head->has_params_storage() )
+        {
+            RichExceptionNode * p_copy = new( detail::rich_allocation ) detail::RichParamsNode( *p_head );
+            p_copy->p_next = p_head->p_next;
+            p_copy->chain_size = p_head->chain_size;
+            if( p_copy->p_next )
+                p_copy->p_next->n_refs.increment();
+            release_chain( p_head );
+            p_head = p_copy;
+        }
+        return *p_head->p_params;
+    }
+
+    // Returns a reference to the chain from p_node for a new owner.  The
+    // nodes of a StaticRichException are embedded within it, so only live as
+    // long as it does.  They are copied to allocated nodes instead (which
+    // may throw std::bad_alloc), and so are never part of any other chain.
+    static RichExceptionNode * share_chain( RichExceptionNode * p_node )
+    {
+        if( is_embedded( p_node ) )
+            return copy_embedded_chain( p_node );
+        if( p_node )
+            p_node->n_refs.increment();
+        return p_node;
+    }
+    static bool is_embedded( const RichExceptionNode * p_node ) { return p_node && p_node->is_embedded; }
+    static RichExceptionNode * copy_embedded_chain( const RichExceptionNode * p_node )
+    {
+        // Literal values may refer to the StaticRichException's own text, so
+        // their text is copied too
+        RichExceptionNode * p_copy_head = 0;
+        RichExceptionNode * * pp_link = &p_copy_head;
+        try
+        {
+            for( ; p_node; p_node = p_node->p_next )
+            {
+                RichExceptionNode * p_copy = new( detail::rich_allocation ) detail::RichParamsNode( *p_node, detail::RichCopyLiteralsTag() );
+                p_copy->chain_size = p_node->chain_size;
+                *pp_link = p_copy;
+                pp_link = &p_copy->p_next;
+            }
+        }
+        catch( ... )
+        {
+            release_chain( p_copy_head );
+            throw;
+        }
+        return p_copy_head;
+    }
+
+    static void release_chain( RichExceptionNode * p_node )
+    {
+        while( p_node && ! p_node->is_embedded && p_node->n_refs.decrement() )
+        {
+            RichExceptionNode * p_next = p_node->p_next;
+            delete p_node;
+            p_node = p_next;
+        }
+    }
+};
+
+//----------------------------------------------------------------------------
+// RichExceptionHandle is an immutable, shared reference to a chain of
+// exception nodes, for handing exceptions between threads, or across futures
+// and coroutines.  Copying a handle only increments a reference count, and
+// since nothing can modify the nodes of a handle, copies can be used, and
+// destroyed, on any number of threads at once.  For example:
+//
+//      // Worker thread
+//      catch( const RichException & e )
+//      {
+//          queue.push( RichExceptionHandle( e ) );
+//      }
+//
+//      // Submitting thread
+//      RichExceptionHandle failure( queue.pop() );
+//      throw RichException( "com.codalogic.pool.task", "Task failed", failure );
+//
+// Chaining from a handle (which converts to a const RichException &) shares
+// its nodes, leaving the handle unchanged.  rethrow() throws the RichException
+// the handle was made from (without the type of any derived class), and with
+// C++11, handles can be converted to and from std::exception_ptr.
+//----------------------------------------------------------------------------
+
+class RichExceptionHandle
+{
+private:
+    RichException exception;    // Never modified
+
+public:
+    typedef RichException::const_reference const_reference;
+    typedef RichException::const_iterator const_iterator;
+    typedef RichException::const_reverse_iterator const_reverse_iterator;
+
+    RichExceptionHandle() {}    // An empty handle
+    explicit RichExceptionHandle( const RichException & r_exception ) : exception( r_exception ) {}
+
+    operator const RichException & () const { return exception; }
+    const RichException & get() const { return exception; }
+
+    void rethrow() const { throw exception; }
+
+#if defined( RICH_EXCEPTION_CXX11 )
+    std::exception_ptr to_exception_ptr() const { return std::make_exception_ptr( exception ); }
+
+    // Returns an empty handle if p_exception does not hold a RichException
+    static RichExceptionHandle from_exception_ptr( const std::exception_ptr & p_exception )
+    {
+        if( p_exception )
+        {
+            try
+            {
+                std::rethrow_exception( p_exception );
+            }
+            catch( const RichException & e )
+            {
+                return RichExceptionHandle( e );
+            }
+            catch( ... )
+            {
+            }
+        }
+        return RichExceptionHandle();
+    }
+    static RichExceptionHandle current() { return from_exception_ptr( std::current_exception() ); }
+#endif
+
+    const char * what() const { return exception.what(); }
+    const char * main_error_uri() const { return exception.main_error_uri(); }
+    RichUriId main_error_uri_id() const { return exception.main_error_uri_id(); }
+    bool is( RichUriId error_uri_id_in ) const { return exception.is( error_uri_id_in ); }
+    const_iterator find( RichUriId error_uri_id_in ) const { return exception.find( error_uri_id_in ); }
+    bool has( RichUriId error_uri_id_in ) const { return exception.has( error_uri_id_in ); }
+
+    bool empty() const { return exception.empty(); }
+    size_t size() const { return exception.size(); }
+
+    const_reference front() const { return exception.front(); }
+    const_iterator begin() const { return exception.begin(); }
+    const_iterator end() const { return exception.end(); }
+    const_reverse_iterator rbegin() const { return exception.rbegin(); }
+    const_reverse_iterator rend() const { return exception.rend(); }
+
+    std::string to_string() const { return exception.to_string(); }
+
+    friend std::ostream & operator << ( std::ostream & os, const RichExceptionHandle & r_handle )
+    {
+        return os << r_handle.exception;
+    }
 };
 
 }   // Namespace namespace rich_excep